@@ -0,0 +1,163 @@
+#include "../include/BuddyAllocator.h"
+#include "../include/GpuBufferAllocator.h"
+#include "../tests/MockWebGpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Buddy allocator throughput and fragmentation, on the CPU alone: bursts of
+// allocations freed in random order, then a long random alloc/free churn
+// holding about half the capacity, and the same churn through
+// GpuBufferAllocator against the mock device.
+namespace {
+    constexpr uint64_t Capacity = 64ull << 20;
+    constexpr uint64_t MinBlock = 256;
+    constexpr uint32_t BurstAllocations = 100000;
+    constexpr uint32_t ChurnOperations = 1000000;
+    constexpr uint32_t Repeats = 5;
+
+    using Clock = std::chrono::steady_clock;
+
+    double NanosecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    // Mostly small uniform and vertex ranges, now and then a large one
+    uint64_t RandomSize(std::mt19937& random)
+    {
+        uint32_t roll = random() % 100;
+        if (roll < 70) return 16 + random() % 1024;
+        if (roll < 95) return 1024 + random() % (64 << 10);
+        return (64 << 10) + random() % (1 << 20);
+    }
+
+    // Fill with one burst, free in random order
+    void BenchBurst()
+    {
+        double bestAllocateNs = 0.0;
+        double bestFreeNs = 0.0;
+        for (uint32_t repeat = 0; repeat < Repeats; ++repeat) {
+            std::mt19937 random(42);
+            std::vector<uint64_t> sizes(BurstAllocations);
+            for (uint64_t& size : sizes) size = 16 + random() % 4096;
+            std::vector<uint64_t> offsets;
+            offsets.reserve(BurstAllocations);
+
+            BuddyAllocator allocator;
+            allocator.Initialize(Capacity, MinBlock);
+            auto allocateStart = Clock::now();
+            for (uint64_t size : sizes) {
+                uint64_t offset = allocator.Allocate(size);
+                if (offset != BuddyAllocator::InvalidOffset) offsets.push_back(offset);
+            }
+            double allocateNs = NanosecondsSince(allocateStart) / BurstAllocations;
+
+            std::shuffle(offsets.begin(), offsets.end(), random);
+            auto freeStart = Clock::now();
+            for (uint64_t offset : offsets) allocator.Free(offset);
+            double freeNs = NanosecondsSince(freeStart) / (double)offsets.size();
+
+            if (repeat == 0 || allocateNs < bestAllocateNs) bestAllocateNs = allocateNs;
+            if (repeat == 0 || freeNs < bestFreeNs) bestFreeNs = freeNs;
+        }
+        std::cout << "Burst of " << BurstAllocations << " allocations of 16 B to 4 KiB, freed in random order\n"
+            << "  allocate " << std::setw(6) << bestAllocateNs << " ns (" << 1e3 / bestAllocateNs << " M/s), free "
+            << std::setw(6) << bestFreeNs << " ns (" << 1e3 / bestFreeNs << " M/s)\n";
+    }
+
+    // Random frees and allocations around half occupancy, the way buffers
+    // come and go while a scene streams in and out
+    void BenchChurn()
+    {
+        std::mt19937 random(7);
+        BuddyAllocator allocator;
+        allocator.Initialize(Capacity, MinBlock);
+        std::vector<uint64_t> live;
+
+        uint64_t failures = 0;
+        double fragmentationSum = 0.0;
+        double worstFragmentation = 0.0;
+        uint32_t samples = 0;
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ChurnOperations; ++i) {
+            // Three in four operations allocate below half occupancy, free above
+            bool belowHalf = allocator.GetStats().allocatedBytes < Capacity / 2;
+            bool allocate = live.empty() || (random() % 4 != 0) == belowHalf;
+            if (allocate) {
+                uint64_t offset = allocator.Allocate(RandomSize(random));
+                if (offset == BuddyAllocator::InvalidOffset) ++failures;
+                else live.push_back(offset);
+            }
+            else {
+                size_t index = random() % live.size();
+                allocator.Free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+            if (i % 1024 == 0) {
+                BuddyAllocatorStats stats = allocator.GetStats();
+                fragmentationSum += stats.fragmentation;
+                worstFragmentation = std::max(worstFragmentation, stats.fragmentation);
+                ++samples;
+            }
+        }
+        double ns = NanosecondsSince(start) / ChurnOperations;
+
+        BuddyAllocatorStats stats = allocator.GetStats();
+        std::cout << "Churn, " << ChurnOperations << " random operations around half of " << (Capacity >> 20) << " MiB\n"
+            << "  " << std::setw(6) << ns << " ns per operation, " << failures << " failed allocations\n"
+            << "  fragmentation average " << std::setprecision(3) << fragmentationSum / samples << ", worst "
+            << worstFragmentation << ", at the end " << stats.fragmentation << std::setprecision(1)
+            << " (" << stats.allocationCount << " allocations, largest free block " << (stats.largestFreeBlock >> 10) << " KiB)\n";
+
+        for (uint64_t offset : live) allocator.Free(offset);
+    }
+
+    // The same churn through the backing buffers, each mock call included
+    void BenchGpuBufferAllocator()
+    {
+        std::mt19937 random(7);
+        GpuBufferAllocator allocator;
+        allocator.Initialize(MockWebGpu::GetDevice());
+        std::vector<BufferAllocation> live;
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ChurnOperations; ++i) {
+            bool allocate = live.empty() || (random() % 4 != 0) == (live.size() < 4096);
+            if (allocate) {
+                BufferUsageClass usageClass = (BufferUsageClass)(random() % (uint32_t)BufferUsageClass::Count);
+                BufferAllocation allocation = allocator.Allocate(usageClass, RandomSize(random) & ~3ull);
+                if (allocation.IsValid()) live.push_back(allocation);
+            }
+            else {
+                size_t index = random() % live.size();
+                allocator.Free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+        double ns = NanosecondsSince(start) / ChurnOperations;
+
+        std::cout << "GpuBufferAllocator churn, " << ChurnOperations << " operations over four usage classes\n"
+            << "  " << std::setw(6) << ns << " ns per operation, "
+            << MockWebGpu::GetCallCount("wgpuDeviceCreateBuffer") << " backing buffers created\n";
+        allocator.Report(std::cout);
+
+        for (BufferAllocation& allocation : live) allocator.Free(allocation);
+        allocator.Terminate();
+    }
+}
+
+int main()
+{
+    std::cout << std::fixed << std::setprecision(1);
+    BenchBurst();
+    BenchChurn();
+    BenchGpuBufferAllocator();
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "../include/JobSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Job system microbenchmarks: the cost of spawning and waiting for jobs,
+// and how a data-parallel loop scales from 1 to N threads.
+//
+//   BenchJobSystem [maxThreads]     (default: one per core)
+namespace {
+    constexpr uint32_t SpawnedJobs = 100000;
+    constexpr uint32_t RoundTrips = 10000;
+    constexpr size_t Elements = 1 << 22;
+    constexpr size_t Grain = 1 << 14;
+    constexpr uint32_t Repeats = 5;
+
+    using Clock = std::chrono::steady_clock;
+
+    double NanosecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    // Enough arithmetic per element for the loop to be compute bound
+    void Work(std::vector<float>& data, size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i) {
+            float x = data[i];
+            for (int k = 0; k < 16; ++k) x = std::sqrt(x * x + 1.0f) * 0.5f;
+            data[i] = x;
+        }
+    }
+
+    // Empty jobs: what the scheduler itself costs
+    void BenchSpawn(uint32_t threads)
+    {
+        JobSystem jobSystem;
+        jobSystem.Initialize(threads - 1);
+
+        auto spawnStart = Clock::now();
+        Job* root = jobSystem.Create(nullptr);
+        for (uint32_t i = 0; i < SpawnedJobs; ++i) {
+            jobSystem.Spawn([]() {}, root);
+        }
+        jobSystem.Run(root);
+        jobSystem.Wait(root);
+        double spawnNs = NanosecondsSince(spawnStart) / SpawnedJobs;
+
+        // Latency of one job handed over and waited for
+        auto roundTripStart = Clock::now();
+        for (uint32_t i = 0; i < RoundTrips; ++i) {
+            Job* job = jobSystem.Create([]() {});
+            jobSystem.Run(job);
+            jobSystem.Wait(job);
+        }
+        double roundTripNs = NanosecondsSince(roundTripStart) / RoundTrips;
+
+        std::cout << std::setw(3) << threads << " threads: spawn " << std::setw(7) << spawnNs << " ns/job, "
+            << "run + wait " << std::setw(7) << roundTripNs << " ns\n";
+        jobSystem.Terminate();
+    }
+
+    // Best of a few runs, in milliseconds
+    template<typename Function>
+    double Measure(Function const& function)
+    {
+        double best = 0.0;
+        for (uint32_t i = 0; i < Repeats; ++i) {
+            auto start = Clock::now();
+            function();
+            double ms = NanosecondsSince(start) * 1e-6;
+            if (i == 0 || ms < best) best = ms;
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+    if (argc > 1) maxThreads = (uint32_t)std::strtoul(argv[1], nullptr, 10);
+    // Initialize(0) picks the worker count itself: start at one worker
+    if (maxThreads < 2) maxThreads = 2;
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Spawn overhead, " << SpawnedJobs << " empty children of one parent\n";
+    for (uint32_t threads = 2; threads <= maxThreads; ++threads) {
+        BenchSpawn(threads);
+    }
+
+    std::vector<float> data(Elements, 1.0f);
+    double serialMs = Measure([&data]() { Work(data, 0, data.size()); });
+    std::cout << "Scaling, ParallelFor over " << Elements << " elements in chunks of " << Grain << "\n";
+    std::cout << std::setw(3) << 1 << " thread:  " << std::setw(7) << serialMs << " ms (serial loop)\n";
+    for (uint32_t threads = 2; threads <= maxThreads; ++threads) {
+        JobSystem jobSystem;
+        jobSystem.Initialize(threads - 1);
+        double ms = Measure([&jobSystem, &data]() {
+            jobSystem.ParallelFor(0, data.size(), Grain, [&data](size_t first, size_t last) { Work(data, first, last); });
+            });
+        std::cout << std::setw(3) << threads << " threads: " << std::setw(7) << ms << " ms, speedup "
+            << std::setprecision(2) << serialMs / ms << "x, efficiency " << std::setprecision(0)
+            << 100.0 * serialMs / ms / threads << "%\n" << std::setprecision(1);
+        jobSystem.Terminate();
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "../include/RenderGraph.h"
+#include "../tests/MockWebGpu.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// Render graph compile and execute times against the mock device, for
+// graphs of growing size. The mock does no GPU work: what is measured is
+// the graph's own CPU cost.
+namespace {
+    constexpr uint32_t WarmupFrames = 16;
+    constexpr uint32_t MeasuredFrames = 1000;
+
+    RenderGraphTextureDesc ColorDesc()
+    {
+        RenderGraphTextureDesc desc;
+        desc.width = 1280;
+        desc.height = 720;
+        desc.format = WGPUTextureFormat_RGBA16Float;
+        desc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+        return desc;
+    }
+
+    // A chain of post-processing like passes, each reading the previous
+    // one's output. Every fourth pass also writes a debug texture only read
+    // by a pass without outputs: the debug pass is culled, its writer is
+    // kept for the chain.
+    void DeclareFrame(RenderGraph& graph, uint32_t passCount)
+    {
+        graph.Reset();
+        RenderGraphResource backbuffer = graph.ImportTexture("Backbuffer", nullptr, ColorDesc());
+        RenderGraphResource previous = InvalidRenderGraphResource;
+
+        for (uint32_t i = 0; i + 1 < passCount; ++i) {
+            RenderGraphResource output = graph.CreateTexture("Chain", ColorDesc());
+            uint32_t pass = graph.AddPass("Chain", RenderGraphPassType::Render, [](RenderGraphPassContext const&) {});
+            if (previous != InvalidRenderGraphResource) graph.Read(pass, previous);
+            graph.SetColorAttachment(pass, output, WGPULoadOp_Clear);
+
+            if (i % 4 == 0) {
+                RenderGraphResource debug = graph.CreateTexture("Debug", ColorDesc());
+                graph.Write(pass, debug);
+                uint32_t view = graph.AddPass("Debug view", RenderGraphPassType::Compute, [](RenderGraphPassContext const&) {});
+                graph.Read(view, debug);
+            }
+            previous = output;
+        }
+
+        uint32_t present = graph.AddPass("Present", RenderGraphPassType::Render, [](RenderGraphPassContext const&) {});
+        if (previous != InvalidRenderGraphResource) graph.Read(present, previous);
+        graph.SetColorAttachment(present, backbuffer, WGPULoadOp_Clear);
+    }
+
+    void Run(uint32_t passCount)
+    {
+        RenderGraph graph;
+        graph.Initialize(MockWebGpu::GetDevice());
+
+        double declareMs = 0.0;
+        double compileMs = 0.0;
+        double executeMs = 0.0;
+        uint64_t texturesBefore = 0;
+        for (uint32_t frame = 0; frame < WarmupFrames + MeasuredFrames; ++frame) {
+            if (frame == WarmupFrames) texturesBefore = MockWebGpu::GetCallCount("wgpuDeviceCreateTexture");
+
+            auto declareStart = std::chrono::steady_clock::now();
+            DeclareFrame(graph, passCount);
+            std::chrono::duration<double, std::milli> declareTime = std::chrono::steady_clock::now() - declareStart;
+
+            graph.Compile();
+            WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(MockWebGpu::GetDevice(), nullptr);
+            graph.Execute(encoder);
+            wgpuCommandEncoderRelease(encoder);
+
+            if (frame < WarmupFrames) continue;
+            declareMs += declareTime.count();
+            compileMs += graph.GetStats().compileMs;
+            executeMs += graph.GetStats().executeMs;
+        }
+
+        RenderGraphStats const& stats = graph.GetStats();
+        std::cout << std::setw(6) << stats.declaredPasses << " passes"
+            << std::setw(5) << stats.culledPasses << " culled"
+            << std::setw(5) << stats.encoderPasses << " encoder passes"
+            << std::setw(5) << stats.physicalTextures << "/" << stats.transientTextures << " textures"
+            << "  declare " << std::fixed << std::setprecision(4) << declareMs / MeasuredFrames << " ms"
+            << "  compile " << compileMs / MeasuredFrames << " ms"
+            << "  execute " << executeMs / MeasuredFrames << " ms"
+            << "  textures created " << MockWebGpu::GetCallCount("wgpuDeviceCreateTexture") - texturesBefore
+            << "\n";
+        graph.Terminate();
+    }
+}
+
+int main()
+{
+    std::cout << "Render graph, mean over " << MeasuredFrames << " frames\n";
+    for (uint32_t passCount : { 8u, 32u, 128u, 512u }) {
+        Run(passCount);
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "../include/JobSystem.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
+#define STBI_WRITE_NO_STDIO
+#include "../glfw/deps/stb_image_write.h"
+
+// JPEG screenshot encoding with stb_image_write, on a synthetic 4K frame: at
+// each quality, the serial encoder against stbi_write_jpg_to_func_parallel
+// on 2 to N threads, one strip of MCU rows per thread as FrameCapture does.
+//
+//   BenchStbJpg [maxThreads]     (default: one per core)
+namespace {
+    constexpr int Width = 3840;
+    constexpr int Height = 2160;
+    constexpr uint32_t Repeats = 5;
+    constexpr int Qualities[] = { 75, 90, 95 };
+
+    using Clock = std::chrono::steady_clock;
+
+    // Smooth gradients and flat shapes with a little noise, closer to a
+    // rendered frame than random bytes or a solid color
+    std::vector<uint8_t> MakeFrame()
+    {
+        std::vector<uint8_t> rgba((size_t)Width * Height * 4);
+        uint32_t noise = 12345;
+        for (int y = 0; y < Height; ++y) {
+            for (int x = 0; x < Width; ++x) {
+                noise = noise * 1664525u + 1013904223u;
+                int grain = (int)(noise >> 29) - 4;
+                bool inside = ((x / 320) + (y / 240)) % 3 == 0;
+                uint8_t* pixel = &rgba[((size_t)y * Width + x) * 4];
+                pixel[0] = (uint8_t)(inside ? 230 : (x * 255 / Width + grain) & 0xFF);
+                pixel[1] = (uint8_t)(inside ? 40 : (y * 255 / Height + grain) & 0xFF);
+                pixel[2] = (uint8_t)(((x + y) * 255 / (Width + Height)) & 0xFF);
+                pixel[3] = 255;
+            }
+        }
+        return rgba;
+    }
+
+    void CountBytes(void* context, void* /* data */, int size)
+    {
+        *static_cast<size_t*>(context) += (size_t)size;
+    }
+
+    void ParallelFor(void* parallelContext, int count, void (*job)(void* jobContext, int index), void* jobContext)
+    {
+        JobSystem& jobSystem = *static_cast<JobSystem*>(parallelContext);
+        jobSystem.ParallelFor(0, (size_t)count, 1, [job, jobContext](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) job(jobContext, (int)i);
+            });
+    }
+
+    // Best of a few runs, in milliseconds
+    template<typename Function>
+    double Measure(Function const& function)
+    {
+        double best = 0.0;
+        for (uint32_t i = 0; i < Repeats; ++i) {
+            auto start = Clock::now();
+            function();
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (i == 0 || ms < best) best = ms;
+        }
+        return best;
+    }
+
+    void PrintResult(char const* label, uint32_t threads, double ms, size_t bytes, double serialMs)
+    {
+        double megapixels = (double)Width * Height * 1e-6;
+        double inputMB = (double)Width * Height * 4 / (1024.0 * 1024.0);
+        std::cout << std::setw(10) << label << std::setw(3) << threads << std::setw(9) << ms << " ms "
+            << std::setw(7) << megapixels / (ms * 1e-3) << " MP/s " << std::setw(7) << inputMB / (ms * 1e-3)
+            << " MB/s  " << std::setw(9) << bytes << " bytes";
+        if (serialMs > 0.0) std::cout << "  speedup " << std::setprecision(2) << serialMs / ms << "x" << std::setprecision(1);
+        std::cout << '\n';
+    }
+
+    void BenchQuality(std::vector<uint8_t> const& rgba, int quality, uint32_t maxThreads)
+    {
+        std::cout << "Quality " << quality << ", " << Width << "x" << Height << " RGBA\n";
+        size_t serialBytes = 0;
+        double serialMs = Measure([&rgba, &serialBytes, quality]() {
+            serialBytes = 0;
+            stbi_write_jpg_to_func(CountBytes, &serialBytes, Width, Height, 4, rgba.data(), quality);
+            });
+        PrintResult("serial", 1, serialMs, serialBytes, 0.0);
+
+        for (uint32_t threads = 2; threads <= maxThreads; ++threads) {
+            JobSystem jobSystem;
+            jobSystem.Initialize(threads - 1);
+            size_t bytes = 0;
+            double ms = Measure([&rgba, &bytes, &jobSystem, quality, threads]() {
+                bytes = 0;
+                stbi_write_jpg_to_func_parallel(CountBytes, &bytes, Width, Height, 4, rgba.data(), quality,
+                    (int)threads, ParallelFor, &jobSystem);
+                });
+            PrintResult("parallel", threads, ms, bytes, serialMs);
+            jobSystem.Terminate();
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+    if (argc > 1) maxThreads = (uint32_t)std::strtoul(argv[1], nullptr, 10);
+    // Initialize(0) picks the worker count itself: start at one worker
+    if (maxThreads < 2) maxThreads = 2;
+
+    std::vector<uint8_t> rgba = MakeFrame();
+    std::cout << std::fixed << std::setprecision(1);
+    for (int quality : Qualities) BenchQuality(rgba, quality, maxThreads);
+    return 0;
+}
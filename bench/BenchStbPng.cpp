@@ -0,0 +1,145 @@
+#include "../include/JobSystem.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
+#define STBI_WRITE_NO_STDIO
+#include "../glfw/deps/stb_image_write.h"
+
+// PNG screenshot encoding with stb_image_write, on a synthetic 1080p frame:
+// the serial encoder against stbi_write_png_to_func_parallel on 2 to N
+// threads, one strip per thread as FrameCapture does, then the serial
+// encoder's throughput and compression ratio at each compression level.
+//
+//   BenchStbPng [maxThreads]     (default: one per core)
+namespace {
+    constexpr int Width = 1920;
+    constexpr int Height = 1080;
+    constexpr uint32_t Repeats = 5;
+    constexpr int Levels[] = { 1, 3, 5, 8, 10, 12 };
+
+    using Clock = std::chrono::steady_clock;
+
+    // Smooth gradients and flat shapes with a little noise, closer to a
+    // rendered frame than random bytes or a solid color
+    std::vector<uint8_t> MakeFrame()
+    {
+        std::vector<uint8_t> rgba((size_t)Width * Height * 4);
+        uint32_t noise = 12345;
+        for (int y = 0; y < Height; ++y) {
+            for (int x = 0; x < Width; ++x) {
+                noise = noise * 1664525u + 1013904223u;
+                int grain = (int)(noise >> 29) - 4;
+                bool inside = ((x / 160) + (y / 120)) % 3 == 0;
+                uint8_t* pixel = &rgba[((size_t)y * Width + x) * 4];
+                pixel[0] = (uint8_t)(inside ? 230 : (x * 255 / Width + grain) & 0xFF);
+                pixel[1] = (uint8_t)(inside ? 40 : (y * 255 / Height + grain) & 0xFF);
+                pixel[2] = (uint8_t)(((x + y) * 255 / (Width + Height)) & 0xFF);
+                pixel[3] = 255;
+            }
+        }
+        return rgba;
+    }
+
+    void CountBytes(void* context, void* /* data */, int size)
+    {
+        *static_cast<size_t*>(context) += (size_t)size;
+    }
+
+    void ParallelFor(void* parallelContext, int count, void (*job)(void* jobContext, int index), void* jobContext)
+    {
+        JobSystem& jobSystem = *static_cast<JobSystem*>(parallelContext);
+        jobSystem.ParallelFor(0, (size_t)count, 1, [job, jobContext](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) job(jobContext, (int)i);
+            });
+    }
+
+    // Best of a few runs, in milliseconds
+    template<typename Function>
+    double Measure(Function const& function)
+    {
+        double best = 0.0;
+        for (uint32_t i = 0; i < Repeats; ++i) {
+            auto start = Clock::now();
+            function();
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (i == 0 || ms < best) best = ms;
+        }
+        return best;
+    }
+
+    void PrintResult(char const* label, uint32_t threads, double ms, size_t bytes, double serialMs)
+    {
+        double inputMB = (double)Width * Height * 4 / (1024.0 * 1024.0);
+        std::cout << std::setw(10) << label << std::setw(3) << threads << std::setw(9) << ms << " ms "
+            << std::setw(7) << inputMB / (ms * 1e-3) << " MB/s  " << std::setw(9) << bytes << " bytes";
+        if (serialMs > 0.0) std::cout << "  speedup " << std::setprecision(2) << serialMs / ms << "x" << std::setprecision(1);
+        std::cout << '\n';
+    }
+
+    void BenchParallel(std::vector<uint8_t> const& rgba, uint32_t maxThreads)
+    {
+        std::cout << "Serial against parallel strips, " << Width << "x" << Height << " RGBA, level "
+            << stbi_write_png_compression_level << "\n";
+        size_t serialBytes = 0;
+        double serialMs = Measure([&rgba, &serialBytes]() {
+            serialBytes = 0;
+            stbi_write_png_to_func(CountBytes, &serialBytes, Width, Height, 4, rgba.data(), Width * 4);
+            });
+        PrintResult("serial", 1, serialMs, serialBytes, 0.0);
+
+        for (uint32_t threads = 2; threads <= maxThreads; ++threads) {
+            JobSystem jobSystem;
+            jobSystem.Initialize(threads - 1);
+            size_t bytes = 0;
+            double ms = Measure([&rgba, &bytes, &jobSystem, threads]() {
+                bytes = 0;
+                stbi_write_png_to_func_parallel(CountBytes, &bytes, Width, Height, 4, rgba.data(), Width * 4,
+                    (int)threads, ParallelFor, &jobSystem);
+                });
+            PrintResult("parallel", threads, ms, bytes, serialMs);
+            jobSystem.Terminate();
+        }
+    }
+
+    // Filter search and match finder cost against size, serially
+    void BenchLevels(std::vector<uint8_t> const& rgba)
+    {
+        int defaultLevel = stbi_write_png_compression_level;
+        std::cout << "Compression levels, serial\n";
+        for (int level : Levels) {
+            stbi_write_png_compression_level = level;
+            size_t bytes = 0;
+            double ms = Measure([&rgba, &bytes]() {
+                bytes = 0;
+                stbi_write_png_to_func(CountBytes, &bytes, Width, Height, 4, rgba.data(), Width * 4);
+                });
+            double inputMB = (double)rgba.size() / (1024.0 * 1024.0);
+            std::cout << "  level " << std::setw(2) << level << std::setw(9) << ms << " ms " << std::setw(7)
+                << inputMB / (ms * 1e-3) << " MB/s  " << std::setw(9) << bytes << " bytes  ratio "
+                << std::setprecision(2) << (double)rgba.size() / bytes << std::setprecision(1) << '\n';
+        }
+        stbi_write_png_compression_level = defaultLevel;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+    if (argc > 1) maxThreads = (uint32_t)std::strtoul(argv[1], nullptr, 10);
+    // Initialize(0) picks the worker count itself: start at one worker
+    if (maxThreads < 2) maxThreads = 2;
+
+    std::vector<uint8_t> rgba = MakeFrame();
+    std::cout << std::fixed << std::setprecision(1);
+    BenchParallel(rgba, maxThreads);
+    BenchLevels(rgba);
+    return 0;
+}
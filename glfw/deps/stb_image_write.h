@@ -31,6 +31,8 @@ BUILDING:
    unsigned char * my_compress(unsigned char *data, int data_len, int *out_len, int quality);
    The returned data will be freed with STBIW_FREE() (free() by default),
    so it must be heap allocated with STBIW_MALLOC() (malloc() by default),
+   You can #define STBIW_NO_SIMD to disable the SSE2/AVX2 PNG filter kernels,
+   they are enabled when the compiler targets SSE2 (and AVX2, e.g. -mavx2).
 
 UNICODE:
 
@@ -64,6 +66,29 @@ USAGE:
    where the callback is:
       void stbi_write_func(void *context, void *data, int size);
 
+   PNG can also be encoded on several threads, provided by the caller:
+
+     int stbi_write_png_to_func_parallel(stbi_write_func *func, void *context, int w, int h, int comp, const void *data, int stride_in_bytes,
+                                         int strips, stbi_write_parallel_for *parallel_for, void *parallel_context);
+
+   where parallel_for must call job(job_context, i) for every i in [0, count),
+   in any order and on any threads, and return once all calls returned:
+      void stbi_write_parallel_for(void *parallel_context, int count, void (*job)(void *job_context, int index), void *job_context);
+
+   The image is cut into 'strips' bands of rows, filtered and deflated
+   independently; each band ends with a sync flush so the bands concatenate
+   into a single valid zlib stream. Bands still match against the 32K of data
+   before them, so the file is only slightly larger than the serial one.
+   With STBIW_ZLIB_COMPRESS defined, only the filtering is parallel.
+
+   JPEG likewise, 'strips' bands of MCU rows being encoded on their own:
+
+     int stbi_write_jpg_to_func_parallel(stbi_write_func *func, void *context, int x, int y, int comp, const void *data, int quality,
+                                         int strips, stbi_write_parallel_for *parallel_for, void *parallel_context);
+
+   The file then has a restart interval per MCU row (DRI and RSTn markers),
+   which any baseline decoder handles, for a few bytes per row.
+
    You can configure it with these global variables:
       int stbi_write_tga_with_rle;             // defaults to true; set to 0 to disable RLE
       int stbi_write_png_compression_level;    // defaults to 8; set to higher for more compression
@@ -192,6 +217,13 @@ STBIWDEF int stbi_write_tga_to_func(stbi_write_func *func, void *context, int w,
 STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const float *data);
 STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x, int y, int comp, const void  *data, int quality);
 
+typedef void stbi_write_parallel_for(void *parallel_context, int count, void (*job)(void *job_context, int index), void *job_context);
+
+STBIWDEF int stbi_write_png_to_func_parallel(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data, int stride_in_bytes,
+                                             int strips, stbi_write_parallel_for *parallel_for, void *parallel_context);
+STBIWDEF int stbi_write_jpg_to_func_parallel(stbi_write_func *func, void *context, int x, int y, int comp, const void  *data, int quality,
+                                             int strips, stbi_write_parallel_for *parallel_for, void *parallel_context);
+
 STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #endif//INCLUDE_STB_IMAGE_WRITE_H
@@ -247,6 +279,15 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #define STBIW_UCHAR(x) (unsigned char) ((x) & 0xff)
 
+#if !defined(STBIW_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBIW_SSE2
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#define STBIW_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 #ifdef STB_IMAGE_WRITE_STATIC
 static int stbi_write_png_compression_level = 8;
 static int stbi_write_tga_with_rle = 1;
@@ -856,10 +897,31 @@ static int stbiw__zlib_bitrev(int code, int codebits)
    return res;
 }
 
+#ifdef STBIW_SSE2
+static int stbiw__ctz(unsigned int x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+   return __builtin_ctz(x);
+#else
+   int n = 0;
+   while (!(x & 1)) { x >>= 1; ++n; }
+   return n;
+#endif
+}
+#endif
+
 static unsigned int stbiw__zlib_countm(unsigned char *a, unsigned char *b, int limit)
 {
-   int i;
-   for (i=0; i < limit && i < 258; ++i)
+   int i = 0;
+   if (limit > 258) limit = 258;
+#ifdef STBIW_SSE2
+   for (; i+16 <= limit; i += 16) {
+      __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (a+i)), _mm_loadu_si128((__m128i *) (b+i)));
+      unsigned int diff = ~(unsigned int) _mm_movemask_epi8(eq) & 0xffff;
+      if (diff) return i + stbiw__ctz(diff);
+   }
+#endif
+   for (; i < limit; ++i)
       if (a[i] != b[i]) break;
    return i;
 }
@@ -890,62 +952,57 @@ static unsigned int stbiw__zhash(unsigned char *data)
 
 #define stbiw__ZHASH   16384
 
-#endif // STBIW_ZLIB_COMPRESS
+static void stbiw__zhash_insert(unsigned char ***hash_table, int h, unsigned char *p, int quality)
+{
+   // when hash table entry is too long, delete half the entries
+   if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2*quality) {
+      STBIW_MEMMOVE(hash_table[h], hash_table[h]+quality, sizeof(hash_table[h][0])*quality);
+      stbiw__sbn(hash_table[h]) = quality;
+   }
+   stbiw__sbpush(hash_table[h],p);
+}
 
-STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+// Fixed huffman symbols for data[start..end), appended to the current block.
+// Matches may reach back before 'start' through what is in hash_table.
+static unsigned char *stbiw__zlib_compress_range(unsigned char *out, unsigned int *bitbuf_io, int *bitcount_io, unsigned char ***hash_table,
+                                                 unsigned char *data, int start, int end, int quality)
 {
-#ifdef STBIW_ZLIB_COMPRESS
-   // user provided a zlib compress implementation, use that
-   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
-#else // use builtin
    static unsigned short lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
    static unsigned char  lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
    static unsigned short distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
    static unsigned char  disteb[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
-   unsigned int bitbuf=0;
-   int i,j, bitcount=0;
-   unsigned char *out = NULL;
-   unsigned char ***hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
-   if (hash_table == NULL)
-      return NULL;
-   if (quality < 5) quality = 5;
-
-   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
-   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
-   stbiw__zlib_add(1,1);  // BFINAL = 1
-   stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
-
-   for (i=0; i < stbiw__ZHASH; ++i)
-      hash_table[i] = NULL;
+   unsigned int bitbuf = *bitbuf_io;
+   int bitcount = *bitcount_io;
+   int i = start, j;
 
-   i=0;
-   while (i < data_len-3) {
+   while (i < end-3) {
       // hash next 3 bytes of data to be compressed
-      int h = stbiw__zhash(data+i)&(stbiw__ZHASH-1), best=3;
+      int h = stbiw__zhash(data+i)&(stbiw__ZHASH-1), best=2;
+      int longest = end-i < 258 ? end-i : 258;
       unsigned char *bestloc = 0;
       unsigned char **hlist = hash_table[h];
       int n = stbiw__sbcount(hlist);
-      for (j=0; j < n; ++j) {
-         if (hlist[j]-data > i-32768) { // if entry lies within window
-            int d = stbiw__zlib_countm(hlist[j], data+i, data_len-i);
-            if (d >= best) { best=d; bestloc=hlist[j]; }
+      // newest first, so the first longest match is also the closest one; the
+      // chain is in position order, so the first entry out of the window ends it
+      for (j=n-1; j >= 0 && best < longest; --j) {
+         if (hlist[j]-data <= i-32768) break; // if entry lies outside window
+         // a longer match has to agree on the byte right after 'best': most candidates fail there
+         if (hlist[j][best] == data[i+best]) {
+            int d = stbiw__zlib_countm(hlist[j], data+i, end-i);
+            if (d > best) { best=d; bestloc=hlist[j]; }
          }
       }
-      // when hash table entry is too long, delete half the entries
-      if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2*quality) {
-         STBIW_MEMMOVE(hash_table[h], hash_table[h]+quality, sizeof(hash_table[h][0])*quality);
-         stbiw__sbn(hash_table[h]) = quality;
-      }
-      stbiw__sbpush(hash_table[h],data+i);
+      stbiw__zhash_insert(hash_table, h, data+i, quality);
 
       if (bestloc) {
          // "lazy matching" - check match at *next* byte, and if it's better, do cur byte as literal
          h = stbiw__zhash(data+i+1)&(stbiw__ZHASH-1);
          hlist = hash_table[h];
          n = stbiw__sbcount(hlist);
-         for (j=0; j < n; ++j) {
-            if (hlist[j]-data > i-32767) {
-               int e = stbiw__zlib_countm(hlist[j], data+i+1, data_len-i-1);
+         for (j=n-1; j >= 0 && best < end-i-1 && best < 258; --j) {
+            if (hlist[j]-data <= i-32767) break;
+            if (hlist[j][best] == data[i+1+best]) {
+               int e = stbiw__zlib_countm(hlist[j], data+i+1, end-i-1);
                if (e > best) { // if next match is better, bail on current match
                   bestloc = NULL;
                   break;
@@ -970,8 +1027,128 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
       }
    }
    // write out final bytes
-   for (;i < data_len; ++i)
+   for (;i < end; ++i)
       stbiw__zlib_huffb(data[i]);
+
+   *bitbuf_io = bitbuf;
+   *bitcount_io = bitcount;
+   return out;
+}
+
+static unsigned int stbiw__adler32(unsigned char *data, int data_len)
+{
+   unsigned int s1=1, s2=0;
+   int i, j=0, blocklen = (int) (data_len % 5552);
+   while (j < data_len) {
+      for (i=0; i < blocklen; ++i) { s1 += data[j+i]; s2 += s1; }
+      s1 %= 65521; s2 %= 65521;
+      j += blocklen;
+      blocklen = 5552;
+   }
+   return (s2 << 16) | s1;
+}
+
+// adler32 of A followed by B, from adler32(A), adler32(B) and the length of B (as in zlib)
+static unsigned int stbiw__adler32_combine(unsigned int adler1, unsigned int adler2, int len2)
+{
+   unsigned int rem = (unsigned int) (len2 % 65521);
+   unsigned int sum1 = adler1 & 0xffff;
+   unsigned int sum2 = (rem * sum1) % 65521;
+   sum1 += (adler2 & 0xffff) + 65521 - 1;
+   sum2 += (adler1 >> 16) + (adler2 >> 16) + 65521 - rem;
+   if (sum1 >= 65521) sum1 -= 65521;
+   if (sum1 >= 65521) sum1 -= 65521;
+   if (sum2 >= (65521u << 1)) sum2 -= (65521u << 1);
+   if (sum2 >= 65521) sum2 -= 65521;
+   return (sum2 << 16) | sum1;
+}
+
+// Raw deflate blocks for data[start..end), no zlib header nor adler32. The
+// blocks end on a byte boundary: with a sync flush (empty stored block) if
+// 'last' is 0, with BFINAL set otherwise. Frees with stbiw__sbfree().
+static unsigned char *stbiw__zlib_compress_strip(unsigned char *data, int start, int end, int quality, int last)
+{
+   unsigned int bitbuf=0;
+   int i, j, bitcount=0;
+   unsigned char *out = NULL;
+   unsigned char ***hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
+   if (hash_table == NULL)
+      return NULL;
+   if (quality < 5) quality = 5;
+
+   for (i=0; i < stbiw__ZHASH; ++i)
+      hash_table[i] = NULL;
+   // prime the dictionary with the window before the strip
+   for (i = start > 32767 ? start-32767 : 0; i < start; ++i)
+      stbiw__zhash_insert(hash_table, stbiw__zhash(data+i)&(stbiw__ZHASH-1), data+i, quality);
+
+   stbiw__zlib_add(last ? 1 : 0,1);  // BFINAL
+   stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
+   out = stbiw__zlib_compress_range(out, &bitbuf, &bitcount, hash_table, data, start, end, quality);
+   stbiw__zlib_huff(256); // end of block
+   if (!last) {
+      // sync flush: empty stored block
+      stbiw__zlib_add(0,1);
+      stbiw__zlib_add(0,2);
+   }
+   while (bitcount)
+      stbiw__zlib_add(0,1);
+   if (!last) {
+      stbiw__sbpush(out, 0x00);
+      stbiw__sbpush(out, 0x00);
+      stbiw__sbpush(out, 0xff);
+      stbiw__sbpush(out, 0xff);
+   }
+
+   for (i=0; i < stbiw__ZHASH; ++i)
+      (void) stbiw__sbfree(hash_table[i]);
+   STBIW_FREE(hash_table);
+
+   // store uncompressed instead if compression was worse
+   if (stbiw__sbn(out) > (end-start) + ((end-start+32766)/32767)*5) {
+      stbiw__sbn(out) = 0;
+      for (j = start; j < end;) {
+         int blocklen = end - j;
+         if (blocklen > 32767) blocklen = 32767;
+         stbiw__sbpush(out, last && end - j == blocklen); // BFINAL = ?, BTYPE = 0 -- no compression
+         stbiw__sbpush(out, STBIW_UCHAR(blocklen)); // LEN
+         stbiw__sbpush(out, STBIW_UCHAR(blocklen >> 8));
+         stbiw__sbpush(out, STBIW_UCHAR(~blocklen)); // NLEN
+         stbiw__sbpush(out, STBIW_UCHAR(~blocklen >> 8));
+         stbiw__sbmaybegrow(out, blocklen);
+         memcpy(out+stbiw__sbn(out), data+j, blocklen);
+         stbiw__sbn(out) += blocklen;
+         j += blocklen;
+      }
+   }
+   return out;
+}
+
+#endif // STBIW_ZLIB_COMPRESS
+
+STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+{
+#ifdef STBIW_ZLIB_COMPRESS
+   // user provided a zlib compress implementation, use that
+   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
+#else // use builtin
+   unsigned int bitbuf=0;
+   int i,j, bitcount=0;
+   unsigned char *out = NULL;
+   unsigned char ***hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
+   if (hash_table == NULL)
+      return NULL;
+   if (quality < 5) quality = 5;
+
+   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
+   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
+   stbiw__zlib_add(1,1);  // BFINAL = 1
+   stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
+
+   for (i=0; i < stbiw__ZHASH; ++i)
+      hash_table[i] = NULL;
+
+   out = stbiw__zlib_compress_range(out, &bitbuf, &bitcount, hash_table, data, 0, data_len, quality);
    stbiw__zlib_huff(256); // end of block
    // pad with 0 bits to byte boundary
    while (bitcount)
@@ -1000,19 +1177,11 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
 
    {
       // compute adler32 on input
-      unsigned int s1=1, s2=0;
-      int blocklen = (int) (data_len % 5552);
-      j=0;
-      while (j < data_len) {
-         for (i=0; i < blocklen; ++i) { s1 += data[j+i]; s2 += s1; }
-         s1 %= 65521; s2 %= 65521;
-         j += blocklen;
-         blocklen = 5552;
-      }
-      stbiw__sbpush(out, STBIW_UCHAR(s2 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s2));
-      stbiw__sbpush(out, STBIW_UCHAR(s1 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s1));
+      unsigned int adler = stbiw__adler32(data, data_len);
+      stbiw__sbpush(out, STBIW_UCHAR(adler >> 24));
+      stbiw__sbpush(out, STBIW_UCHAR(adler >> 16));
+      stbiw__sbpush(out, STBIW_UCHAR(adler >> 8));
+      stbiw__sbpush(out, STBIW_UCHAR(adler));
    }
    *out_len = stbiw__sbn(out);
    // make returned pointer freeable
@@ -1088,6 +1257,120 @@ static unsigned char stbiw__paeth(int a, int b, int c)
    return STBIW_UCHAR(c);
 }
 
+#ifdef STBIW_SSE2
+// paeth predictor on 8 pixels bytes widened to 16 bits
+static __m128i stbiw__paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i bc = _mm_sub_epi16(b, c), ac = _mm_sub_epi16(a, c), abc = _mm_add_epi16(bc, ac);
+   __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+   __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+   __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+   __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+   __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+   __m128i bc_pick = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+   return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, bc_pick));
+}
+
+#ifdef STBIW_AVX2
+static __m256i stbiw__paeth_avx2(__m256i a, __m256i b, __m256i c)
+{
+   __m256i bc = _mm256_sub_epi16(b, c), ac = _mm256_sub_epi16(a, c);
+   __m256i pa = _mm256_abs_epi16(bc), pb = _mm256_abs_epi16(ac), pc = _mm256_abs_epi16(_mm256_add_epi16(bc, ac));
+   __m256i not_a = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb), _mm256_cmpgt_epi16(pa, pc));
+   __m256i not_b = _mm256_cmpgt_epi16(pb, pc);
+   return _mm256_blendv_epi8(a, _mm256_blendv_epi8(b, c, not_b), not_a);
+}
+#endif
+
+// bytes [n, i) of the filtered line, i is returned; the caller does the tail
+static int stbiw__encode_png_line_simd(unsigned char *z, int signed_stride, int len, int n, int type, signed char *line_buffer)
+{
+   __m128i zero = _mm_setzero_si128();
+   int i = n;
+#ifdef STBIW_AVX2
+   __m256i zero256 = _mm256_setzero_si256();
+   for (; i+32 <= len; i += 32) {
+      __m256i x = _mm256_loadu_si256((__m256i *) (z+i)), pred;
+      __m256i a = _mm256_loadu_si256((__m256i *) (z+i-n));
+      __m256i b, c;
+      switch (type) {
+         case 1: case 6: pred = a; break;
+         case 2: pred = _mm256_loadu_si256((__m256i *) (z+i-signed_stride)); break;
+         case 3: // floor((a+b)/2): avg rounds up, take the carry back
+            b = _mm256_loadu_si256((__m256i *) (z+i-signed_stride));
+            pred = _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+            break;
+         case 4:
+            b = _mm256_loadu_si256((__m256i *) (z+i-signed_stride));
+            c = _mm256_loadu_si256((__m256i *) (z+i-signed_stride-n));
+            pred = _mm256_packus_epi16(
+               stbiw__paeth_avx2(_mm256_unpacklo_epi8(a, zero256), _mm256_unpacklo_epi8(b, zero256), _mm256_unpacklo_epi8(c, zero256)),
+               stbiw__paeth_avx2(_mm256_unpackhi_epi8(a, zero256), _mm256_unpackhi_epi8(b, zero256), _mm256_unpackhi_epi8(c, zero256)));
+            break;
+         default: // 5
+            pred = _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7f));
+            break;
+      }
+      _mm256_storeu_si256((__m256i *) (line_buffer+i), _mm256_sub_epi8(x, pred));
+   }
+#endif
+   for (; i+16 <= len; i += 16) {
+      __m128i x = _mm_loadu_si128((__m128i *) (z+i)), pred;
+      __m128i a = _mm_loadu_si128((__m128i *) (z+i-n));
+      __m128i b, c;
+      switch (type) {
+         case 1: case 6: pred = a; break;
+         case 2: pred = _mm_loadu_si128((__m128i *) (z+i-signed_stride)); break;
+         case 3: // floor((a+b)/2): avg rounds up, take the carry back
+            b = _mm_loadu_si128((__m128i *) (z+i-signed_stride));
+            pred = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            break;
+         case 4:
+            b = _mm_loadu_si128((__m128i *) (z+i-signed_stride));
+            c = _mm_loadu_si128((__m128i *) (z+i-signed_stride-n));
+            pred = _mm_packus_epi16(
+               stbiw__paeth_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+               stbiw__paeth_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+            break;
+         default: // 5
+            pred = _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7f));
+            break;
+      }
+      _mm_storeu_si128((__m128i *) (line_buffer+i), _mm_sub_epi8(x, pred));
+   }
+   return i;
+}
+#endif // STBIW_SSE2
+
+// sum of the absolute values of the filtered bytes, the filter selection heuristic
+static int stbiw__png_line_cost(signed char *line_buffer, int len)
+{
+   int i = 0, est = 0;
+#ifdef STBIW_SSE2
+   __m128i zero = _mm_setzero_si128(), sum = _mm_setzero_si128();
+#ifdef STBIW_AVX2
+   __m256i sum256 = _mm256_setzero_si256();
+   for (; i+32 <= len; i += 32) {
+      __m256i v = _mm256_abs_epi8(_mm256_loadu_si256((__m256i *) (line_buffer+i)));
+      sum256 = _mm256_add_epi64(sum256, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+   }
+   sum = _mm_add_epi64(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+#endif
+   for (; i+16 <= len; i += 16) {
+      // |v| as unsigned: the smaller of v and -v, 128 for -128
+      __m128i v = _mm_loadu_si128((__m128i *) (line_buffer+i));
+      v = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+      sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+   }
+   sum = _mm_add_epi64(sum, _mm_srli_si128(sum, 8));
+   est = _mm_cvtsi128_si32(sum);
+#endif
+   for (; i < len; ++i)
+      est += abs(line_buffer[i]);
+   return est;
+}
+
 // @OPTIMIZE: provide an option that always forces left-predict or paeth predict
 static void stbiw__encode_png_line(unsigned char *pixels, int stride_bytes, int width, int height, int y, int n, int filter_type, signed char *line_buffer)
 {
@@ -1115,71 +1398,74 @@ static void stbiw__encode_png_line(unsigned char *pixels, int stride_bytes, int
          case 6: line_buffer[i] = z[i]; break;
       }
    }
+#ifdef STBIW_SSE2
+   i = stbiw__encode_png_line_simd(z, signed_stride, width*n, n, type, line_buffer);
+#else
+   i = n;
+#endif
    switch (type) {
-      case 1: for (i=n; i < width*n; ++i) line_buffer[i] = z[i] - z[i-n]; break;
-      case 2: for (i=n; i < width*n; ++i) line_buffer[i] = z[i] - z[i-signed_stride]; break;
-      case 3: for (i=n; i < width*n; ++i) line_buffer[i] = z[i] - ((z[i-n] + z[i-signed_stride])>>1); break;
-      case 4: for (i=n; i < width*n; ++i) line_buffer[i] = z[i] - stbiw__paeth(z[i-n], z[i-signed_stride], z[i-signed_stride-n]); break;
-      case 5: for (i=n; i < width*n; ++i) line_buffer[i] = z[i] - (z[i-n]>>1); break;
-      case 6: for (i=n; i < width*n; ++i) line_buffer[i] = z[i] - stbiw__paeth(z[i-n], 0,0); break;
+      case 1: for (; i < width*n; ++i) line_buffer[i] = z[i] - z[i-n]; break;
+      case 2: for (; i < width*n; ++i) line_buffer[i] = z[i] - z[i-signed_stride]; break;
+      case 3: for (; i < width*n; ++i) line_buffer[i] = z[i] - ((z[i-n] + z[i-signed_stride])>>1); break;
+      case 4: for (; i < width*n; ++i) line_buffer[i] = z[i] - stbiw__paeth(z[i-n], z[i-signed_stride], z[i-signed_stride-n]); break;
+      case 5: for (; i < width*n; ++i) line_buffer[i] = z[i] - (z[i-n]>>1); break;
+      case 6: for (; i < width*n; ++i) line_buffer[i] = z[i] - stbiw__paeth(z[i-n], 0,0); break;
    }
 }
 
-STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+// filters rows [y0,y1) into filt: per row, the filter type then the filtered bytes
+static int stbiw__filter_png_rows(unsigned char *filt, const unsigned char *pixels, int stride_bytes, int x, int y, int n, int y0, int y1)
 {
    int force_filter = stbi_write_force_png_filter;
-   int ctype[5] = { -1, 0, 4, 2, 6 };
-   unsigned char sig[8] = { 137,80,78,71,13,10,26,10 };
-   unsigned char *out,*o, *filt, *zlib;
-   signed char *line_buffer;
-   int j,zlen;
-
-   if (stride_bytes == 0)
-      stride_bytes = x * n;
+   signed char *line_buffer, *best_buffer, *buffers;
+   int j;
 
    if (force_filter >= 5) {
       force_filter = -1;
    }
 
-   filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y); if (!filt) return 0;
-   line_buffer = (signed char *) STBIW_MALLOC(x * n); if (!line_buffer) { STBIW_FREE(filt); return 0; }
-   for (j=0; j < y; ++j) {
+   buffers = (signed char *) STBIW_MALLOC(2 * x * n); if (!buffers) return 0;
+   for (j=y0; j < y1; ++j) {
       int filter_type;
+      line_buffer = buffers;
+      best_buffer = buffers + x * n;
       if (force_filter > -1) {
          filter_type = force_filter;
-         stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, force_filter, line_buffer);
+         stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, force_filter, best_buffer);
       } else { // Estimate the best filter by running through all of them:
-         int best_filter = 0, best_filter_val = 0x7fffffff, est, i;
+         int best_filter = 0, best_filter_val = 0x7fffffff, est;
          for (filter_type = 0; filter_type < 5; filter_type++) {
             stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, filter_type, line_buffer);
 
             // Estimate the entropy of the line using this filter; the less, the better.
-            est = 0;
-            for (i = 0; i < x*n; ++i) {
-               est += abs((signed char) line_buffer[i]);
-            }
+            est = stbiw__png_line_cost(line_buffer, x*n);
             if (est < best_filter_val) {
+               // keep it rather than encoding the winner again
+               signed char *t = best_buffer; best_buffer = line_buffer; line_buffer = t;
                best_filter_val = est;
                best_filter = filter_type;
             }
          }
-         if (filter_type != best_filter) {  // If the last iteration already got us the best filter, don't redo it
-            stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, best_filter, line_buffer);
-            filter_type = best_filter;
-         }
+         filter_type = best_filter;
       }
-      // when we get here, filter_type contains the filter type, and line_buffer contains the data
+      // when we get here, filter_type contains the filter type, and best_buffer contains the data
       filt[j*(x*n+1)] = (unsigned char) filter_type;
-      STBIW_MEMMOVE(filt+j*(x*n+1)+1, line_buffer, x*n);
+      STBIW_MEMMOVE(filt+j*(x*n+1)+1, best_buffer, x*n);
    }
-   STBIW_FREE(line_buffer);
-   zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, stbi_write_png_compression_level);
-   STBIW_FREE(filt);
-   if (!zlib) return 0;
+   STBIW_FREE(buffers);
+   return 1;
+}
+
+// wraps a zlib stream into the PNG chunks, frees zlib
+static unsigned char *stbiw__png_wrap(unsigned char *zlib, int zlen, int x, int y, int n, int *out_len)
+{
+   int ctype[5] = { -1, 0, 4, 2, 6 };
+   unsigned char sig[8] = { 137,80,78,71,13,10,26,10 };
+   unsigned char *out,*o;
 
    // each tag requires 12 bytes of overhead
    out = (unsigned char *) STBIW_MALLOC(8 + 12+13 + 12+zlen + 12);
-   if (!out) return 0;
+   if (!out) { STBIW_FREE(zlib); return 0; }
    *out_len = 8 + 12+13 + 12+zlen + 12;
 
    o=out;
@@ -1211,6 +1497,132 @@ STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int s
    return out;
 }
 
+STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+{
+   unsigned char *filt, *zlib;
+   int zlen;
+
+   if (stride_bytes == 0)
+      stride_bytes = x * n;
+
+   filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y); if (!filt) return 0;
+   if (!stbiw__filter_png_rows(filt, pixels, stride_bytes, x, y, n, 0, y)) { STBIW_FREE(filt); return 0; }
+   zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, stbi_write_png_compression_level);
+   STBIW_FREE(filt);
+   if (!zlib) return 0;
+
+   return stbiw__png_wrap(zlib, zlen, x, y, n, out_len);
+}
+
+typedef struct
+{
+   const unsigned char *pixels;
+   unsigned char *filt;
+   int stride_bytes, x, y, n, strips;
+   int *ok;
+   unsigned char **zlib;
+   unsigned int *adler;
+} stbiw__png_strips;
+
+static int stbiw__png_strip_row(stbiw__png_strips *p, int strip)
+{
+   return (int) ((long long) p->y * strip / p->strips);
+}
+
+static void stbiw__png_filter_strip(void *context, int strip)
+{
+   stbiw__png_strips *p = (stbiw__png_strips *) context;
+   p->ok[strip] = stbiw__filter_png_rows(p->filt, p->pixels, p->stride_bytes, p->x, p->y, p->n,
+                                         stbiw__png_strip_row(p, strip), stbiw__png_strip_row(p, strip+1));
+}
+
+#ifndef STBIW_ZLIB_COMPRESS
+static void stbiw__png_deflate_strip(void *context, int strip)
+{
+   stbiw__png_strips *p = (stbiw__png_strips *) context;
+   int row_bytes = p->x*p->n+1;
+   int start = stbiw__png_strip_row(p, strip) * row_bytes;
+   int end = stbiw__png_strip_row(p, strip+1) * row_bytes;
+   p->zlib[strip] = stbiw__zlib_compress_strip(p->filt, start, end, stbi_write_png_compression_level, strip == p->strips-1);
+   p->adler[strip] = stbiw__adler32(p->filt+start, end-start);
+}
+#endif
+
+static void stbiw__parallel_for_serial(void *parallel_context, int count, void (*job)(void *job_context, int index), void *job_context)
+{
+   int i;
+   (void) parallel_context;
+   for (i=0; i < count; ++i)
+      job(job_context, i);
+}
+
+static unsigned char *stbiw__write_png_to_mem_parallel(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len,
+                                                       int strips, stbi_write_parallel_for *parallel_for, void *parallel_context)
+{
+   stbiw__png_strips p;
+   unsigned char *zlib = NULL;
+   int i, ok = 1, zlen = 0;
+
+   if (strips > y) strips = y;
+   if (strips <= 1)
+      return stbi_write_png_to_mem(pixels, stride_bytes, x, y, n, out_len);
+   if (!parallel_for)
+      parallel_for = stbiw__parallel_for_serial;
+
+   p.pixels = pixels;
+   p.stride_bytes = stride_bytes ? stride_bytes : x * n;
+   p.x = x; p.y = y; p.n = n;
+   p.strips = strips;
+   p.filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y);
+   p.ok = (int *) STBIW_MALLOC(strips * sizeof(int));
+   p.zlib = (unsigned char **) STBIW_MALLOC(strips * sizeof(unsigned char *));
+   p.adler = (unsigned int *) STBIW_MALLOC(strips * sizeof(unsigned int));
+   if (!p.filt || !p.ok || !p.zlib || !p.adler) {
+      STBIW_FREE(p.filt); STBIW_FREE(p.ok); STBIW_FREE(p.zlib); STBIW_FREE(p.adler);
+      return 0;
+   }
+
+   // bands of rows: the filters only look one row up, into the source pixels
+   parallel_for(parallel_context, strips, stbiw__png_filter_strip, &p);
+   for (i=0; i < strips; ++i)
+      ok = ok && p.ok[i];
+
+   if (ok) {
+#ifdef STBIW_ZLIB_COMPRESS
+      zlib = stbi_zlib_compress(p.filt, y*(x*n+1), &zlen, stbi_write_png_compression_level);
+#else
+      // then the same bands of filtered bytes, each ending on a byte boundary
+      unsigned int adler = 1;
+      unsigned char *o;
+      parallel_for(parallel_context, strips, stbiw__png_deflate_strip, &p);
+      zlen = 2 + 4;
+      for (i=0; i < strips; ++i) {
+         if (!p.zlib[i]) ok = 0;
+         zlen += stbiw__sbn(p.zlib[i]);
+         adler = stbiw__adler32_combine(adler, p.adler[i],
+                                        (stbiw__png_strip_row(&p, i+1) - stbiw__png_strip_row(&p, i)) * (x*n+1));
+      }
+      if (ok) zlib = (unsigned char *) STBIW_MALLOC(zlen);
+      if (zlib) {
+         o = zlib;
+         *o++ = 0x78;   // DEFLATE 32K window
+         *o++ = 0x5e;   // FLEVEL = 1
+         for (i=0; i < strips; ++i) {
+            STBIW_MEMMOVE(o, p.zlib[i], stbiw__sbn(p.zlib[i]));
+            o += stbiw__sbn(p.zlib[i]);
+         }
+         stbiw__wp32(o, adler);
+      }
+      for (i=0; i < strips; ++i)
+         (void) stbiw__sbfree(p.zlib[i]);
+#endif
+   }
+   STBIW_FREE(p.filt); STBIW_FREE(p.ok); STBIW_FREE(p.zlib); STBIW_FREE(p.adler);
+   if (!zlib) return 0;
+
+   return stbiw__png_wrap(zlib, zlen, x, y, n, out_len);
+}
+
 #ifndef STBI_WRITE_NO_STDIO
 STBIWDEF int stbi_write_png(char const *filename, int x, int y, int comp, const void *data, int stride_bytes)
 {
@@ -1238,6 +1650,18 @@ STBIWDEF int stbi_write_png_to_func(stbi_write_func *func, void *context, int x,
    return 1;
 }
 
+STBIWDEF int stbi_write_png_to_func_parallel(stbi_write_func *func, void *context, int x, int y, int comp, const void *data, int stride_bytes,
+                                             int strips, stbi_write_parallel_for *parallel_for, void *parallel_context)
+{
+   int len;
+   unsigned char *png = stbiw__write_png_to_mem_parallel((const unsigned char *) data, stride_bytes, x, y, comp, &len,
+                                                         strips, parallel_for, parallel_context);
+   if (png == NULL) return 0;
+   func(context, png, len);
+   STBIW_FREE(png);
+   return 1;
+}
+
 
 /* ***************************************************************************
  *
@@ -1256,9 +1680,9 @@ static void stbiw__jpg_writeBits(stbi__write_context *s, int *bitBufP, int *bitC
    bitBuf |= bs[0] << (24 - bitCnt);
    while(bitCnt >= 8) {
       unsigned char c = (bitBuf >> 16) & 255;
-      stbiw__putc(s, c);
+      stbiw__write1(s, c);
       if(c == 255) {
-         stbiw__putc(s, 0);
+         stbiw__write1(s, 0);
       }
       bitBuf <<= 8;
       bitCnt -= 8;
@@ -1267,6 +1691,7 @@ static void stbiw__jpg_writeBits(stbi__write_context *s, int *bitBufP, int *bitC
    *bitCntP = bitCnt;
 }
 
+#ifndef STBIW_SSE2
 static void stbiw__jpg_DCT(float *d0p, float *d1p, float *d2p, float *d3p, float *d4p, float *d5p, float *d6p, float *d7p) {
    float d0 = *d0p, d1 = *d1p, d2 = *d2p, d3 = *d3p, d4 = *d4p, d5 = *d5p, d6 = *d6p, d7 = *d7p;
    float z1, z2, z3, z4, z5, z11, z13;
@@ -1315,6 +1740,101 @@ static void stbiw__jpg_DCT(float *d0p, float *d1p, float *d2p, float *d3p, float
    *d0p = d0;  *d2p = d2;  *d4p = d4;  *d6p = d6;
 }
 
+#endif
+
+#ifdef STBIW_SSE2
+// stbiw__jpg_DCT on 4 lanes, the same operations in the same order
+static void stbiw__jpg_DCT4(__m128 *d) {
+   __m128 tmp0 = _mm_add_ps(d[0], d[7]);
+   __m128 tmp7 = _mm_sub_ps(d[0], d[7]);
+   __m128 tmp1 = _mm_add_ps(d[1], d[6]);
+   __m128 tmp6 = _mm_sub_ps(d[1], d[6]);
+   __m128 tmp2 = _mm_add_ps(d[2], d[5]);
+   __m128 tmp5 = _mm_sub_ps(d[2], d[5]);
+   __m128 tmp3 = _mm_add_ps(d[3], d[4]);
+   __m128 tmp4 = _mm_sub_ps(d[3], d[4]);
+
+   // Even part
+   __m128 tmp10 = _mm_add_ps(tmp0, tmp3);
+   __m128 tmp13 = _mm_sub_ps(tmp0, tmp3);
+   __m128 tmp11 = _mm_add_ps(tmp1, tmp2);
+   __m128 tmp12 = _mm_sub_ps(tmp1, tmp2);
+   __m128 z1, z2, z3, z4, z5, z11, z13;
+
+   d[0] = _mm_add_ps(tmp10, tmp11);
+   d[4] = _mm_sub_ps(tmp10, tmp11);
+
+   z1 = _mm_mul_ps(_mm_add_ps(tmp12, tmp13), _mm_set1_ps(0.707106781f));
+   d[2] = _mm_add_ps(tmp13, z1);
+   d[6] = _mm_sub_ps(tmp13, z1);
+
+   // Odd part
+   tmp10 = _mm_add_ps(tmp4, tmp5);
+   tmp11 = _mm_add_ps(tmp5, tmp6);
+   tmp12 = _mm_add_ps(tmp6, tmp7);
+
+   z5 = _mm_mul_ps(_mm_sub_ps(tmp10, tmp12), _mm_set1_ps(0.382683433f));
+   z2 = _mm_add_ps(_mm_mul_ps(tmp10, _mm_set1_ps(0.541196100f)), z5);
+   z4 = _mm_add_ps(_mm_mul_ps(tmp12, _mm_set1_ps(1.306562965f)), z5);
+   z3 = _mm_mul_ps(tmp11, _mm_set1_ps(0.707106781f));
+
+   z11 = _mm_add_ps(tmp7, z3);
+   z13 = _mm_sub_ps(tmp7, z3);
+
+   d[5] = _mm_add_ps(z13, z2);
+   d[3] = _mm_sub_ps(z13, z2);
+   d[1] = _mm_add_ps(z11, z4);
+   d[7] = _mm_sub_ps(z11, z4);
+}
+
+// rows then columns, in place; a lane holds a row for the first pass, a column for the second
+static void stbiw__jpg_DCT_block(float *CDU, int du_stride) {
+   __m128 lo[8], hi[8], t[8];
+   int i, half;
+   for(i = 0; i < 8; ++i) {
+      lo[i] = _mm_loadu_ps(CDU + i*du_stride);
+      hi[i] = _mm_loadu_ps(CDU + i*du_stride + 4);
+   }
+   for(half = 0; half < 8; half += 4) {
+      for(i = 0; i < 4; ++i) {
+         t[i] = lo[half+i];
+         t[i+4] = hi[half+i];
+      }
+      _MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+      _MM_TRANSPOSE4_PS(t[4], t[5], t[6], t[7]);
+      stbiw__jpg_DCT4(t);
+      _MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+      _MM_TRANSPOSE4_PS(t[4], t[5], t[6], t[7]);
+      for(i = 0; i < 4; ++i) {
+         lo[half+i] = t[i];
+         hi[half+i] = t[i+4];
+      }
+   }
+   stbiw__jpg_DCT4(lo);
+   stbiw__jpg_DCT4(hi);
+   for(i = 0; i < 8; ++i) {
+      _mm_storeu_ps(CDU + i*du_stride, lo[i]);
+      _mm_storeu_ps(CDU + i*du_stride + 4, hi[i]);
+   }
+}
+
+static void stbiw__jpg_quantize(const float *CDU, int du_stride, const float *fdtbl, int *DU) {
+   const __m128 half = _mm_set1_ps(0.5f), sign = _mm_set1_ps(-0.0f);
+   int q[64], x, y, j;
+   for(y = 0; y < 8; ++y) {
+      for(x = 0; x < 8; x += 4) {
+         __m128 v = _mm_mul_ps(_mm_loadu_ps(CDU + y*du_stride + x), _mm_loadu_ps(fdtbl + y*8 + x));
+         // round half away from zero: add 0.5 with the sign of v, then truncate
+         v = _mm_add_ps(v, _mm_or_ps(half, _mm_and_ps(v, sign)));
+         _mm_storeu_si128((__m128i *) (q + y*8 + x), _mm_cvttps_epi32(v));
+      }
+   }
+   for(j = 0; j < 64; ++j) {
+      DU[stbiw__jpg_ZigZag[j]] = q[j];
+   }
+}
+#endif // STBIW_SSE2
+
 static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
    int tmp1 = val < 0 ? -val : val;
    val = val < 0 ? val-1 : val;
@@ -1328,9 +1848,15 @@ static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
 static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt, float *CDU, int du_stride, float *fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
    const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
    const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
-   int dataOff, i, j, n, diff, end0pos, x, y;
+   int i, diff, end0pos;
    int DU[64];
 
+#ifdef STBIW_SSE2
+   stbiw__jpg_DCT_block(CDU, du_stride);
+   stbiw__jpg_quantize(CDU, du_stride, fdtbl, DU);
+#else
+   int dataOff, j, n, x, y;
+
    // DCT rows
    for(dataOff=0, n=du_stride*8; dataOff<n; dataOff+=du_stride) {
       stbiw__jpg_DCT(&CDU[dataOff], &CDU[dataOff+1], &CDU[dataOff+2], &CDU[dataOff+3], &CDU[dataOff+4], &CDU[dataOff+5], &CDU[dataOff+6], &CDU[dataOff+7]);
@@ -1351,6 +1877,7 @@ static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt
          DU[stbiw__jpg_ZigZag[j]] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
       }
    }
+#endif
 
    // Encode DC
    diff = DU[0] - DC;
@@ -1395,7 +1922,169 @@ static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt
    return DU[0];
 }
 
-static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, int comp, const void* data, int quality) {
+// Y, Cb, Cr of 'count' pixels of a row from column x, the columns past the
+// right edge repeating the last pixel
+static void stbiw__jpg_convert_row(const unsigned char *dataR, const unsigned char *dataG, const unsigned char *dataB, int base_p,
+                                   int x, int count, int width, int comp, float *Y, float *U, float *V) {
+   int pos = 0, col = x;
+#ifdef STBIW_SSE2
+   for(; pos+4 <= count; pos += 4, col += 4) {
+      __m128 r, g, b;
+      if(comp == 4 && col+4 <= width) {
+         __m128i px = _mm_loadu_si128((const __m128i *) (dataR + base_p + col*4));
+         __m128i mask = _mm_set1_epi32(0xff);
+         r = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+         g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+         b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+      } else {
+         int p0 = base_p + ((col+0 < width) ? col+0 : (width-1))*comp;
+         int p1 = base_p + ((col+1 < width) ? col+1 : (width-1))*comp;
+         int p2 = base_p + ((col+2 < width) ? col+2 : (width-1))*comp;
+         int p3 = base_p + ((col+3 < width) ? col+3 : (width-1))*comp;
+         r = _mm_cvtepi32_ps(_mm_setr_epi32(dataR[p0], dataR[p1], dataR[p2], dataR[p3]));
+         g = _mm_cvtepi32_ps(_mm_setr_epi32(dataG[p0], dataG[p1], dataG[p2], dataG[p3]));
+         b = _mm_cvtepi32_ps(_mm_setr_epi32(dataB[p0], dataB[p1], dataB[p2], dataB[p3]));
+      }
+      _mm_storeu_ps(Y+pos, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.29900f), r), _mm_mul_ps(_mm_set1_ps(0.58700f), g)),
+                                                _mm_mul_ps(_mm_set1_ps(0.11400f), b)), _mm_set1_ps(128.0f)));
+      _mm_storeu_ps(U+pos, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(-0.16874f), r), _mm_mul_ps(_mm_set1_ps(0.33126f), g)),
+                                      _mm_mul_ps(_mm_set1_ps(0.50000f), b)));
+      _mm_storeu_ps(V+pos, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(0.50000f), r), _mm_mul_ps(_mm_set1_ps(0.41869f), g)),
+                                      _mm_mul_ps(_mm_set1_ps(0.08131f), b)));
+   }
+#endif
+   for(; pos < count; ++pos, ++col) {
+      // if col >= width => use pixel from last input column
+      int p = base_p + ((col < width) ? col : (width-1))*comp;
+      float r = dataR[p], g = dataG[p], b = dataB[p];
+      Y[pos]= +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
+      U[pos]= -0.16874f*r - 0.33126f*g + 0.50000f*b;
+      V[pos]= +0.50000f*r - 0.41869f*g - 0.08131f*b;
+   }
+}
+
+typedef struct
+{
+   unsigned char *data;
+   int len, cap, failed;
+} stbiw__jpg_buffer;
+
+static void stbiw__jpg_buffer_write(void *context, void *data, int size)
+{
+   stbiw__jpg_buffer *b = (stbiw__jpg_buffer *) context;
+   if (b->failed) return;
+   if (b->len + size > b->cap) {
+      int cap = b->cap ? b->cap : 4096;
+      unsigned char *p;
+      while (cap < b->len + size) cap *= 2;
+      p = (unsigned char *) STBIW_REALLOC_SIZED(b->data, b->cap, cap);
+      if (!p) { b->failed = 1; return; }
+      b->data = p;
+      b->cap = cap;
+   }
+   memcpy(b->data + b->len, data, size);
+   b->len += size;
+}
+
+typedef struct
+{
+   const unsigned char *data;
+   int width, height, comp, subsample;
+   float *fdtbl_Y, *fdtbl_UV;
+   const unsigned short (*YDC_HT)[2], (*UVDC_HT)[2], (*YAC_HT)[2], (*UVAC_HT)[2];
+   // restart markers after every MCU row, strips of rows encoded into buffers
+   int restart, mcu_rows, strips;
+   stbiw__jpg_buffer *buffers;
+} stbiw__jpg_encoder;
+
+// entropy coded data of the MCU rows [row0, row1)
+static void stbiw__jpg_encode_rows(stbi__write_context *s, const stbiw__jpg_encoder *enc, int row0, int row1) {
+   static const unsigned short fillBits[] = {0x7F, 7};
+   int DCY=0, DCU=0, DCV=0;
+   int bitBuf=0, bitCnt=0;
+   int width = enc->width, height = enc->height, comp = enc->comp;
+   // comp == 2 is grey+alpha (alpha is ignored)
+   int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
+   const unsigned char *dataR = enc->data;
+   const unsigned char *dataG = dataR + ofsG;
+   const unsigned char *dataB = dataR + ofsB;
+   int mcu_row, row, x, y, pos;
+   for(mcu_row = row0; mcu_row < row1; ++mcu_row) {
+      if(enc->restart && mcu_row > 0) {
+         stbiw__write1(s, 0xFF);
+         stbiw__write1(s, (unsigned char) (0xD0 + ((mcu_row-1) & 7))); // RSTn
+      }
+      if(enc->subsample) {
+         y = mcu_row * 16;
+         for(x = 0; x < width; x += 16) {
+            float Y[256], U[256], V[256];
+            for(row = y, pos = 0; row < y+16; ++row, pos += 16) {
+               // row >= height => use last input row
+               int clamped_row = (row < height) ? row : height - 1;
+               int base_p = (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
+               stbiw__jpg_convert_row(dataR, dataG, dataB, base_p, x, 16, width, comp, Y+pos, U+pos, V+pos);
+            }
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+0,   16, enc->fdtbl_Y, DCY, enc->YDC_HT, enc->YAC_HT);
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+8,   16, enc->fdtbl_Y, DCY, enc->YDC_HT, enc->YAC_HT);
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+128, 16, enc->fdtbl_Y, DCY, enc->YDC_HT, enc->YAC_HT);
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+136, 16, enc->fdtbl_Y, DCY, enc->YDC_HT, enc->YAC_HT);
+
+            // subsample U,V
+            {
+               float subU[64], subV[64];
+               int yy, xx;
+               for(yy = 0, pos = 0; yy < 8; ++yy) {
+                  for(xx = 0; xx < 8; ++xx, ++pos) {
+                     int j = yy*32+xx*2;
+                     subU[pos] = (U[j+0] + U[j+1] + U[j+16] + U[j+17]) * 0.25f;
+                     subV[pos] = (V[j+0] + V[j+1] + V[j+16] + V[j+17]) * 0.25f;
+                  }
+               }
+               DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subU, 8, enc->fdtbl_UV, DCU, enc->UVDC_HT, enc->UVAC_HT);
+               DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subV, 8, enc->fdtbl_UV, DCV, enc->UVDC_HT, enc->UVAC_HT);
+            }
+         }
+      } else {
+         y = mcu_row * 8;
+         for(x = 0; x < width; x += 8) {
+            float Y[64], U[64], V[64];
+            for(row = y, pos = 0; row < y+8; ++row, pos += 8) {
+               // row >= height => use last input row
+               int clamped_row = (row < height) ? row : height - 1;
+               int base_p = (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
+               stbiw__jpg_convert_row(dataR, dataG, dataB, base_p, x, 8, width, comp, Y+pos, U+pos, V+pos);
+            }
+
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y, 8, enc->fdtbl_Y,  DCY, enc->YDC_HT, enc->YAC_HT);
+            DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, U, 8, enc->fdtbl_UV, DCU, enc->UVDC_HT, enc->UVAC_HT);
+            DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, V, 8, enc->fdtbl_UV, DCV, enc->UVDC_HT, enc->UVAC_HT);
+         }
+      }
+      if(enc->restart) {
+         // an interval ends byte aligned, and the next one predicts DC from 0 again
+         stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
+         bitBuf = bitCnt = 0;
+         DCY = DCU = DCV = 0;
+      }
+   }
+   if(!enc->restart) {
+      // Do the bit alignment of the EOI marker
+      stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
+   }
+   stbiw__write_flush(s);
+}
+
+static void stbiw__jpg_encode_strip(void *context, int strip) {
+   const stbiw__jpg_encoder *enc = (const stbiw__jpg_encoder *) context;
+   stbi__write_context s;
+   memset(&s, 0, sizeof(s));
+   stbi__start_write_callbacks(&s, stbiw__jpg_buffer_write, &enc->buffers[strip]);
+   stbiw__jpg_encode_rows(&s, enc, (int) ((long long) enc->mcu_rows * strip / enc->strips),
+                          (int) ((long long) enc->mcu_rows * (strip+1) / enc->strips));
+}
+
+static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, int comp, const void* data, int quality,
+                               int strips, stbi_write_parallel_for *parallel_for, void *parallel_context) {
    // Constants that don't pollute global namespace
    static const unsigned char std_dc_luminance_nrcodes[] = {0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0};
    static const unsigned char std_dc_luminance_values[] = {0,1,2,3,4,5,6,7,8,9,10,11};
@@ -1467,7 +2156,7 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
    static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
                                  1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
 
-   int row, col, i, k, subsample;
+   int row, col, i, k, subsample, mcu_size, mcu_rows;
    float fdtbl_Y[64], fdtbl_UV[64];
    unsigned char YTable[64], UVTable[64];
 
@@ -1479,6 +2168,11 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
    subsample = quality <= 90 ? 1 : 0;
    quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
    quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+   mcu_size = subsample ? 16 : 8;
+   mcu_rows = (height + mcu_size-1) / mcu_size;
+   if(strips > mcu_rows) {
+      strips = mcu_rows;
+   }
 
    for(i = 0; i < 64; ++i) {
       int uvti, yti = (YQT[i]*quality+50)/100;
@@ -1516,85 +2210,58 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
       stbiw__putc(s, 0x11); // HTUACinfo
       s->func(s->context, (void*)(std_ac_chrominance_nrcodes+1), sizeof(std_ac_chrominance_nrcodes)-1);
       s->func(s->context, (void*)std_ac_chrominance_values, sizeof(std_ac_chrominance_values));
+      if(strips > 1) {
+         // DRI: a restart interval per MCU row
+         int mcus_per_row = (width + mcu_size-1) / mcu_size;
+         const unsigned char dri[] = { 0xFF,0xDD,0,4,(unsigned char)(mcus_per_row>>8),STBIW_UCHAR(mcus_per_row) };
+         s->func(s->context, (void*)dri, sizeof(dri));
+      }
       s->func(s->context, (void*)head2, sizeof(head2));
    }
 
    // Encode 8x8 macroblocks
    {
-      static const unsigned short fillBits[] = {0x7F, 7};
-      int DCY=0, DCU=0, DCV=0;
-      int bitBuf=0, bitCnt=0;
-      // comp == 2 is grey+alpha (alpha is ignored)
-      int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
-      const unsigned char *dataR = (const unsigned char *)data;
-      const unsigned char *dataG = dataR + ofsG;
-      const unsigned char *dataB = dataR + ofsB;
-      int x, y, pos;
-      if(subsample) {
-         for(y = 0; y < height; y += 16) {
-            for(x = 0; x < width; x += 16) {
-               float Y[256], U[256], V[256];
-               for(row = y, pos = 0; row < y+16; ++row) {
-                  // row >= height => use last input row
-                  int clamped_row = (row < height) ? row : height - 1;
-                  int base_p = (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
-                  for(col = x; col < x+16; ++col, ++pos) {
-                     // if col >= width => use pixel from last input column
-                     int p = base_p + ((col < width) ? col : (width-1))*comp;
-                     float r = dataR[p], g = dataG[p], b = dataB[p];
-                     Y[pos]= +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
-                     U[pos]= -0.16874f*r - 0.33126f*g + 0.50000f*b;
-                     V[pos]= +0.50000f*r - 0.41869f*g - 0.08131f*b;
-                  }
-               }
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+0,   16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+8,   16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+128, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+136, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-
-               // subsample U,V
-               {
-                  float subU[64], subV[64];
-                  int yy, xx;
-                  for(yy = 0, pos = 0; yy < 8; ++yy) {
-                     for(xx = 0; xx < 8; ++xx, ++pos) {
-                        int j = yy*32+xx*2;
-                        subU[pos] = (U[j+0] + U[j+1] + U[j+16] + U[j+17]) * 0.25f;
-                        subV[pos] = (V[j+0] + V[j+1] + V[j+16] + V[j+17]) * 0.25f;
-                     }
-                  }
-                  DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subU, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                  DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subV, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
-               }
-            }
-         }
+      stbiw__jpg_encoder enc;
+      enc.data = (const unsigned char *) data;
+      enc.width = width;
+      enc.height = height;
+      enc.comp = comp;
+      enc.subsample = subsample;
+      enc.fdtbl_Y = fdtbl_Y;
+      enc.fdtbl_UV = fdtbl_UV;
+      enc.YDC_HT = YDC_HT;
+      enc.UVDC_HT = UVDC_HT;
+      enc.YAC_HT = YAC_HT;
+      enc.UVAC_HT = UVAC_HT;
+      enc.restart = strips > 1;
+      enc.mcu_rows = mcu_rows;
+      enc.strips = strips;
+      enc.buffers = NULL;
+      if(strips <= 1) {
+         stbiw__jpg_encode_rows(s, &enc, 0, mcu_rows);
       } else {
-         for(y = 0; y < height; y += 8) {
-            for(x = 0; x < width; x += 8) {
-               float Y[64], U[64], V[64];
-               for(row = y, pos = 0; row < y+8; ++row) {
-                  // row >= height => use last input row
-                  int clamped_row = (row < height) ? row : height - 1;
-                  int base_p = (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
-                  for(col = x; col < x+8; ++col, ++pos) {
-                     // if col >= width => use pixel from last input column
-                     int p = base_p + ((col < width) ? col : (width-1))*comp;
-                     float r = dataR[p], g = dataG[p], b = dataB[p];
-                     Y[pos]= +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
-                     U[pos]= -0.16874f*r - 0.33126f*g + 0.50000f*b;
-                     V[pos]= +0.50000f*r - 0.41869f*g - 0.08131f*b;
-                  }
-               }
-
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y, 8, fdtbl_Y,  DCY, YDC_HT, YAC_HT);
-               DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, U, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-               DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, V, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+         int ok = 1;
+         enc.buffers = (stbiw__jpg_buffer *) STBIW_MALLOC(strips * sizeof(stbiw__jpg_buffer));
+         if(!enc.buffers) {
+            return 0;
+         }
+         memset(enc.buffers, 0, strips * sizeof(stbiw__jpg_buffer));
+         if(!parallel_for) {
+            parallel_for = stbiw__parallel_for_serial;
+         }
+         parallel_for(parallel_context, strips, stbiw__jpg_encode_strip, &enc);
+         for(i = 0; i < strips; ++i) {
+            ok = ok && !enc.buffers[i].failed;
+            if(ok && enc.buffers[i].len) {
+               s->func(s->context, enc.buffers[i].data, enc.buffers[i].len);
             }
+            STBIW_FREE(enc.buffers[i].data);
+         }
+         STBIW_FREE(enc.buffers);
+         if(!ok) {
+            return 0;
          }
       }
-
-      // Do the bit alignment of the EOI marker
-      stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
    }
 
    // EOI
@@ -1608,7 +2275,15 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x,
 {
    stbi__write_context s = { 0 };
    stbi__start_write_callbacks(&s, func, context);
-   return stbi_write_jpg_core(&s, x, y, comp, (void *) data, quality);
+   return stbi_write_jpg_core(&s, x, y, comp, (void *) data, quality, 1, NULL, NULL);
+}
+
+STBIWDEF int stbi_write_jpg_to_func_parallel(stbi_write_func *func, void *context, int x, int y, int comp, const void *data, int quality,
+                                             int strips, stbi_write_parallel_for *parallel_for, void *parallel_context)
+{
+   stbi__write_context s = { 0 };
+   stbi__start_write_callbacks(&s, func, context);
+   return stbi_write_jpg_core(&s, x, y, comp, (void *) data, quality, strips, parallel_for, parallel_context);
 }
 
 
@@ -1617,7 +2292,7 @@ STBIWDEF int stbi_write_jpg(char const *filename, int x, int y, int comp, const
 {
    stbi__write_context s = { 0 };
    if (stbi__start_write_file(&s,filename)) {
-      int r = stbi_write_jpg_core(&s, x, y, comp, data, quality);
+      int r = stbi_write_jpg_core(&s, x, y, comp, data, quality, 1, NULL, NULL);
       stbi__end_write_file(&s);
       return r;
    } else
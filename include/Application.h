@@ -4,66 +4,194 @@
 #include <webgpu/webgpu.h>
 #include <glfw3webgpu.h>
 #include <cassert>
+#include <chrono>
+#include <string>
 #include <vector>
 
+#include "FrameRing.h"
+#include "FramePacer.h"
+#include "UploadRing.h"
+#include "GpuBufferAllocator.h"
+#include "GpuCulling.h"
+#include "RenderGraph.h"
+#include "RenderBundleRecorder.h"
+#include "GpuProfiler.h"
+#include "TextureReadback.h"
+#include "FrameCapture.h"
+#include "VideoRecorder.h"
+#include "PipelineCache.h"
+#include "PipelineManager.h"
+#include "StartupTimeline.h"
+#include "CpuProfiler.h"
+#include "Logger.h"
+#include "GpuAsync.h"
+#include "JobSystem.h"
+#include "RedrawScheduler.h"
+#include "RenderThread.h"
+#include "SimulationScheduler.h"
+#include "GpuHandle.h"
+
+#ifndef WEBGPU_BACKEND_WGPU
 #define WEBGPU_BACKEND_WGPU
+#endif // WEBGPU_BACKEND_WGPU
+
+// Set from the command line by main()
+struct ApplicationOptions {
+    // Render into an offscreen texture read back to the CPU, without window
+    // nor surface
+    bool headless = false;
+    // Stop after this many frames, 0 to run until the window is closed
+    uint32_t frameCount = 0;
+    uint32_t width = 640;
+    uint32_t height = 480;
+    // Screenshot of the last frame when headless
+    std::string screenshotPath;
+    // Y4M file or "|command" every frame is streamed to. Frames are never
+    // dropped when headless, the writer sets the pace instead.
+    std::string recordPath;
+    // Block on events and redraw only when something changed, instead of
+    // rendering continuously. Ignored when headless.
+    bool onDemand = false;
+    // Record and present on a render thread while the main thread only
+    // handles events. Ignored when headless, and redraws are continuous.
+    bool renderThread = false;
+    // Fixed simulation ticks per second on their own thread, 0 for none
+    double simulationRate = 0.0;
+};
 
 class Application {
 public:
     
     // Initialize everything and return true if it went all right
-    bool Initialize();
+    bool Initialize(ApplicationOptions const& options = {});
 
     // Uninitialize everything that was initialized
     void Terminate();
 
     // Draw a frame and handle events
     void MainLoop();
+    // Run MainLoop() on the render thread until the window is closed or
+    // enough frames were rendered, pumping events on this one
+    void RunWithRenderThread();
 
     
     // Return true as long as the main loop should keep on running
     bool IsRunning();
+    bool IsHeadless() const { return options.headless; }
+
+    // Reconfigure the surface with `presentMode`, or the closest supported mode
+    void SetPresentMode(WGPUPresentMode presentMode);
 
+    // The offscreen target's view when headless
     WGPUTextureView GetNextSurfaceTextureView();
     WGPUAdapter requestAdapterSync(WGPUInstance instance, WGPURequestAdapterOptions const* options);
     WGPUDevice requestDeviceSync(WGPUAdapter adapter, WGPUDeviceDescriptor const* descriptor);
 
 public:
     // We put here all the variables that are shared between init and main loop
-    GLFWwindow* window;
-    WGPUSurface surface;
-    WGPUQueue queue;
+    // Null until created: failure paths of Initialize test and release them
+    GLFWwindow* window = nullptr;
+    WGPUSurface surface = nullptr;
+    WGPUQueue queue = nullptr;
 
     WGPUDeviceDescriptor deviceDesc;
-    WGPUDevice device;
+    WGPUDevice device = nullptr;
 
     WGPUInstanceDescriptor desc;
-    WGPUInstance instance;
-
-    WGPUAdapter adapter;
-
-    WGPUTextureView targetView;
-
-    WGPURenderPassEncoder renderPass;
-    WGPURenderPassDescriptor renderPassDesc;
-    WGPURenderPassColorAttachment renderPassColorAttachment;
+    WGPUInstance instance = nullptr;
+
+    WGPUAdapter adapter = nullptr;
+
+    // Per-phase timing of Initialize, reported once it returns
+    StartupTimeline startupTimeline;
+
+    // Work-stealing workers for engine tasks, the main thread helps in Wait()
+    JobSystem jobSystem;
+
+    // Drives wgpuDevicePoll for the coroutines awaiting GPU callbacks
+    GpuExecutor gpuExecutor;
+
+    // Frame rate cap, present mode and input timing
+    FramePacer framePacer;
+    // Continuous or on-demand redraws, and the event wait
+    RedrawScheduler redrawScheduler;
+    // Owns recording and presenting when options.renderThread is set
+    RenderThread renderThread;
+    // Fixed-rate ticks, sampled and interpolated once per frame
+    SimulationScheduler simulation;
+
+    // Per-frame encoder, render pass descriptors and completion fences
+    FrameRing frameRing;
+    // Staging buffers for CPU -> GPU uploads, flushed into each frame's encoder
+    UploadRing uploadRing;
+    // Sub-allocates vertex, index, uniform and storage ranges
+    GpuBufferAllocator bufferAllocator;
+    // Frustum culling on the GPU, feeding an indirect draw
+    GpuCulling culling;
+    Frustum cameraFrustum;
+    // Rebuilt every frame, keeps its transient textures pooled
+    RenderGraph renderGraph;
+    // Records draw lists into render bundles on worker threads
+    RenderBundleRecorder bundleRecorder;
+    // GPU time of every render graph pass, when timestamp queries exist
+    GpuProfiler gpuProfiler;
+
+    // Headless: render target and its readback to the CPU
+    GpuTexture offscreenTexture;
+    TextureReadback offscreenReadback;
+    // Screenshots encoded and written on worker threads
+    FrameCapture frameCapture;
+    // Streams frames to a Y4M file or pipe
+    VideoRecorder videoRecorder;
 
     WGPUCommandEncoderDescriptor encoderDesc;
-    WGPUCommandEncoder encoder;
+    WGPUCommandEncoder encoder = nullptr;
 
     WGPUCommandBufferDescriptor cmdBufferDescriptor;
-    WGPUCommandBuffer command;
+    WGPUCommandBuffer command = nullptr;
 
 
     //TEST
-    WGPUBuffer buffer1;
-    WGPUBuffer buffer2;
+    BufferAllocation buffer1;
+    BufferAllocation buffer2;
 
     // In Application class
 private:
-    WGPURenderPipeline pipeline;
+    ApplicationOptions options;
+    uint64_t framesRendered = 0;
+    // Texture behind the view returned by GetNextSurfaceTextureView()
+    WGPUTexture targetTexture = nullptr;
+    uint32_t screenshotCount = 0;
+    uint32_t recordingCount = 0;
+    std::chrono::steady_clock::time_point firstFrameStart;
+    // Center pixel of the last frame read back, as RGBA
+    uint8_t lastReadbackPixel[4] = {};
+
+    // Owns the shader modules and pipelines
+    PipelineCache pipelineCache;
+    // Builds pipelines off the main thread
+    PipelineManager pipelineManager;
+    PipelineHandle pipeline = InvalidPipelineHandle;
     WGPUTextureFormat surfaceFormat = WGPUTextureFormat_Undefined;
+    WGPUSurfaceConfiguration surfaceConfig = {};
+    // Cycled by the key callback
+    uint32_t presentModeChoice = 0;
+    bool frameRateCap = false;
+    // Latest window state seen by the render thread
+    WindowState windowState;
 
     void InitializePipeline();
+    // Stop the threads Initialize started before failing, so that the
+    // destructors do not terminate the process. Return false.
+    bool AbortInitialize();
+    // P, J, L, T, C and V, on whichever thread records frames
+    void HandleKey(int key, int mods);
+    // Render thread: handle what the main thread queued
+    void DrainInputEvents();
+    void PublishWindowState();
+    void CreateOffscreenTarget();
+    void ReportHeadless();
+    // Hash of the state the frame is built from, for damage tracking
+    uint64_t HashFrameInputs() const;
 };
 
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct BuddyAllocatorStats {
+    uint64_t capacity = 0;
+    // Bytes in allocated blocks, including the rounding to a power of two
+    uint64_t allocatedBytes = 0;
+    uint32_t allocationCount = 0;
+    uint64_t largestFreeBlock = 0;
+    // 0 when all the free space is one block, towards 1 as it gets scattered
+    double fragmentation = 0.0;
+};
+
+// Power-of-two buddy allocator over an abstract range of offsets. It does
+// not touch the memory it manages, so it runs and can be measured on the
+// CPU alone; GpuBufferAllocator maps its offsets into WGPUBuffers.
+//
+// Blocks are naturally aligned to their size, so any power-of-two alignment
+// up to the block size comes for free. Allocate and Free are O(log n).
+class BuddyAllocator {
+public:
+    static constexpr uint64_t InvalidOffset = ~0ull;
+
+    // `capacity` and `minBlockSize` must be powers of two
+    void Initialize(uint64_t capacity, uint64_t minBlockSize);
+
+    // Return InvalidOffset if there is no free block large enough
+    uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+    // Return the size of the block that was freed
+    uint64_t Free(uint64_t offset);
+
+    bool IsEmpty() const { return stats.allocationCount == 0; }
+    uint64_t GetCapacity() const { return capacity; }
+    BuddyAllocatorStats GetStats() const;
+
+private:
+    enum class NodeState : uint8_t {
+        // Inside a larger block, or not created yet
+        Unused,
+        Free,
+        Split,
+        Allocated,
+    };
+
+    static constexpr uint32_t InvalidNode = ~0u;
+
+    uint64_t BlockSize(uint32_t order) const { return minBlockSize << order; }
+    uint32_t NodeOrder(uint32_t node) const;
+    uint64_t NodeOffset(uint32_t node) const;
+
+    void PushFree(uint32_t order, uint32_t node);
+    void RemoveFree(uint32_t order, uint32_t node);
+
+private:
+    uint64_t capacity = 0;
+    uint64_t minBlockSize = 0;
+    uint32_t maxOrder = 0;
+
+    // Implicit binary tree: the root is the whole range, children of node i
+    // are 2i+1 and 2i+2. Free nodes of each order form a linked list.
+    std::vector<NodeState> states;
+    std::vector<uint32_t> previous;
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> freeLists;
+
+    BuddyAllocatorStats stats;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <x86intrin.h>
+#  endif
+#  define CPU_PROFILER_TSC 1
+#endif
+
+// Scoped CPU zones, exported as a Chrome / Perfetto JSON trace.
+//
+// Each thread appends its zones to its own ring buffer without locks or
+// atomic read-modify-writes: a zone costs two timestamp reads and one store
+// of a few words. The rings keep the most recent zones; WriteTrace() copies
+// them out while the threads keep running and drops what was overwritten
+// during the copy.
+//
+// Timestamps come from the TSC on x86 (converted to time with a calibration
+// taken at export) and from steady_clock elsewhere.
+//
+// Zones compile to nothing unless CPU_PROFILER_ENABLED is defined (xmake
+// option "cpu_profiler").
+class CpuProfiler {
+public:
+    // Zones kept per thread, a power of two
+    static constexpr uint32_t RingSize = 1u << 16;
+
+    // `tracePath` is used by dumps requested with RequestDump(). Installs a
+    // SIGUSR1 handler requesting one where signals exist.
+    static void Initialize(char const* tracePath = "trace.json");
+
+    // Shown as the name of the calling thread in the trace
+    static void SetThreadName(char const* name);
+
+    // Async-signal-safe, the dump happens in the next Update()
+    static void RequestDump();
+    // Call once per frame: writes the trace if a dump was requested
+    static void Update();
+
+    // Every zone still in the rings, return false if the file can't be written
+    static bool WriteTrace(char const* path);
+
+    static uint64_t Now()
+    {
+#ifdef CPU_PROFILER_TSC
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // `name` must outlive the profiler (a string literal)
+    static void Record(char const* name, uint64_t begin, uint64_t end)
+    {
+        if (!threadRing) threadRing = &GetThreadRing();
+        uint64_t head = threadRing->head.load(std::memory_order_relaxed);
+        threadRing->zones[head & (RingSize - 1)] = Zone{ name, begin, end };
+        threadRing->head.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    struct Zone {
+        char const* name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct ThreadRing {
+        Zone zones[RingSize];
+        // Zones ever recorded, only written by the owning thread
+        std::atomic<uint64_t> head{ 0 };
+        uint32_t threadIndex = 0;
+        std::string name;
+    };
+
+    struct Registry;
+
+    static inline thread_local ThreadRing* threadRing = nullptr;
+
+    static ThreadRing& GetThreadRing();
+    static Registry& GetRegistry();
+};
+
+// Zone covering the rest of the enclosing scope
+class CpuZone {
+public:
+    explicit CpuZone(char const* name) : name(name), begin(CpuProfiler::Now()) {}
+    ~CpuZone() { CpuProfiler::Record(name, begin, CpuProfiler::Now()); }
+
+    CpuZone(CpuZone const&) = delete;
+    CpuZone& operator=(CpuZone const&) = delete;
+
+private:
+    char const* name;
+    uint64_t begin;
+};
+
+#define CPU_ZONE_CONCAT_(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_(a, b)
+
+#ifdef CPU_PROFILER_ENABLED
+#  define CPU_ZONE(name) CpuZone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+#else
+#  define CPU_ZONE(name) ((void)0)
+#endif // CPU_PROFILER_ENABLED
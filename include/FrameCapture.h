@@ -0,0 +1,97 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "TextureReadback.h"
+
+enum class CaptureFormat {
+    Png,
+    Jpg,
+};
+
+struct FrameCaptureStats {
+    uint64_t requested = 0;
+    uint64_t written = 0;
+    // Readback ring full, too many images waiting for encoding, or the file
+    // could not be written
+    uint64_t dropped = 0;
+    uint64_t bytesWritten = 0;
+    // Main thread time spent converting mapped frames
+    double convertMs = 0.0;
+    // Job system time spent encoding and writing
+    double encodeMs = 0.0;
+};
+
+// Screenshots that never stall the frame. Capture() records a copy of the
+// target into a TextureReadback; once mapped a few frames later, Poll()
+// converts the pixels to tightly packed RGBA (swizzling BGRA targets) and
+// hands them to the job system, where a job encodes PNG or JPEG with
+// stb_image_write and writes the file. Images are cut into strips of rows
+// encoded as jobs of their own, so every core of the job system helps.
+// When the readback ring is full or MaxQueuedImages are still being
+// encoded, the screenshot is dropped.
+class FrameCapture {
+public:
+    static constexpr size_t MaxQueuedImages = 4;
+
+    bool Initialize(WGPUDevice device, uint32_t width, uint32_t height, WGPUTextureFormat format, JobSystem& jobSystem);
+    // Finish the queued screenshots
+    void Terminate();
+
+    // Capture the next frame given to Capture() into `path`
+    void RequestScreenshot(std::string path, CaptureFormat format = CaptureFormat::Png, int jpgQuality = 90);
+    bool HasPendingRequest() const { return !requests.empty(); }
+    // No readback left for Poll() to collect
+    bool IsIdle() const { return requests.empty() && capturing.empty(); }
+
+    // Record the copy if a screenshot was requested. `texture` needs CopySrc.
+    void Capture(WGPUCommandEncoder encoder, WGPUTexture texture, uint64_t frameNumber);
+    void OnSubmitted();
+    void Poll();
+
+    FrameCaptureStats GetStats() const;
+
+    // BGRA or RGBA rows with padding to tightly packed RGBA
+    static void ConvertToRgba(ReadbackImage const& image, uint8_t* rgba);
+
+private:
+    struct Request {
+        std::string path;
+        CaptureFormat format = CaptureFormat::Png;
+        int jpgQuality = 90;
+    };
+
+    struct Image {
+        Request request;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> rgba;
+    };
+
+    void OnReadback(ReadbackImage const& image);
+    // Job body: encode and write the oldest image waiting
+    void EncodeNext();
+    bool Encode(Image const& image, std::vector<uint8_t>& encoded) const;
+
+private:
+    TextureReadback readback;
+    JobSystem* jobSystem = nullptr;
+
+    // Requested, then waiting for their readback, in order
+    std::deque<Request> requests;
+    std::deque<Request> capturing;
+
+    // Parent of the encoding jobs, run and waited for by Terminate()
+    Job* encodeJobs = nullptr;
+    mutable std::mutex mutex;
+    std::deque<Image> images;
+    // Handed to the job system and not written yet
+    size_t queuedImages = 0;
+
+    FrameCaptureStats stats;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct FramePacingStats {
+    WGPUPresentMode presentMode = WGPUPresentMode_Fifo;
+    // Interval between the last two presents
+    double frameMs = 0.0;
+    // Over the last HistorySize frames
+    double averageFrameMs = 0.0;
+    double worstFrameMs = 0.0;
+    // Input sampled to frame submitted
+    double workMs = 0.0;
+    // Time the limiter held the last frame back
+    double waitMs = 0.0;
+    // Input sampled to present returned
+    double inputToPresentMs = 0.0;
+    // inputToPresentMs plus the time the image should wait in the
+    // presentation queue before reaching the screen
+    double estimatedLatencyMs = 0.0;
+    uint64_t frames = 0;
+};
+
+// Paces the main loop: optional frame rate cap, present mode selection
+// among the modes the surface supports, and "just in time" input sampling.
+//
+// Just in time, the wait happens before polling events and ends as late as
+// possible: at the predicted next present, minus the predicted recording
+// time and a safety margin. The frame then records with fresh input instead
+// of idling after having sampled it.
+//
+// Call order every frame: WaitForInput(), poll events, MarkInputSampled(),
+// record, MarkSubmitted(), present, MarkPresented().
+class FramePacer {
+public:
+    static constexpr size_t HistorySize = 120;
+
+    // 0 fps: no CPU-side limit
+    void Initialize(double targetFps = 0.0, bool justInTimeInput = false);
+
+    // From WGPUSurfaceCapabilities, used by SelectPresentMode()
+    void SetSupportedPresentModes(WGPUPresentMode const* modes, size_t count);
+    // `preferred` if the surface supports it, otherwise the closest supported
+    // mode. Fifo is always supported.
+    WGPUPresentMode SelectPresentMode(WGPUPresentMode preferred) const;
+    // The mode the surface was configured with, for latency estimates
+    void SetPresentMode(WGPUPresentMode presentMode) { stats.presentMode = presentMode; }
+
+    void SetTargetFps(double targetFps);
+    void SetJustInTimeInput(bool enabled, double marginMs = 1.5);
+    bool IsJustInTimeInput() const { return justInTimeInput; }
+
+    void WaitForInput();
+    void MarkInputSampled();
+    void MarkSubmitted();
+    void MarkPresented();
+
+    FramePacingStats const& GetStats() const { return stats; }
+
+    // OS sleep for the bulk of the wait, spin for the last stretch
+    void PreciseSleepUntil(std::chrono::steady_clock::time_point deadline);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static double ToMs(Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); }
+
+private:
+    std::vector<WGPUPresentMode> supportedModes;
+
+    Clock::duration period = Clock::duration::zero();
+    bool justInTimeInput = false;
+    Clock::duration margin = std::chrono::microseconds(1500);
+
+    Clock::time_point frameStart;
+    Clock::time_point inputSampled;
+    Clock::time_point submitted;
+    Clock::time_point lastPresent;
+    bool hasPresented = false;
+    // Just in time with a cap: presents are scheduled every `period`
+    Clock::time_point presentTarget;
+    bool hasPresentTarget = false;
+
+    // Smoothed predictions
+    double predictedWorkMs = 0.0;
+    double predictedFrameMs = 0.0;
+    // How long a 1 ms sleep actually takes on this system
+    double sleepOvershootMs = 1.0;
+
+    double history[HistorySize] = {};
+    size_t historyCount = 0;
+    size_t historyNext = 0;
+
+    FramePacingStats stats;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+// A WebGPU object that must outlive the frame that recorded it. It is
+// released once the GPU signals that the frame's work is done.
+struct FrameTransient {
+    void* handle = nullptr;
+    void (*release)(void* handle) = nullptr;
+};
+
+// Everything one frame in flight needs to record and submit its commands.
+// The descriptors are filled once at startup and reused every frame, only
+// the per-frame handles (encoder, target view) change. Render pass
+// descriptors are built by the RenderGraph.
+struct FrameContext {
+    uint32_t index = 0;
+    uint64_t frameNumber = 0;
+
+    WGPUCommandEncoderDescriptor encoderDesc = {};
+    WGPUCommandBufferDescriptor cmdBufferDescriptor = {};
+
+    WGPUCommandEncoder encoder = nullptr;
+    WGPUTextureView targetView = nullptr;
+
+    // Released when the completion fence of this slot fires
+    std::vector<FrameTransient> transients;
+
+    // Completion fence, signaled by wgpuQueueOnSubmittedWorkDone. Atomic as
+    // any thread polling the device may run the callback.
+    bool inFlight = false;
+    std::atomic<bool> fenceSignaled{ true };
+    uint64_t submissionIndex = 0;
+
+    // WGPU objects created while recording this frame
+    uint32_t allocations = 0;
+    std::chrono::steady_clock::time_point beginTime;
+};
+
+struct FrameStats {
+    // CPU time between BeginFrame and EndFrame of the last frame
+    double cpuFrameMs = 0.0;
+    // Time BeginFrame spent waiting for the GPU to release the slot
+    double fenceWaitMs = 0.0;
+    // WGPU objects created while recording the last frame
+    uint32_t allocations = 0;
+    uint64_t framesSubmitted = 0;
+};
+
+// Ring of per-frame contexts allowing the CPU to record frame N+1 while the
+// GPU still works on frame N. A slot is only reused once the work submitted
+// from it has completed.
+class FrameRing {
+public:
+    static constexpr uint32_t MaxFramesInFlight = 4;
+
+    // Create the slots and fill their reusable descriptors
+    bool Initialize(WGPUDevice device, WGPUQueue queue, uint32_t framesInFlight = 2);
+
+    // Wait for every frame in flight and release what they still hold,
+    // including what GpuHandles deferred
+    void Terminate();
+
+    // Pick the next slot, waiting for the GPU if it is still in use, and
+    // create its command encoder. What finished frames hold is released.
+    FrameContext& BeginFrame();
+
+    // Finish the frame encoder, submit it and arm the slot fence. Objects
+    // GpuHandles deferred until now are released with this frame.
+    void Submit(FrameContext& frame);
+
+    // Close the frame and update the statistics
+    void EndFrame(FrameContext& frame);
+
+    // Close a frame that will not be submitted (e.g. no surface texture),
+    // releasing its encoder instead
+    void AbandonFrame(FrameContext& frame);
+
+    // Keep an object alive until the GPU is done with the frame
+    void Track(FrameContext& frame, void* handle, void (*release)(void*));
+
+    // Count a WGPU object created while recording the frame
+    void CountAllocation(FrameContext& frame) { ++frame.allocations; }
+
+    uint32_t GetFramesInFlight() const { return framesInFlight; }
+    FrameStats const& GetStats() const { return stats; }
+
+private:
+    void WaitForFence(FrameContext& frame);
+    void ReleaseTransients(FrameContext& frame);
+    // Every slot whose fence fired since, without waiting
+    void ReleaseCompleted();
+
+private:
+    WGPUDevice device = nullptr;
+    WGPUQueue queue = nullptr;
+
+    FrameContext frames[MaxFramesInFlight];
+    uint32_t framesInFlight = 0;
+    uint32_t current = 0;
+    uint64_t frameNumber = 0;
+
+    FrameStats stats;
+};
@@ -0,0 +1,228 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Awaitable layer over the callback-based WebGPU API.
+//
+// A GpuTask is a coroutine started eagerly when called. Awaiting one of the
+// Gpu* awaitables below suspends it until the matching WebGPU callback fires;
+// it is then resumed from GpuExecutor::Poll(), never from inside the
+// callback, so user code always runs on the thread driving the executor.
+
+class GpuExecutor;
+
+template <typename T>
+struct GpuResult {
+    T value{};
+    bool ok = false;
+    std::string message;
+};
+
+namespace detail {
+    // Shared promise state: the continuation to resume when the task ends
+    struct GpuPromiseBase {
+        std::coroutine_handle<> continuation;
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    template <typename T>
+    struct GpuPromise : GpuPromiseBase {
+        std::optional<T> value;
+        void return_value(T result) { value = std::move(result); }
+    };
+
+    template <>
+    struct GpuPromise<void> : GpuPromiseBase {
+        void return_void() {}
+    };
+}
+
+template <typename T = void>
+class GpuTask {
+public:
+    struct promise_type : detail::GpuPromise<T> {
+        GpuTask get_return_object() {
+            return GpuTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    GpuTask() = default;
+    explicit GpuTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    GpuTask(GpuTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    GpuTask& operator=(GpuTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    GpuTask(GpuTask const&) = delete;
+    GpuTask& operator=(GpuTask const&) = delete;
+    ~GpuTask() { if (handle) handle.destroy(); }
+
+    bool IsDone() const { return !handle || handle.done(); }
+
+    // Let go of the coroutine without destroying its frame, for one that a
+    // pending callback may still write into. The frame leaks.
+    void Abandon() { handle = nullptr; }
+
+    T TakeResult() {
+        if constexpr (!std::is_void_v<T>) return std::move(*handle.promise().value);
+    }
+
+    // Awaiting a task from another coroutine chains them
+    bool await_ready() const noexcept { return IsDone(); }
+    void await_suspend(std::coroutine_handle<> awaiting) noexcept { handle.promise().continuation = awaiting; }
+    T await_resume() { return TakeResult(); }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Resumes coroutines whose WebGPU callback fired. Poll() is non-blocking and
+// meant to be called once per frame; Wait() blocks until a task is done.
+class GpuExecutor {
+public:
+    GpuExecutor() = default;
+    GpuExecutor(WGPUInstance instance, WGPUDevice device) { Initialize(instance, device); }
+
+    void Initialize(WGPUInstance instance, WGPUDevice device);
+    // Run detached tasks to completion, then drop them. Call it once the
+    // frames are done, before releasing what the tasks use.
+    void Terminate();
+
+    // Let WebGPU run its callbacks, then resume what they woke up. Return
+    // true if at least one coroutine was resumed.
+    bool Poll();
+
+    // Called by awaiters, possibly from another thread polling the device
+    void Schedule(std::coroutine_handle<> handle);
+
+    // Keep a task alive until it completes, without anyone awaiting it
+    void Spawn(GpuTask<void> task);
+
+    template <typename T>
+    T Wait(GpuTask<T> task) {
+        while (!task.IsDone()) Poll();
+        return task.TakeResult();
+    }
+
+    size_t GetPendingTaskCount() const { return detached.size(); }
+
+private:
+    WGPUInstance instance = nullptr;
+    WGPUDevice device = nullptr;
+
+    std::mutex mutex;
+    std::vector<std::coroutine_handle<>> ready;
+    std::vector<std::coroutine_handle<>> resuming;
+    std::vector<GpuTask<void>> detached;
+};
+
+// Common part of the awaiters: whoever of await_suspend and the callback
+// comes second decides how the coroutine continues, so a callback firing
+// synchronously inside the WebGPU call simply doesn't suspend.
+class GpuAwaiterBase {
+public:
+    explicit GpuAwaiterBase(GpuExecutor& executor) : executor(executor) {}
+    GpuAwaiterBase(GpuAwaiterBase const&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+protected:
+    bool Suspend(std::coroutine_handle<> awaiting);
+    void Complete();
+
+    GpuExecutor& executor;
+    std::coroutine_handle<> handle;
+    std::atomic<bool> rendezvous{ false };
+};
+
+class GpuRequestAdapter : public GpuAwaiterBase {
+public:
+    GpuRequestAdapter(GpuExecutor& executor, WGPUInstance instance, WGPURequestAdapterOptions const* options)
+        : GpuAwaiterBase(executor), instance(instance), options(options) {}
+    bool await_suspend(std::coroutine_handle<> awaiting);
+    GpuResult<WGPUAdapter> await_resume() { return std::move(result); }
+
+private:
+    WGPUInstance instance;
+    WGPURequestAdapterOptions const* options;
+    GpuResult<WGPUAdapter> result;
+};
+
+class GpuRequestDevice : public GpuAwaiterBase {
+public:
+    GpuRequestDevice(GpuExecutor& executor, WGPUAdapter adapter, WGPUDeviceDescriptor const* descriptor)
+        : GpuAwaiterBase(executor), adapter(adapter), descriptor(descriptor) {}
+    bool await_suspend(std::coroutine_handle<> awaiting);
+    GpuResult<WGPUDevice> await_resume() { return std::move(result); }
+
+private:
+    WGPUAdapter adapter;
+    WGPUDeviceDescriptor const* descriptor;
+    GpuResult<WGPUDevice> result;
+};
+
+class GpuMapBuffer : public GpuAwaiterBase {
+public:
+    GpuMapBuffer(GpuExecutor& executor, WGPUBuffer buffer, WGPUMapModeFlags mode, size_t offset, size_t size)
+        : GpuAwaiterBase(executor), buffer(buffer), mode(mode), offset(offset), size(size) {}
+    bool await_suspend(std::coroutine_handle<> awaiting);
+    WGPUBufferMapAsyncStatus await_resume() const { return status; }
+
+private:
+    WGPUBuffer buffer;
+    WGPUMapModeFlags mode;
+    size_t offset;
+    size_t size;
+    WGPUBufferMapAsyncStatus status = WGPUBufferMapAsyncStatus_Unknown;
+};
+
+class GpuQueueWorkDone : public GpuAwaiterBase {
+public:
+    GpuQueueWorkDone(GpuExecutor& executor, WGPUQueue queue)
+        : GpuAwaiterBase(executor), queue(queue) {}
+    bool await_suspend(std::coroutine_handle<> awaiting);
+    WGPUQueueWorkDoneStatus await_resume() const { return status; }
+
+private:
+    WGPUQueue queue;
+    WGPUQueueWorkDoneStatus status = WGPUQueueWorkDoneStatus_Unknown;
+};
+
+// Pair with wgpuDevicePushErrorScope; `ok` is true when no error was captured
+class GpuPopErrorScope : public GpuAwaiterBase {
+public:
+    GpuPopErrorScope(GpuExecutor& executor, WGPUDevice device)
+        : GpuAwaiterBase(executor), device(device) {}
+    bool await_suspend(std::coroutine_handle<> awaiting);
+    GpuResult<WGPUErrorType> await_resume() { return std::move(result); }
+
+private:
+    WGPUDevice device;
+    GpuResult<WGPUErrorType> result;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "BuddyAllocator.h"
+
+// Each class has its own backing buffers, usage flags and alignment
+enum class BufferUsageClass {
+    Vertex,
+    Index,
+    Uniform,
+    Storage,
+    Count,
+};
+
+// A range of a shared backing buffer. Bind or copy with `buffer` + `offset`.
+struct BufferAllocation {
+    WGPUBuffer buffer = nullptr;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    BufferUsageClass usageClass = BufferUsageClass::Count;
+    uint32_t block = 0;
+
+    bool IsValid() const { return buffer != nullptr; }
+};
+
+// Carves small vertex, index, uniform and storage allocations out of large
+// backing buffers instead of creating one WGPUBuffer per allocation.
+// Allocations larger than a backing block get a dedicated block.
+//
+// Freed ranges may be handed out again right away: writes go through the
+// queue, which keeps them ordered after the commands reading the old data.
+class GpuBufferAllocator {
+public:
+    static constexpr uint64_t MinBlockSize = 256;
+
+    bool Initialize(WGPUDevice device, uint64_t blockSize = 4 << 20);
+    void Terminate();
+
+    BufferAllocation Allocate(BufferUsageClass usageClass, uint64_t size);
+    void Free(BufferAllocation& allocation);
+
+    // Per-class occupancy and fragmentation
+    void Report(std::ostream& out) const;
+
+private:
+    struct Block {
+        WGPUBuffer buffer = nullptr;
+        BuddyAllocator allocator;
+        // Bytes actually requested, without the rounding of the allocator
+        uint64_t requestedBytes = 0;
+    };
+
+    struct Pool {
+        char const* name = "";
+        WGPUBufferUsageFlags usage = WGPUBufferUsage_None;
+        uint64_t alignment = 4;
+        // Released blocks leave a null entry so that indices stay valid
+        std::vector<std::unique_ptr<Block>> blocks;
+    };
+
+    Block* CreateBlock(Pool& pool, uint64_t capacity, uint32_t& index);
+
+private:
+    WGPUDevice device = nullptr;
+    uint64_t blockSize = 0;
+    Pool pools[(size_t)BufferUsageClass::Count];
+};
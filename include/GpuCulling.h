@@ -0,0 +1,85 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <vector>
+
+#include "GpuAsync.h"
+#include "GpuBufferAllocator.h"
+#include "GpuHandle.h"
+
+class PipelineCache;
+class UploadRing;
+
+// Bounding sphere of an instance, laid out as a WGSL vec4f
+struct InstanceBounds {
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float radius = 0.0f;
+};
+
+// Six planes (a, b, c, d) with normals pointing inside: a point p is inside
+// a plane when a*x + b*y + c*z + d >= 0
+struct Frustum {
+    float planes[6][4] = {};
+
+    // Planes of a column-major view-projection matrix with WebGPU's [0, 1]
+    // clip-space depth
+    static Frustum FromViewProjection(float const* matrix);
+};
+
+// CPU reference of the culling shader, four spheres at a time with SSE when
+// available. Fill `visible` with the indices of the instances that survive.
+void CullInstancesCpu(Frustum const& frustum, InstanceBounds const* bounds, uint32_t count, std::vector<uint32_t>& visible);
+
+// GPU-driven frustum culling. A compute pass tests every instance bounding
+// sphere and appends the survivors to a list of visible instance indices,
+// counting them directly in the instanceCount of an indirect draw, so that
+// the frame draws everything with a single DrawIndirect.
+//
+// The visible list is in no particular order; vertex shaders read the
+// instance they draw as visibleInstances[instance_index].
+class GpuCulling {
+public:
+    static constexpr uint32_t WorkgroupSize = 64;
+
+    bool Initialize(WGPUDevice device, PipelineCache& cache, GpuBufferAllocator& allocator, uint32_t maxInstances);
+    void Terminate();
+
+    // Upload new bounds, kept on the GPU until the next call
+    void SetInstances(UploadRing& uploads, InstanceBounds const* bounds, uint32_t count);
+
+    // Upload this frame's frustum and reset the indirect arguments. Must be
+    // flushed before the pass running Dispatch().
+    void Prepare(UploadRing& uploads, Frustum const& frustum, uint32_t vertexCount);
+
+    void Dispatch(WGPUComputePassEncoder pass);
+
+    // Arguments of wgpuRenderPassEncoderDrawIndirect, at offset 0
+    WGPUBuffer GetIndirectBuffer() const { return indirectBuffer.Get(); }
+    BufferAllocation const& GetVisibleInstances() const { return visibleInstances; }
+
+    // Read the result of the last submitted culling back and compare it with
+    // CullInstancesCpu on the same inputs
+    GpuTask<void> Validate(GpuExecutor& executor, WGPUQueue queue);
+    // -1 while no validation finished, then 0 or 1
+    int GetValidationResult() const { return validationResult; }
+
+private:
+    WGPUDevice device = nullptr;
+    GpuBufferAllocator* allocator = nullptr;
+    uint32_t maxInstances = 0;
+
+    GpuComputePipeline pipeline;
+    GpuBindGroup bindGroup;
+
+    BufferAllocation frustumUniform;
+    BufferAllocation instanceBounds;
+    BufferAllocation visibleInstances;
+    GpuBuffer indirectBuffer;
+
+    // Inputs of the last Prepare(), for the CPU reference
+    std::vector<InstanceBounds> cpuBounds;
+    Frustum cpuFrustum;
+    uint32_t vertexCount = 0;
+
+    int validationResult = -1;
+};
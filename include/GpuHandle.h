@@ -0,0 +1,157 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "FrameRing.h"
+
+enum class GpuObjectType : uint8_t {
+    Buffer,
+    Texture,
+    TextureView,
+    Sampler,
+    BindGroup,
+    BindGroupLayout,
+    PipelineLayout,
+    ShaderModule,
+    RenderPipeline,
+    ComputePipeline,
+    QuerySet,
+    RenderBundle,
+    Count,
+};
+
+struct GpuObjectCounts {
+    // Owned by a GpuHandle
+    uint64_t live = 0;
+    // Dropped by their handle, waiting for the GPU to be done with them
+    uint64_t pending = 0;
+    uint64_t released = 0;
+};
+
+// Where dropped WGPU objects wait before being released. A GpuHandle going
+// out of scope defers its object here; the next FrameRing::Submit() moves
+// everything waiting into that frame, released together once its
+// completion fence fires. The GPU may still use an object dropped while
+// recording, but never past the fence of the next submission.
+class GpuReleaseQueue {
+public:
+    static void Defer(void* handle, void (*release)(void*), GpuObjectType type);
+    // Hand everything deferred so far to a frame about to be in flight
+    static void TakePending(std::vector<FrameTransient>& transients);
+    // Release everything deferred right away, once the GPU is idle
+    static void ReleasePending();
+
+    static GpuObjectCounts GetCounts(GpuObjectType type);
+    static char const* GetTypeName(GpuObjectType type);
+    // Per type, types that never had an object are skipped
+    static void Report(std::ostream& out);
+
+    // Counters kept by GpuHandle
+    static void OnAdopted(GpuObjectType type);
+    static void OnDetached(GpuObjectType type);
+    static void OnReleased(GpuObjectType type);
+};
+
+template<typename T>
+struct GpuHandleTraits;
+
+#define GPU_HANDLE_TRAITS(Handle, Type, ReleaseFunction) \
+    template<> \
+    struct GpuHandleTraits<Handle> { \
+        static constexpr GpuObjectType type = GpuObjectType::Type; \
+        static void Release(void* handle) { ReleaseFunction(static_cast<Handle>(handle)); } \
+    };
+
+GPU_HANDLE_TRAITS(WGPUBuffer, Buffer, wgpuBufferRelease)
+GPU_HANDLE_TRAITS(WGPUTexture, Texture, wgpuTextureRelease)
+GPU_HANDLE_TRAITS(WGPUTextureView, TextureView, wgpuTextureViewRelease)
+GPU_HANDLE_TRAITS(WGPUSampler, Sampler, wgpuSamplerRelease)
+GPU_HANDLE_TRAITS(WGPUBindGroup, BindGroup, wgpuBindGroupRelease)
+GPU_HANDLE_TRAITS(WGPUBindGroupLayout, BindGroupLayout, wgpuBindGroupLayoutRelease)
+GPU_HANDLE_TRAITS(WGPUPipelineLayout, PipelineLayout, wgpuPipelineLayoutRelease)
+GPU_HANDLE_TRAITS(WGPUShaderModule, ShaderModule, wgpuShaderModuleRelease)
+GPU_HANDLE_TRAITS(WGPURenderPipeline, RenderPipeline, wgpuRenderPipelineRelease)
+GPU_HANDLE_TRAITS(WGPUComputePipeline, ComputePipeline, wgpuComputePipelineRelease)
+GPU_HANDLE_TRAITS(WGPUQuerySet, QuerySet, wgpuQuerySetRelease)
+GPU_HANDLE_TRAITS(WGPURenderBundle, RenderBundle, wgpuRenderBundleRelease)
+
+#undef GPU_HANDLE_TRAITS
+
+// Move-only owner of one reference to a WGPU object. Dropping it, by
+// destruction, Reset() or assignment, defers the release through the
+// GpuReleaseQueue instead of releasing right away.
+template<typename T>
+class GpuHandle {
+public:
+    using Traits = GpuHandleTraits<T>;
+
+    GpuHandle() = default;
+    // Takes over the reference `handle` holds
+    explicit GpuHandle(T handle) : handle(handle) { if (handle) GpuReleaseQueue::OnAdopted(Traits::type); }
+    ~GpuHandle() { Reset(); }
+
+    GpuHandle(GpuHandle const&) = delete;
+    GpuHandle& operator=(GpuHandle const&) = delete;
+    GpuHandle(GpuHandle&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    GpuHandle& operator=(GpuHandle&& other) noexcept
+    {
+        if (this != &other) {
+            Reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    T Get() const { return handle; }
+    explicit operator bool() const { return handle != nullptr; }
+
+    void Reset(T newHandle = nullptr)
+    {
+        if (handle) {
+            GpuReleaseQueue::OnDetached(Traits::type);
+            GpuReleaseQueue::Defer(handle, &ReleaseDeferred, Traits::type);
+        }
+        handle = newHandle;
+        if (handle) GpuReleaseQueue::OnAdopted(Traits::type);
+    }
+
+    // Give the reference back to the caller, who releases it
+    T Detach()
+    {
+        if (handle) GpuReleaseQueue::OnDetached(Traits::type);
+        return std::exchange(handle, nullptr);
+    }
+
+private:
+    static void ReleaseDeferred(void* handle)
+    {
+        Traits::Release(handle);
+        GpuReleaseQueue::OnReleased(Traits::type);
+    }
+
+private:
+    T handle = nullptr;
+};
+
+// Defer the release of a reference held outside of a GpuHandle
+template<typename T>
+void GpuDeferRelease(T handle)
+{
+    GpuHandle<T>(handle).Reset();
+}
+
+using GpuBuffer = GpuHandle<WGPUBuffer>;
+using GpuTexture = GpuHandle<WGPUTexture>;
+using GpuTextureView = GpuHandle<WGPUTextureView>;
+using GpuSampler = GpuHandle<WGPUSampler>;
+using GpuBindGroup = GpuHandle<WGPUBindGroup>;
+using GpuBindGroupLayout = GpuHandle<WGPUBindGroupLayout>;
+using GpuPipelineLayout = GpuHandle<WGPUPipelineLayout>;
+using GpuShaderModule = GpuHandle<WGPUShaderModule>;
+using GpuRenderPipeline = GpuHandle<WGPURenderPipeline>;
+using GpuComputePipeline = GpuHandle<WGPUComputePipeline>;
+using GpuQuerySet = GpuHandle<WGPUQuerySet>;
+using GpuRenderBundle = GpuHandle<WGPURenderBundle>;
@@ -0,0 +1,111 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GpuPassTiming {
+    std::string name;
+    double lastMs = 0.0;
+    double averageMs = 0.0;
+    double maxMs = 0.0;
+    uint32_t samples = 0;
+};
+
+struct GpuProfilerStats {
+    bool enabled = false;
+    uint64_t framesResolved = 0;
+    // Frames not profiled because every readback buffer was still in use
+    uint64_t framesSkipped = 0;
+    // Passes beyond MaxPassesPerFrame
+    uint64_t passesDropped = 0;
+};
+
+// GPU timings of render and compute passes from timestamp queries.
+//
+// Each pass gets a begin/end pair of queries in the frame's query set. At
+// the end of the frame the set is resolved and copied into one buffer of a
+// readback ring, which is mapped asynchronously once submitted; results are
+// collected a few frames later without ever waiting for the GPU. If every
+// buffer of the ring is still mapping, the frame is simply not profiled.
+//
+// Without the TimestampQuery feature (or with no device at all) the profiler
+// stays disabled: it hands out no timestamp writes and reports nothing.
+class GpuProfiler {
+public:
+    static constexpr uint32_t MaxPassesPerFrame = 32;
+    static constexpr uint32_t ReadbackRingSize = 4;
+    static constexpr uint32_t HistorySize = 120;
+
+    GpuProfiler();
+    ~GpuProfiler();
+
+    bool Initialize(WGPUDevice device);
+    void Terminate();
+
+    bool IsEnabled() const { return enabled; }
+
+    // Collect finished readbacks, then pick the ring slot for this frame
+    void BeginFrame();
+
+    // Timestamp writes for the next pass, nullptr if it is not profiled
+    WGPURenderPassTimestampWrites const* RenderPassWrites(char const* name);
+    WGPUComputePassTimestampWrites const* ComputePassWrites(char const* name);
+
+    // Resolve the queries into the readback buffer of the frame
+    void EndFrame(WGPUCommandEncoder encoder);
+
+    // Call once the encoder given to EndFrame() was submitted
+    void OnSubmitted();
+
+    // Rolling per-pass history, in order of first appearance
+    std::vector<GpuPassTiming> GetPassTimings() const;
+    GpuProfilerStats const& GetStats() const { return stats; }
+    void Report(std::ostream& out) const;
+
+private:
+    enum class SlotState {
+        Free,
+        Recording,
+        // Submitted, waiting for wgpuBufferMapAsync
+        Mapping,
+        Mapped,
+        // The map failed, unmap and reuse
+        Failed,
+    };
+
+    struct Slot;
+
+    struct PassHistory {
+        std::string name;
+        float samples[HistorySize] = {};
+        uint32_t count = 0;
+        uint32_t next = 0;
+        float lastMs = 0.0f;
+    };
+
+    // Return the first query index of the pass, or ~0u
+    uint32_t AllocatePass(char const* name);
+    void Collect(Slot& slot);
+
+private:
+    WGPUDevice device = nullptr;
+    bool enabled = false;
+
+    std::unique_ptr<Slot> slots[ReadbackRingSize];
+    uint32_t current = 0;
+    Slot* recording = nullptr;
+
+    // Returned by the *PassWrites() functions, valid until the next call
+    WGPURenderPassTimestampWrites renderWrites = {};
+    WGPUComputePassTimestampWrites computeWrites = {};
+
+    std::vector<PassHistory> history;
+    std::unordered_map<std::string, size_t> historyIndex;
+
+    GpuProfilerStats stats;
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A unit of work. It is finished once its function returned and all of its
+// children are finished, so waiting on a parent waits on the whole tree.
+struct Job {
+    std::function<void()> function;
+    Job* parent = nullptr;
+    // 1 for the job itself, plus 1 per unfinished child
+    std::atomic<uint32_t> unfinished{ 1 };
+    // 1 for the handle returned by Create(), plus 1 until finished
+    std::atomic<uint32_t> references{ 2 };
+};
+
+// Fixed-size Chase-Lev deque of one worker: the owner pushes and pops at
+// the bottom, other threads steal from the top. When full, Push() fails and
+// the caller runs the job itself.
+class JobDeque {
+public:
+    static constexpr int64_t Capacity = 4096;
+
+    bool Push(Job* job);
+    Job* Pop();
+    Job* Steal();
+
+private:
+    alignas(64) std::atomic<int64_t> top{ 0 };
+    alignas(64) std::atomic<int64_t> bottom{ 0 };
+    std::atomic<Job*> jobs[Capacity] = {};
+};
+
+struct JobWorkerStats {
+    uint64_t jobsExecuted = 0;
+    // Taken from another thread's deque
+    uint64_t jobsStolen = 0;
+    // Times it went to sleep for lack of work
+    uint64_t sleeps = 0;
+    double busyMs = 0.0;
+    // busyMs over the time since Initialize
+    double utilization = 0.0;
+};
+
+struct JobSystemStats {
+    // The thread that called Initialize first, then the workers
+    std::vector<JobWorkerStats> workers;
+    // Run from threads without a deque, through the shared queue
+    uint64_t jobsInjected = 0;
+};
+
+// Work-stealing scheduler. Every worker, and the thread that called
+// Initialize(), owns a deque: jobs it runs go to its own bottom and come
+// back LIFO, idle workers steal the oldest ones from the others. Other
+// threads hand their jobs over through a shared queue. Wait() never
+// blocks while there is work: the waiting thread runs jobs until the one
+// it waits for is finished.
+class JobSystem {
+public:
+    // 0 workers: one per core besides the calling thread, at least one
+    void Initialize(uint32_t workerCount = 0);
+    // Runs what is left first
+    void Terminate();
+
+    // The job does not run until given to Run(). With a parent, the parent
+    // is not finished before this job is. The handle stays valid until
+    // Wait() or Release().
+    Job* Create(std::function<void()> function, Job* parent = nullptr);
+    void Run(Job* job);
+    // Create and run a job nobody waits for directly, e.g. a child
+    void Spawn(std::function<void()> function, Job* parent = nullptr);
+    bool IsFinished(Job const* job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+    // Run other jobs until `job` is finished, then release it
+    void Wait(Job* job);
+    // Give up the handle of a job that is not waited for
+    void Release(Job* job);
+
+    // Calls body(first, last) over [begin, end) cut into chunks of `grain`,
+    // and returns once all ran
+    void ParallelFor(size_t begin, size_t end, size_t grain, std::function<void(size_t first, size_t last)> const& body);
+
+    // Worker threads plus the thread that called Initialize()
+    uint32_t GetThreadCount() const { return (uint32_t)workers.size(); }
+    JobSystemStats GetStats() const;
+
+private:
+    struct alignas(64) Worker {
+        JobSystem* system = nullptr;
+        uint32_t index = 0;
+        JobDeque deque;
+        std::atomic<uint64_t> jobsExecuted{ 0 };
+        std::atomic<uint64_t> jobsStolen{ 0 };
+        std::atomic<uint64_t> sleeps{ 0 };
+        std::atomic<uint64_t> busyNs{ 0 };
+        std::thread thread;
+    };
+
+    Worker* GetCurrentWorker() const;
+    // Own deque, then the others, then the shared queue
+    Job* FindJob(Worker* worker);
+    void Execute(Job* job, Worker* worker);
+    void Finish(Job* job);
+    void WorkerMain(Worker* worker);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::chrono::steady_clock::time_point start;
+
+    // Jobs pushed and not taken yet, which idle workers sleep on
+    std::atomic<int64_t> queuedJobs{ 0 };
+    std::atomic<int32_t> sleepingWorkers{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    mutable std::mutex injectedMutex;
+    std::deque<Job*> injected;
+    uint64_t jobsInjected = 0;
+};
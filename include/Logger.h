@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warning,
+    Error,
+};
+
+struct LoggerStats {
+    uint64_t logged = 0;
+    // The thread's ring was full: the flusher is far behind
+    uint64_t dropped = 0;
+    // Identical to the message right before, counted instead of written
+    uint64_t repeated = 0;
+    // Over the per-event rate limit
+    uint64_t suppressed = 0;
+    uint64_t written = 0;
+};
+
+// Structured, asynchronous logging for callbacks and other hot paths.
+//
+// A message is an event name (a string literal) followed by key, value
+// fields: Logger::Error("Device error", "type", type, "message", message).
+// The calling thread copies it into its own ring buffer without locks and
+// returns; a flusher thread formats and writes everything every few
+// milliseconds, in time order. Strings are copied, up to MaxText bytes per
+// message. A full ring drops the message rather than wait.
+//
+// Before writing, the flusher collapses runs of identical messages into a
+// repeat count, and writes at most `maxPerSecond` messages of each event per
+// second, reporting how many it suppressed.
+class Logger {
+public:
+    // Messages kept per thread, a power of two
+    static constexpr uint32_t RingSize = 1u << 10;
+    static constexpr uint32_t MaxFields = 4;
+    static constexpr uint32_t MaxText = 136;
+
+    static void Initialize(LogLevel minLevel = LogLevel::Info, FILE* output = stdout, uint32_t maxPerSecond = 20);
+    // Writes what is left and stops the flusher
+    static void Terminate();
+    // Write everything logged so far, from the calling thread
+    static void Flush();
+
+    static LoggerStats GetStats();
+
+    template<typename... Fields>
+    static void Debug(char const* event, Fields const&... fields) { Log(LogLevel::Debug, event, fields...); }
+    template<typename... Fields>
+    static void Info(char const* event, Fields const&... fields) { Log(LogLevel::Info, event, fields...); }
+    template<typename... Fields>
+    static void Warning(char const* event, Fields const&... fields) { Log(LogLevel::Warning, event, fields...); }
+    template<typename... Fields>
+    static void Error(char const* event, Fields const&... fields) { Log(LogLevel::Error, event, fields...); }
+
+    // `event` and the keys must outlive the logger (string literals)
+    template<typename... Fields>
+    static void Log(LogLevel level, char const* event, Fields const&... fields)
+    {
+        static_assert(sizeof...(Fields) % 2 == 0, "Fields are key, value pairs");
+        static_assert(sizeof...(Fields) / 2 <= MaxFields, "Too many fields");
+        if (level < minLevel.load(std::memory_order_relaxed)) return;
+        Record* record = BeginRecord();
+        if (!record) return;
+        record->time = std::chrono::steady_clock::now();
+        record->event = event;
+        record->level = level;
+        record->fieldCount = 0;
+        record->textUsed = 0;
+        if constexpr (sizeof...(Fields) > 0) SetFields(*record, fields...);
+        threadRing->head.store(threadRing->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    enum class FieldType : uint8_t {
+        Int,
+        UInt,
+        Double,
+        String,
+        Pointer,
+    };
+
+    struct Field {
+        char const* key;
+        FieldType type;
+        // String: where its bytes are in the record's text
+        uint16_t textOffset;
+        uint16_t textLength;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+        };
+    };
+
+    struct Record {
+        std::chrono::steady_clock::time_point time;
+        char const* event;
+        LogLevel level;
+        uint8_t fieldCount;
+        uint16_t textUsed;
+        Field fields[MaxFields];
+        char text[MaxText];
+    };
+
+    struct ThreadRing {
+        Record records[RingSize];
+        // Written by the owning thread, and by the flusher
+        alignas(64) std::atomic<uint64_t> head{ 0 };
+        alignas(64) std::atomic<uint64_t> tail{ 0 };
+        std::atomic<uint64_t> dropped{ 0 };
+    };
+
+    struct Registry;
+
+    static inline thread_local ThreadRing* threadRing = nullptr;
+    static inline std::atomic<LogLevel> minLevel{ LogLevel::Info };
+
+    static ThreadRing& GetThreadRing();
+    static Registry& GetRegistry();
+    static void FlusherMain();
+    static void Drain(Registry& registry);
+    static bool IsSameMessage(Record const& a, Record const& b);
+
+    // The slot to fill, or nullptr when the ring is full
+    static Record* BeginRecord()
+    {
+        if (!threadRing) threadRing = &GetThreadRing();
+        uint64_t head = threadRing->head.load(std::memory_order_relaxed);
+        if (head - threadRing->tail.load(std::memory_order_acquire) == RingSize) {
+            threadRing->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &threadRing->records[head & (RingSize - 1)];
+    }
+
+    template<typename T, typename... Rest>
+    static void SetFields(Record& record, char const* key, T const& value, Rest const&... rest)
+    {
+        Field& field = record.fields[record.fieldCount++];
+        field.key = key;
+        SetValue(record, field, value);
+        if constexpr (sizeof...(Rest) > 0) SetFields(record, rest...);
+    }
+
+    template<typename T>
+    static void SetValue(Record& record, Field& field, T const& value)
+    {
+        if constexpr (std::is_enum_v<T>) {
+            field.type = FieldType::Int;
+            field.i = (int64_t)value;
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            field.type = FieldType::Int;
+            field.i = value;
+        }
+        else if constexpr (std::is_integral_v<T>) {
+            field.type = FieldType::UInt;
+            field.u = value;
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            field.type = FieldType::Double;
+            field.d = value;
+        }
+        else if constexpr (std::is_same_v<T, std::string>) {
+            SetString(record, field, value.data(), value.size());
+        }
+        else if constexpr (std::is_convertible_v<T const&, char const*>) {
+            char const* text = value;
+            SetString(record, field, text ? text : "(null)", text ? std::strlen(text) : 6);
+        }
+        else if constexpr (std::is_pointer_v<T>) {
+            field.type = FieldType::Pointer;
+            field.u = (uint64_t)(uintptr_t)value;
+        }
+        else {
+            static_assert(!sizeof(T), "Unsupported log field type");
+        }
+    }
+
+    static void SetString(Record& record, Field& field, char const* text, size_t length)
+    {
+        // Truncated to what is left of the record
+        length = std::min<size_t>(length, MaxText - record.textUsed);
+        std::memcpy(record.text + record.textUsed, text, length);
+        field.type = FieldType::String;
+        field.textOffset = record.textUsed;
+        field.textLength = (uint16_t)length;
+        record.textUsed += (uint16_t)length;
+    }
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct PipelineCacheStats {
+    // In-memory deduplication
+    uint32_t shaderHits = 0;
+    uint32_t shaderMisses = 0;
+    uint32_t pipelineHits = 0;
+    uint32_t pipelineMisses = 0;
+    // Keys already validated by a previous run
+    uint32_t diskHits = 0;
+    uint32_t diskMisses = 0;
+    // Objects the device rejected, released instead of cached
+    uint32_t validationFailures = 0;
+    // Time spent creating shader modules and pipelines
+    double createMs = 0.0;
+};
+
+// Content-addressed cache for shader modules and render pipelines.
+//
+// Keys are a 64-bit hash of the WGSL source, the entry points and every
+// field of the WGPURenderPipelineDescriptor, so identical requests return
+// the very same handle. The cache owns the handles it returns.
+//
+// wgpu-native does not expose pipeline binaries, so the on-disk part only
+// records which keys passed validation, reported as disk hits on the next run.
+// It keeps the MaxIndexKeys most recently used keys. Pipelines with an
+// explicit layout stay out of it: their key holds the layout's handle, which
+// means nothing in another run. For the same reason such a layout must
+// outlive the cache.
+//
+// Thread-safe. Validation does not use error scopes, which are device-wide
+// and would catch the errors of other threads: wgpu-native reports an error
+// from inside the failing call, on its thread, and the uncaptured error
+// callback hands it to CaptureError(). Any thread may create objects, as
+// long as no other thread has an error scope open meanwhile.
+class PipelineCache {
+public:
+    // Keys written back to the index at most
+    static constexpr size_t MaxIndexKeys = 4096;
+
+    // Load the index of known keys from `indexPath` (missing file is fine)
+    bool Initialize(WGPUDevice device, char const* indexPath = "pipeline_cache.txt");
+
+    // Write the index back and release every cached object
+    void Terminate();
+
+    // Return nullptr if the source does not pass validation. Failures are not
+    // cached: the next call with the same source tries again.
+    WGPUShaderModule GetShaderModule(char const* wgslSource);
+
+    // `descriptor` is used as a template: its vertex and fragment modules are
+    // replaced by the module compiled from `wgslSource`. Return nullptr if the
+    // module or the pipeline does not pass validation.
+    WGPURenderPipeline GetRenderPipeline(char const* wgslSource, WGPURenderPipelineDescriptor const& descriptor);
+
+    // Call first from the device's uncaptured error callback. Return true if
+    // the error comes from an object the cache is creating on this thread,
+    // which then fails validation.
+    static bool CaptureError(WGPUErrorType type, char const* message);
+
+    // Hash used as the cache key, exposed for tools and tests
+    static uint64_t HashShader(char const* wgslSource);
+    static uint64_t HashRenderPipeline(uint64_t shaderKey, WGPURenderPipelineDescriptor const& descriptor);
+
+    PipelineCacheStats GetStats();
+
+private:
+    // Errors raised on this thread while it is current fail the object
+    // being created
+    struct Validation {
+        bool failed = false;
+        // Recorded in the on-disk index once it passed
+        bool persistent = true;
+    };
+
+    void BeginValidation(Validation& current, uint64_t key);
+    // Return false if the device reported an error since BeginValidation()
+    bool EndValidation(Validation& current, uint64_t key);
+    void LoadIndex();
+    void SaveIndex();
+
+private:
+    WGPUDevice device = nullptr;
+    std::string indexPath;
+
+    // Recursive since GetRenderPipeline() goes through GetShaderModule()
+    std::recursive_mutex mutex;
+
+    std::unordered_map<uint64_t, WGPUShaderModule> shaderModules;
+    std::unordered_map<uint64_t, WGPURenderPipeline> renderPipelines;
+
+    // Keys found in the index, most recently used first
+    std::unordered_set<uint64_t> indexedKeys;
+    std::vector<uint64_t> indexOrder;
+    // Validated by this run, written back before the older ones
+    std::vector<uint64_t> usedKeys;
+    bool indexDirty = false;
+
+    PipelineCacheStats stats;
+
+    static inline thread_local Validation* validation = nullptr;
+};
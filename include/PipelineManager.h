@@ -0,0 +1,86 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PipelineCache;
+
+using PipelineHandle = uint32_t;
+constexpr PipelineHandle InvalidPipelineHandle = ~0u;
+
+enum class PipelineState {
+    Pending,
+    Ready,
+    Failed,
+};
+
+struct PipelineManagerStats {
+    uint32_t pending = 0;
+    uint32_t ready = 0;
+    uint32_t failed = 0;
+    // Resolve() calls answered with the fallback or with nothing
+    uint64_t fallbackDraws = 0;
+    uint64_t skippedDraws = 0;
+};
+
+// Creates render pipelines on a worker thread so that the main thread never
+// blocks in shader compilation or wgpuDeviceCreateRenderPipeline. Until a
+// pipeline is ready, draws referencing it get the fallback pipeline declared
+// with the request, or nullptr meaning the draw should be skipped.
+//
+// The worker also validates what it creates: the cache catches the errors
+// raised on the worker itself, without error scopes, so the frames recorded
+// meanwhile neither wait for it nor get their errors mixed in.
+class PipelineManager {
+public:
+    PipelineManager();
+    ~PipelineManager();
+
+    void Initialize(WGPUDevice device, PipelineCache& cache);
+
+    // Stop the worker once the requests it already started are done
+    void Terminate();
+
+    // Queue the creation of a pipeline. The descriptor and everything it
+    // points to is copied, the vertex and fragment modules are ignored and
+    // compiled from `wgslSource` by the cache.
+    PipelineHandle Request(char const* name, char const* wgslSource, WGPURenderPipelineDescriptor const& descriptor,
+        PipelineHandle fallback = InvalidPipelineHandle);
+
+    // Pipeline to bind this frame, nullptr if the draw must be skipped
+    WGPURenderPipeline Resolve(PipelineHandle handle);
+
+    PipelineState GetState(PipelineHandle handle) const;
+    // Time between Request() and the pipeline becoming usable
+    double GetTimeToReadyMs(PipelineHandle handle) const;
+
+    PipelineManagerStats GetStats() const;
+
+private:
+    struct Entry;
+
+    void WorkerMain();
+    void Finish(Entry& entry, WGPURenderPipeline pipeline);
+
+private:
+    WGPUDevice device = nullptr;
+    PipelineCache* cache = nullptr;
+
+    // Only the main thread appends, the worker looks entries up under `mutex`
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::deque<PipelineHandle> jobs;
+
+    mutable std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+    std::thread worker;
+
+    uint64_t fallbackDraws = 0;
+    uint64_t skippedDraws = 0;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+struct RedrawSchedulerStats {
+    // Returns from the event wait
+    uint64_t wakeups = 0;
+    uint64_t framesRendered = 0;
+    // Woken up, but nothing the frame depends on had changed
+    uint64_t framesSkipped = 0;
+    // Blocked waiting for events
+    double waitSeconds = 0.0;
+    double wallSeconds = 0.0;
+    // Process CPU time over wall time since Initialize, 1.0 is one core busy
+    double cpuUsage = 0.0;
+};
+
+// Decides when the main loop records a frame. Continuous, it renders every
+// iteration. On demand, the loop blocks in glfwWaitEventsTimeout and renders
+// only when something may change the image:
+// - Invalidate(), from any thread, e.g. input handlers changing state
+// - a running animation, between BeginAnimation() and EndAnimation()
+// - a redraw scheduled with ScheduleRedraw()
+// - damage: the frame's inputs hash differently than the last frame's
+// Anything else, e.g. the mouse moving over a static scene, wakes the loop
+// but the frame is skipped entirely. While background work is in flight
+// (readbacks, pipeline compiles) the wait is capped so it gets polled.
+class RedrawScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void Initialize(bool onDemand, double busyPollMs = 4.0);
+    bool IsOnDemand() const { return onDemand; }
+
+    // Thread safe, wakes the main loop up
+    void Invalidate();
+    void BeginAnimation();
+    void EndAnimation();
+    // Main thread only
+    void ScheduleRedraw(Clock::time_point when);
+    // Background work waiting for the loop to poll it
+    void SetBusy(bool busy) { this->busy = busy; }
+
+    // glfwPollEvents() when continuous or when a frame is due, otherwise
+    // wait for events until the next timer or busy poll
+    void WaitEvents();
+    // Whether this iteration records a frame. `frameInputs` hashes
+    // everything the frame is built from.
+    bool ShouldRender(uint64_t frameInputs);
+
+    RedrawSchedulerStats GetStats() const;
+
+    // FNV-1a, chained through `hash`
+    static uint64_t Hash(void const* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+private:
+    bool IsFrameDue() const;
+
+private:
+    bool onDemand = false;
+    Clock::duration busyPoll = std::chrono::milliseconds(4);
+    bool busy = false;
+    std::thread::id mainThread;
+
+    // Starts invalidated so the first frame is drawn
+    std::atomic<bool> invalidated{ true };
+    std::atomic<int> animations{ 0 };
+    std::priority_queue<Clock::time_point, std::vector<Clock::time_point>, std::greater<Clock::time_point>> timers;
+
+    uint64_t lastInputs = 0;
+    bool hasLastInputs = false;
+
+    Clock::time_point start;
+    // Process CPU seconds at Initialize
+    double cpuStart = 0.0;
+    RedrawSchedulerStats stats;
+};
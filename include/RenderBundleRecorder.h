@@ -0,0 +1,95 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class JobSystem;
+
+// One draw of a draw list. Indexed when `indexBuffer` is set, `count` is
+// then the number of indices. With an `indirectBuffer` the counts are read
+// from it by the GPU instead.
+struct DrawItem {
+    WGPURenderPipeline pipeline = nullptr;
+    WGPUBindGroup bindGroup = nullptr;
+    WGPUBuffer vertexBuffer = nullptr;
+    uint64_t vertexOffset = 0;
+    uint64_t vertexSize = 0;
+    WGPUBuffer indexBuffer = nullptr;
+    WGPUIndexFormat indexFormat = WGPUIndexFormat_Uint32;
+    uint64_t indexOffset = 0;
+    uint64_t indexSize = 0;
+    uint32_t count = 0;
+    uint32_t instanceCount = 1;
+    uint32_t first = 0;
+    uint32_t firstInstance = 0;
+    WGPUBuffer indirectBuffer = nullptr;
+    uint64_t indirectOffset = 0;
+};
+
+// Attachments of the render pass the bundles will be executed in
+struct RenderBundleFormat {
+    WGPUTextureFormat colorFormat = WGPUTextureFormat_Undefined;
+    WGPUTextureFormat depthStencilFormat = WGPUTextureFormat_Undefined;
+};
+
+struct RenderBundleStats {
+    // Since the last BeginFrame()
+    uint32_t bundlesRecorded = 0;
+    uint32_t bundlesReused = 0;
+    uint32_t drawsRecorded = 0;
+    double recordMs = 0.0;
+};
+
+// Records draw lists into render bundles on the job system. Record() cuts
+// the list into at most one slice per thread, each filled into its own
+// WGPURenderBundleEncoder by a job (the calling thread helps while it
+// waits), and returns the bundles in draw order for
+// wgpuRenderPassEncoderExecuteBundles.
+//
+// Static draw lists can be recorded once with GetStaticBundles(): they are
+// only recorded again when the content of the list changes.
+class RenderBundleRecorder {
+public:
+    // Below this, a slice costs more to hand over than to record
+    static constexpr size_t MinDrawsPerSlice = 256;
+
+    void Initialize(WGPUDevice device, JobSystem& jobSystem);
+    void Terminate();
+
+    void BeginFrame();
+
+    // Append the bundles to `bundles`. They belong to the caller, who must
+    // release them once the frame using them is done.
+    void Record(DrawItem const* draws, size_t drawCount, RenderBundleFormat const& format, std::vector<WGPURenderBundle>& bundles);
+
+    // Bundles owned by the recorder, valid until the next call with `name`
+    std::vector<WGPURenderBundle> const& GetStaticBundles(char const* name, DrawItem const* draws, size_t drawCount, RenderBundleFormat const& format);
+
+    RenderBundleStats const& GetStats() const { return stats; }
+
+private:
+    struct Slice {
+        DrawItem const* draws = nullptr;
+        size_t drawCount = 0;
+        RenderBundleFormat format;
+        WGPURenderBundle bundle = nullptr;
+    };
+
+    struct StaticBundles {
+        uint64_t hash = 0;
+        std::vector<WGPURenderBundle> bundles;
+    };
+
+    WGPURenderBundle RecordSlice(Slice const& slice) const;
+
+private:
+    WGPUDevice device = nullptr;
+    JobSystem* jobSystem = nullptr;
+
+    std::vector<Slice> slices;
+    std::unordered_map<std::string, StaticBundles> staticBundles;
+
+    RenderBundleStats stats;
+};
@@ -0,0 +1,172 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class GpuProfiler;
+
+using RenderGraphResource = uint32_t;
+constexpr RenderGraphResource InvalidRenderGraphResource = ~0u;
+
+struct RenderGraphTextureDesc {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    WGPUTextureFormat format = WGPUTextureFormat_Undefined;
+    WGPUTextureUsageFlags usage = WGPUTextureUsage_RenderAttachment;
+
+    bool operator==(RenderGraphTextureDesc const& other) const {
+        return width == other.width && height == other.height
+            && format == other.format && usage == other.usage;
+    }
+};
+
+enum class RenderGraphPassType {
+    Render,
+    Compute,
+};
+
+// What a pass receives when the graph executes it. Only the encoder matching
+// the pass type is set.
+struct RenderGraphPassContext {
+    WGPURenderPassEncoder renderPass = nullptr;
+    WGPUComputePassEncoder computePass = nullptr;
+};
+
+using RenderGraphExecute = std::function<void(RenderGraphPassContext const&)>;
+
+struct RenderGraphStats {
+    uint32_t declaredPasses = 0;
+    uint32_t culledPasses = 0;
+    // Passes folded into the WGPU pass of the previous one
+    uint32_t mergedPasses = 0;
+    // Calls to wgpuCommandEncoderBeginRenderPass / BeginComputePass
+    uint32_t encoderPasses = 0;
+    uint32_t transientTextures = 0;
+    // Textures actually backing the transient ones after aliasing
+    uint32_t physicalTextures = 0;
+    double compileMs = 0.0;
+    double executeMs = 0.0;
+};
+
+// Declarative description of a frame. Passes declare what they read and
+// write, Compile() culls the passes nothing depends on, merges consecutive
+// render passes sharing their attachments and lets transient textures with
+// disjoint lifetimes share the same GPU texture. Execute() then records the
+// resulting ordered list of render and compute passes.
+//
+// The graph is meant to be rebuilt every frame: Reset() forgets the passes
+// but keeps the pool of physical textures.
+class RenderGraph {
+public:
+    void Initialize(WGPUDevice device);
+    void Terminate();
+
+    // Passes get timestamp writes from the profiler if there is one
+    void SetProfiler(GpuProfiler* profiler) { this->profiler = profiler; }
+
+    // Forget the passes and resources declared for the previous frame
+    void Reset();
+
+    // A texture owned outside the graph (e.g. the surface texture). Imported
+    // textures are outputs: passes writing them are never culled.
+    RenderGraphResource ImportTexture(char const* name, WGPUTextureView view, RenderGraphTextureDesc const& desc);
+    // A texture only living during the frame, allocated by the graph
+    RenderGraphResource CreateTexture(char const* name, RenderGraphTextureDesc const& desc);
+
+    uint32_t AddPass(char const* name, RenderGraphPassType type, RenderGraphExecute execute);
+    void SetColorAttachment(uint32_t pass, RenderGraphResource texture, WGPULoadOp loadOp = WGPULoadOp_Load, WGPUColor clearValue = WGPUColor{ 0.0, 0.0, 0.0, 1.0 });
+    void SetDepthAttachment(uint32_t pass, RenderGraphResource texture, WGPULoadOp loadOp = WGPULoadOp_Load, float clearDepth = 1.0f);
+    // Sampled or storage-read texture
+    void Read(uint32_t pass, RenderGraphResource texture);
+    // Storage-written texture (attachments are writes already)
+    void Write(uint32_t pass, RenderGraphResource texture);
+    // Keep the pass even if nothing reads what it writes
+    void SetSideEffects(uint32_t pass);
+
+    // Return false if there is nothing to execute
+    bool Compile();
+    void Execute(WGPUCommandEncoder encoder);
+
+    // Valid between Compile() and the next Reset()
+    WGPUTextureView GetTextureView(RenderGraphResource texture) const;
+
+    RenderGraphStats const& GetStats() const { return stats; }
+
+private:
+    struct Attachment {
+        RenderGraphResource texture = InvalidRenderGraphResource;
+        WGPULoadOp loadOp = WGPULoadOp_Load;
+        WGPUColor clearValue = { 0.0, 0.0, 0.0, 1.0 };
+        float clearDepth = 1.0f;
+    };
+
+    struct Pass {
+        char const* name = nullptr;
+        RenderGraphPassType type = RenderGraphPassType::Render;
+        RenderGraphExecute execute;
+        std::vector<Attachment> colorAttachments;
+        Attachment depthAttachment;
+        std::vector<RenderGraphResource> reads;
+        std::vector<RenderGraphResource> writes;
+        bool sideEffects = false;
+        // Passes whose output this one loads as an attachment
+        std::vector<uint32_t> loadedFrom;
+        uint32_t refCount = 0;
+        bool culled = false;
+    };
+
+    struct Resource {
+        char const* name = nullptr;
+        RenderGraphTextureDesc desc;
+        bool imported = false;
+        WGPUTextureView importedView = nullptr;
+        uint32_t refCount = 0;
+        uint32_t firstUse = ~0u;
+        uint32_t lastUse = 0;
+        uint32_t lastRead = 0;
+        bool read = false;
+        uint32_t physical = ~0u;
+    };
+
+    // One wgpuCommandEncoderBegin*Pass call, covering one or more passes
+    struct Batch {
+        RenderGraphPassType type = RenderGraphPassType::Render;
+        std::vector<uint32_t> passes;
+    };
+
+    struct PhysicalTexture {
+        RenderGraphTextureDesc desc;
+        WGPUTexture texture = nullptr;
+        WGPUTextureView view = nullptr;
+        // Last pass using it in the frame being compiled, ~0u when free
+        uint32_t busyUntil = ~0u;
+    };
+
+    void CullPasses();
+    void ComputeLifetimes();
+    void AliasTransients();
+    void BuildBatches();
+    bool CanMerge(Batch const& batch, Pass const& pass) const;
+    bool IsAttachmentOf(Pass const& pass, RenderGraphResource texture) const;
+    uint32_t AcquirePhysical(RenderGraphTextureDesc const& desc, uint32_t firstUse, uint32_t lastUse);
+    WGPUStoreOp StoreOpFor(RenderGraphResource texture, uint32_t batchEnd) const;
+
+private:
+    WGPUDevice device = nullptr;
+    GpuProfiler* profiler = nullptr;
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<Batch> batches;
+    std::vector<PhysicalTexture> pool;
+
+    // Scratch storage reused by Compile() and Execute()
+    std::vector<RenderGraphResource> cullStack;
+    std::vector<uint32_t> culledStack;
+    // Per resource, the last pass writing it so far
+    std::vector<uint32_t> lastWriters;
+    std::vector<WGPURenderPassColorAttachment> colorAttachments;
+
+    RenderGraphStats stats;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "TripleBuffer.h"
+
+enum class InputEventType {
+    Key,
+    // The window system lost the surface contents
+    Refresh,
+};
+
+struct InputEvent {
+    InputEventType type = InputEventType::Key;
+    int key = 0;
+    int mods = 0;
+    // When the main thread received it
+    std::chrono::steady_clock::time_point time;
+};
+
+// Window state sampled by the main thread after each batch of events
+struct WindowState {
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    bool iconified = false;
+    bool focused = true;
+};
+
+// Single producer, single consumer ring of events: the producer never
+// blocks, a full ring drops the event
+class InputEventQueue {
+public:
+    static constexpr size_t Capacity = 256;
+
+    bool Push(InputEvent const& event);
+    bool Pop(InputEvent& event);
+
+private:
+    std::array<InputEvent, Capacity> events;
+    // Written by the consumer and the producer respectively, on their own
+    // cache lines
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
+
+struct RenderThreadStats {
+    uint64_t eventsPushed = 0;
+    // Queue full, the render thread is far behind
+    uint64_t eventsDropped = 0;
+    uint64_t snapshotsPublished = 0;
+    // Window states the render thread picked up, the rest were superseded
+    uint64_t snapshotsAcquired = 0;
+    // From the main thread receiving an event to the submit of the first
+    // frame recorded after the render thread handled it
+    uint64_t latencySamples = 0;
+    double averageLatencyMs = 0.0;
+    double worstLatencyMs = 0.0;
+};
+
+// Splits the loop in two: the main thread only pumps GLFW events, pushes
+// them into a lock-free queue and publishes the window state, while this
+// thread records, submits and presents frames. Nothing is shared between
+// them but the queue and the triple-buffered window state.
+class RenderThread {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Calls `frame` on the render thread until it returns false or Stop()
+    void Start(std::function<bool()> frame);
+    // Main thread, joins the render thread
+    void Stop();
+    // The render thread left its loop by itself
+    bool IsFinished() const { return finished.load(std::memory_order_acquire); }
+    bool IsRenderThread() const { return renderThreadId.load(std::memory_order_relaxed) == std::this_thread::get_id(); }
+
+    // Main thread
+    void PushEvent(InputEvent const& event);
+    void PublishWindowState(WindowState const& state);
+
+    // Render thread
+    bool PopEvent(InputEvent& event);
+    // Returns false if the window state did not change since the last call
+    bool AcquireWindowState(WindowState& state);
+    // The events popped so far made it into a submitted frame
+    void MarkSubmitted();
+
+    // Once stopped
+    RenderThreadStats GetStats() const;
+
+private:
+    void ThreadMain(std::function<bool()> frame);
+
+private:
+    std::thread thread;
+    // Set by the thread itself: `thread` may still be being assigned when
+    // it starts running
+    std::atomic<std::thread::id> renderThreadId;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> finished{ false };
+
+    InputEventQueue events;
+    TripleBuffer<WindowState> windowState;
+
+    // Render thread: receive times of the events popped since the last submit
+    std::vector<Clock::time_point> unsubmitted;
+    double latencySumMs = 0.0;
+
+    // Main thread counters, and render thread ones, joined in GetStats()
+    uint64_t eventsPushed = 0;
+    uint64_t eventsDropped = 0;
+    uint64_t snapshotsPublished = 0;
+    RenderThreadStats renderStats;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "TripleBuffer.h"
+
+// What the simulation produces every tick, interpolated by the renderer
+struct SimulationState {
+    uint64_t tick = 0;
+    // Simulated seconds
+    double time = 0.0;
+    float clearColor[4] = { 0.9f, 0.1f, 0.2f, 1.0f };
+};
+
+struct SimulationStats {
+    static constexpr size_t HistogramBuckets = 16;
+
+    uint64_t ticks = 0;
+    // Ticks run back to back because the simulation fell behind
+    uint64_t catchUpTicks = 0;
+    // Ticks beyond the catch-up cap, never simulated: the simulation slows
+    // down instead of spiraling
+    uint64_t droppedTicks = 0;
+    double averageTickMs = 0.0;
+    double worstTickMs = 0.0;
+    // Tick durations, bucket i counts [2^i, 2^(i+1)) microseconds, the
+    // first one everything under 2 us and the last one everything above
+    std::array<uint64_t, HistogramBuckets> tickHistogram = {};
+};
+
+// Runs the simulation at a fixed rate on its own thread. Every tick turns
+// the current state into the next one, then the pair is published through
+// a triple buffer: the renderer never waits for a tick, a tick never waits
+// for a frame. The renderer blends the previous and current states by how
+// far the present lies between their tick times, so motion stays smooth at
+// any frame rate, one tick behind.
+class SimulationScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    // Advance `state` by `dt` seconds, it holds the previous tick's state
+    using TickFunction = std::function<void(SimulationState& state, double dt)>;
+
+    void Start(TickFunction tick, double ticksPerSecond = 60.0, uint32_t maxCatchUpTicks = 5, SimulationState const& initial = {});
+    void Stop();
+    bool IsRunning() const { return thread.joinable(); }
+
+    // State to render now. Call from a single thread.
+    SimulationState Sample();
+
+    SimulationStats GetStats() const;
+
+    static SimulationState Interpolate(SimulationState const& previous, SimulationState const& current, float alpha);
+
+private:
+    // Both states are needed to interpolate, so they travel together
+    struct Snapshot {
+        SimulationState previous;
+        SimulationState current;
+        // When `current` was due
+        Clock::time_point currentTime;
+    };
+
+    void ThreadMain(SimulationState state);
+
+private:
+    TickFunction tick;
+    Clock::duration step = std::chrono::milliseconds(16);
+    uint32_t maxCatchUpTicks = 5;
+
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    TripleBuffer<Snapshot> snapshots;
+    Snapshot sampled;
+
+    // Under `mutex`
+    SimulationStats stats;
+    double tickSumMs = 0.0;
+};
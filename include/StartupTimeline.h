@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Records when each startup phase begins and ends, from any thread, and
+// prints the resulting timeline once startup is over.
+class StartupTimeline {
+public:
+    StartupTimeline();
+
+    uint32_t Begin(char const* phase);
+    void End(uint32_t phase);
+
+    // Milliseconds since the timeline was created
+    double ElapsedMs() const;
+
+    // One line per phase plus the total, written with a single flush
+    void Report(std::ostream& out) const;
+
+private:
+    struct Phase {
+        char const* name = nullptr;
+        std::thread::id thread;
+        double beginMs = 0.0;
+        double endMs = -1.0;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Phase> phases;
+};
+
+// Scope covering one phase of the timeline
+class StartupPhase {
+public:
+    StartupPhase(StartupTimeline& timeline, char const* phase)
+        : timeline(timeline), phase(timeline.Begin(phase)) {}
+    ~StartupPhase() { timeline.End(phase); }
+
+    StartupPhase(StartupPhase const&) = delete;
+    StartupPhase& operator=(StartupPhase const&) = delete;
+
+private:
+    StartupTimeline& timeline;
+    uint32_t phase;
+};
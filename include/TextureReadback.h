@@ -0,0 +1,91 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Pixels of one captured texture, valid during the callback only
+struct ReadbackImage {
+    uint8_t const* pixels = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Rows are padded to 256 bytes by the copy
+    uint32_t bytesPerRow = 0;
+    WGPUTextureFormat format = WGPUTextureFormat_Undefined;
+    // Given to Capture(), e.g. the frame number
+    uint64_t tag = 0;
+};
+
+struct TextureReadbackStats {
+    uint64_t captured = 0;
+    uint64_t delivered = 0;
+    // Captures refused because every buffer was still in flight
+    uint64_t dropped = 0;
+    uint64_t bytes = 0;
+};
+
+// Copies textures into a ring of MapRead buffers and hands their pixels to
+// a callback once mapped, without waiting for the GPU: Capture() records
+// the copy, OnSubmitted() starts the map, Poll() delivers what landed, in
+// capture order.
+//
+// Meant for 4 bytes per pixel formats (RGBA8, BGRA8).
+class TextureReadback {
+public:
+    using Callback = std::function<void(ReadbackImage const&)>;
+
+    TextureReadback();
+    ~TextureReadback();
+
+    bool Initialize(WGPUDevice device, uint32_t width, uint32_t height, WGPUTextureFormat format, uint32_t bufferCount = 3);
+    void Terminate();
+
+    void SetCallback(Callback callback) { this->callback = std::move(callback); }
+
+    // The texture needs CopySrc usage. Return false if no buffer is free.
+    bool Capture(WGPUCommandEncoder encoder, WGPUTexture texture, uint64_t tag);
+    // Call once the encoder given to Capture() was submitted
+    void OnSubmitted();
+    // Deliver the captures whose buffer is mapped
+    void Poll();
+    // Poll the device until every capture was delivered
+    void WaitIdle();
+
+    bool IsIdle() const { return inFlight.empty(); }
+    uint32_t GetBytesPerRow() const { return bytesPerRow; }
+    TextureReadbackStats const& GetStats() const { return stats; }
+
+private:
+    enum class SlotState {
+        Free,
+        Recorded,
+        Mapping,
+        Mapped,
+        Failed,
+    };
+
+    struct Slot {
+        WGPUBuffer buffer = nullptr;
+        uint64_t tag = 0;
+        std::atomic<SlotState> state{ SlotState::Free };
+    };
+
+    void PollDevice();
+
+private:
+    WGPUDevice device = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bytesPerRow = 0;
+    WGPUTextureFormat format = WGPUTextureFormat_Undefined;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    // Slots in capture order, from Capture() until delivered
+    std::deque<Slot*> inFlight;
+    Callback callback;
+
+    TextureReadbackStats stats;
+};
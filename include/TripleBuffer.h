@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one writer thread to one reader thread.
+// Neither side waits: the writer fills its own slot and swaps it with the
+// middle one, the reader swaps the middle one with its slot when it holds
+// something newer. Values written faster than they are read are skipped.
+template<typename T>
+class TripleBuffer {
+public:
+    // Writer
+    T& GetWriteSlot() { return slots[writeIndex]; }
+    void Publish()
+    {
+        writeIndex = middle.exchange(writeIndex | FreshBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // Reader: returns false if nothing was published since the last call
+    bool Acquire()
+    {
+        if ((middle.load(std::memory_order_relaxed) & FreshBit) == 0) return false;
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+    T const& GetReadSlot() const { return slots[readIndex]; }
+
+private:
+    static constexpr uint8_t FreshBit = 4;
+    static constexpr uint8_t IndexMask = 3;
+
+    T slots[3] = {};
+    uint8_t writeIndex = 0;
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t readIndex = 2;
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct UploadRingStats {
+    uint64_t totalBytes = 0;
+    // Bytes and copies recorded by the last Flush()
+    uint64_t frameBytes = 0;
+    uint32_t frameCopies = 0;
+    // Uploads folded into the copy of the previous one
+    uint64_t mergedCopies = 0;
+    // Bytes over budget, waiting for a later frame
+    uint64_t deferredBytes = 0;
+    // Chunks whose map failed (e.g. device lost), replaced by new ones
+    uint32_t failedMaps = 0;
+    // Bytes sent through wgpuQueueWriteBuffer for want of a mapped chunk
+    uint64_t directBytes = 0;
+    // Time spent waiting for a staging chunk to come back from the GPU
+    double stallMs = 0.0;
+    double frameStallMs = 0.0;
+    // Average over the lifetime of the ring
+    double bandwidthMBps = 0.0;
+};
+
+// Persistent staging memory for CPU -> GPU buffer uploads.
+//
+// Data is written straight into mapped MapWrite|CopySrc chunks. Flush()
+// records the copies of the frame as a few large
+// wgpuCommandEncoderCopyBufferToBuffer calls, merging uploads that are
+// contiguous on both sides, and OnSubmitted() arms a fence after which
+// the chunks are mapped again for reuse.
+//
+// Uploads beyond the per-frame byte budget are kept aside and go out with
+// the next frames, in order.
+class UploadRing {
+public:
+    static constexpr uint64_t CopyAlignment = 4;
+
+    bool Initialize(WGPUDevice device, WGPUQueue queue, uint64_t chunkSize = 1 << 20,
+        uint32_t chunkCount = 4, uint64_t frameBudget = 8 << 20);
+    // Wait for the chunks still in use by the GPU and release them
+    void Terminate();
+
+    // Reset the frame budget and write uploads deferred by previous frames
+    void BeginFrame();
+
+    // `size` must be a multiple of CopyAlignment. Return false if the bytes
+    // were deferred to a later frame because of the budget.
+    bool Upload(WGPUBuffer destination, uint64_t destinationOffset, void const* data, uint64_t size);
+
+    // Record the pending copies into `encoder`
+    void Flush(WGPUCommandEncoder encoder);
+
+    // Call once the encoder given to Flush() has been submitted
+    void OnSubmitted();
+
+    UploadRingStats const& GetStats() const { return stats; }
+
+private:
+    enum class ChunkState {
+        // Mapped, ready for writes
+        Mapped,
+        // Written this frame, not flushed yet
+        Pending,
+        // Unmapped, read by submitted copies
+        InFlight,
+        // Waiting for wgpuBufferMapAsync
+        Mapping,
+        // The map failed, the chunk has no memory to write to
+        Failed,
+    };
+
+    struct Chunk {
+        UploadRing* ring = nullptr;
+        WGPUBuffer buffer = nullptr;
+        uint8_t* mapped = nullptr;
+        uint64_t cursor = 0;
+        bool fenceArmed = false;
+        // Written by WebGPU callbacks, possibly from another polling thread
+        std::atomic<ChunkState> state{ ChunkState::Mapped };
+    };
+
+    struct Copy {
+        WGPUBuffer source = nullptr;
+        uint64_t sourceOffset = 0;
+        WGPUBuffer destination = nullptr;
+        uint64_t destinationOffset = 0;
+        uint64_t size = 0;
+    };
+
+    struct DeferredUpload {
+        WGPUBuffer destination = nullptr;
+        uint64_t destinationOffset = 0;
+        std::vector<uint8_t> data;
+    };
+
+    // Mapped at creation, nullptr if the buffer could not be created or mapped
+    std::unique_ptr<Chunk> CreateChunk();
+    // Room for `size` bytes, waiting for or growing the ring if needed.
+    // nullptr if no chunk could be mapped.
+    uint8_t* Allocate(uint64_t size, Chunk*& chunk, uint64_t& offset);
+    void Write(WGPUBuffer destination, uint64_t destinationOffset, uint8_t const* data, uint64_t size);
+    // Return false if the map failed
+    bool WaitUntilMapped(Chunk& chunk);
+
+private:
+    WGPUDevice device = nullptr;
+    WGPUQueue queue = nullptr;
+    uint64_t chunkSize = 0;
+    uint64_t frameBudget = 0;
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    uint32_t current = 0;
+
+    std::vector<Copy> copies;
+    std::deque<DeferredUpload> deferred;
+    uint64_t frameBytes = 0;
+
+    std::chrono::steady_clock::time_point startTime;
+    UploadRingStats stats;
+};
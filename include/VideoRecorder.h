@@ -0,0 +1,91 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TextureReadback.h"
+
+// What to do with a frame when the writer is behind and the queue is full
+enum class VideoQueuePolicy {
+    // Skip the frame, the render loop never waits
+    Drop,
+    // Wait for the writer: no frame is lost, the render loop slows down
+    Block,
+};
+
+struct VideoRecorderStats {
+    uint64_t framesCaptured = 0;
+    uint64_t framesWritten = 0;
+    // Readback ring or queue full with the Drop policy
+    uint64_t framesDropped = 0;
+    uint64_t bytesWritten = 0;
+    // RGB -> YUV420 on the main thread
+    double convertMs = 0.0;
+    // Main thread waiting for queue space with the Block policy
+    double blockedMs = 0.0;
+    // Writer thread time in fwrite
+    double writeMs = 0.0;
+};
+
+// Streams frames to a YUV4MPEG2 (.y4m) file or to a pipe, e.g.
+// "|ffmpeg -i - out.mp4". Frames are read back asynchronously, converted
+// to 8-bit 4:2:0 (BT.601, limited range) straight from the mapped buffer,
+// and queued for a writer thread through a bounded queue.
+class VideoRecorder {
+public:
+    bool Initialize(WGPUDevice device, uint32_t width, uint32_t height, WGPUTextureFormat format);
+    void Terminate();
+
+    // `path` starting with '|' is a command whose stdin gets the stream,
+    // "-" is stdout
+    bool Start(std::string const& path, uint32_t fps = 60, VideoQueuePolicy policy = VideoQueuePolicy::Drop, size_t queueSize = 8);
+    // Write what was captured so far and close the output
+    void Stop();
+    bool IsRecording() const { return output != nullptr; }
+
+    // Record the copy of this frame. `texture` needs CopySrc.
+    void Capture(WGPUCommandEncoder encoder, WGPUTexture texture, uint64_t frameNumber);
+    void OnSubmitted();
+    void Poll();
+
+    VideoRecorderStats GetStats() const;
+
+    // Interleaved 4 bytes per pixel rows to planar Y, U, V. Odd sizes round
+    // the chroma planes up.
+    static void ConvertToYuv420(uint8_t const* pixels, uint32_t width, uint32_t height, uint32_t bytesPerRow, bool bgra,
+        uint8_t* y, uint8_t* u, uint8_t* v);
+
+private:
+    void OnReadback(ReadbackImage const& image);
+    void WriterMain();
+
+private:
+    TextureReadback readback;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    WGPUTextureFormat format = WGPUTextureFormat_Undefined;
+    size_t frameSize = 0;
+
+    FILE* output = nullptr;
+    bool outputIsPipe = false;
+    VideoQueuePolicy policy = VideoQueuePolicy::Drop;
+    size_t queueSize = 8;
+
+    // Planar frames: queued for the writer, and recycled once written
+    mutable std::mutex mutex;
+    std::condition_variable frameQueued;
+    std::condition_variable frameWritten;
+    std::deque<std::unique_ptr<std::vector<uint8_t>>> queue;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> freeFrames;
+    bool stopping = false;
+    std::thread writer;
+
+    VideoRecorderStats stats;
+};
@@ -10,7 +10,14 @@
 #include <glfw3webgpu.h>
 
 #include <iostream>
+#include <atomic>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
 #include <vector>
 
 
@@ -36,87 +43,47 @@ fn fs_main() -> @location(0) vec4f {
 
 
 WGPUAdapter Application::requestAdapterSync(WGPUInstance instance, WGPURequestAdapterOptions const* options) {
-    // A simple structure holding the local information shared with the
-    // onAdapterRequestEnded callback.
-    struct UserData {
-        WGPUAdapter adapter = nullptr;
-        bool requestEnded = false;
-    };
-    UserData userData;
-
-    // Callback called by wgpuInstanceRequestAdapter when the request returns
-    // This is a C++ lambda function, but could be any function defined in the
-    // global scope. It must be non-capturing (the brackets [] are empty) so
-    // that it behaves like a regular C function pointer, which is what
-    // wgpuInstanceRequestAdapter expects (WebGPU being a C API). The workaround
-    // is to convey what we want to capture through the pUserData pointer,
-    // provided as the last argument of wgpuInstanceRequestAdapter and received
-    // by the callback as its last argument.
-    auto onAdapterRequestEnded = [](WGPURequestAdapterStatus status, WGPUAdapter adapter, char const* message, void* pUserData) {
-        UserData& userData = *reinterpret_cast<UserData*>(pUserData);
-        if (status == WGPURequestAdapterStatus_Success) {
-            userData.adapter = adapter;
+    // The coroutine takes its arguments by value, so it must not capture
+    auto requestAdapter = [](GpuExecutor& executor, WGPUInstance instance, WGPURequestAdapterOptions const* options) -> GpuTask<WGPUAdapter> {
+        GpuResult<WGPUAdapter> result = co_await GpuRequestAdapter(executor, instance, options);
+        if (!result.ok) {
+            Logger::Error("Could not get WebGPU adapter", "message", result.message);
         }
-        else {
-            std::cout << "Could not get WebGPU adapter: " << message << std::endl;
-        }
-        userData.requestEnded = true;
+        co_return result.value;
         };
 
-    // Call to the WebGPU request adapter procedure
-    wgpuInstanceRequestAdapter(
-        instance /* equivalent of navigator.gpu */,
-        options,
-        onAdapterRequestEnded,
-        (void*)&userData
-    );
-
-    assert(userData.requestEnded);
-
-    return userData.adapter;
+    // Does not need the device, only drives the instance until the callback
+    GpuExecutor executor(instance, nullptr);
+    return executor.Wait(requestAdapter(executor, instance, options));
 }
 WGPUDevice Application::requestDeviceSync(WGPUAdapter adapter, WGPUDeviceDescriptor const* descriptor) {
-    struct UserData {
-        WGPUDevice device = nullptr;
-        bool requestEnded = false;
-    };
-    UserData userData;
-
-    auto onDeviceRequestEnded = [](WGPURequestDeviceStatus status, WGPUDevice device, char const* message, void* pUserData) {
-        UserData& userData = *reinterpret_cast<UserData*>(pUserData);
-        if (status == WGPURequestDeviceStatus_Success) {
-            userData.device = device;
+    auto requestDevice = [](GpuExecutor& executor, WGPUAdapter adapter, WGPUDeviceDescriptor const* descriptor) -> GpuTask<WGPUDevice> {
+        GpuResult<WGPUDevice> result = co_await GpuRequestDevice(executor, adapter, descriptor);
+        if (!result.ok) {
+            Logger::Error("Could not get WebGPU device", "message", result.message);
         }
-        else {
-            std::cout << "Could not get WebGPU device: " << message << std::endl;
-        }
-        userData.requestEnded = true;
+        co_return result.value;
         };
 
-    wgpuAdapterRequestDevice(
-        adapter,
-        descriptor,
-        onDeviceRequestEnded,
-        (void*)&userData
-    );
-
-#ifdef __EMSCRIPTEN__
-    while (!userData.requestEnded) {
-        emscripten_sleep(100);
-    }
-#endif // __EMSCRIPTEN__
-
-    assert(userData.requestEnded);
-
-    return userData.device;
+    GpuExecutor executor(nullptr, nullptr);
+    return executor.Wait(requestDevice(executor, adapter, descriptor));
 }
 WGPUTextureView Application::GetNextSurfaceTextureView() {
+    CPU_ZONE("GetNextSurfaceTextureView");
+    // Headless: always the same offscreen texture, frames in flight are
+    // ordered by the queue
+    if (!surface) {
+        targetTexture = offscreenTexture.Get();
+        return wgpuTextureCreateView(offscreenTexture.Get(), nullptr);
+    }
+
     WGPUSurfaceTexture surfaceTexture;
     wgpuSurfaceGetCurrentTexture(surface, &surfaceTexture);
 
     if (surfaceTexture.status != WGPUSurfaceGetCurrentTextureStatus_Success) {
         return nullptr;
     }
+    targetTexture = surfaceTexture.texture;
 
     WGPUTextureViewDescriptor viewDescriptor;
     viewDescriptor.nextInChain = nullptr;
@@ -136,21 +103,9 @@ WGPUTextureView Application::GetNextSurfaceTextureView() {
 
 void Application::InitializePipeline() {
 
-    //Create Shader Module
-    WGPUShaderModuleDescriptor shaderDesc{};
-#ifdef WEBGPU_BACKEND_WGPU
-    shaderDesc.hintCount = 0;
-    shaderDesc.hints = nullptr;
-#endif
-    WGPUShaderModuleWGSLDescriptor shaderCodeDesc{};
-    // Set the chained struct's header
-    shaderCodeDesc.chain.next = nullptr;
-    shaderCodeDesc.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
-    // Connect the chain
-    shaderDesc.nextInChain = &shaderCodeDesc.chain;
-    shaderCodeDesc.code = shaderSource;
-
-    WGPUShaderModule shaderModule = wgpuDeviceCreateShaderModule(device, &shaderDesc);
+    //Shader Module
+    // 
+    // Compiled (or found) by the pipeline cache, keyed by the hash of shaderSource
 
     //Create Render Pipeline
     WGPURenderPipelineDescriptor pipelineDesc{};
@@ -166,7 +121,7 @@ void Application::InitializePipeline() {
     // NB: We define the 'shaderModule' in the second part of this chapter.
 // Here we tell that the programmable vertex shader stage is described
 // by the function called 'vs_main' in that module.
-    pipelineDesc.vertex.module = shaderModule;
+    pipelineDesc.vertex.module = nullptr;
     pipelineDesc.vertex.entryPoint = "vs_main";
     pipelineDesc.vertex.constantCount = 0;
     pipelineDesc.vertex.constants = nullptr;
@@ -186,7 +141,7 @@ void Application::InitializePipeline() {
     // We tell that the programmable fragment shader stage is described
     // by the function called 'fs_main' in the shader module.
     WGPUFragmentState fragmentState{};
-    fragmentState.module = shaderModule;
+    fragmentState.module = nullptr;
     fragmentState.entryPoint = "fs_main";
     fragmentState.constantCount = 0;
     fragmentState.constants = nullptr;
@@ -230,38 +185,28 @@ void Application::InitializePipeline() {
     pipelineDesc.layout = nullptr;
 
     //Create Pipeline
-    pipeline = wgpuDeviceCreateRenderPipeline(device, &pipelineDesc);
-    // We no longer need to access the shader module
-    wgpuShaderModuleRelease(shaderModule);
+    // Built on the pipeline manager worker, the descriptor is copied. Until
+    // it is ready the triangle is simply not drawn.
+    pipeline = pipelineManager.Request("Triangle", shaderSource, pipelineDesc);
 
 
 }
 
-bool Application::Initialize()
+bool Application::Initialize(ApplicationOptions const& options)
 {
-	// Open window
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // <-- extra info for glfwCreateWindow
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	window = glfwCreateWindow(640, 480, "Learn WebGPU", nullptr, nullptr);
+    this->options = options;
+    // T or SIGUSR1 writes the CPU zones recorded so far to trace.json
+    CpuProfiler::Initialize("trace.json");
+    CpuProfiler::SetThreadName("Main");
+    // Callbacks log through per-thread rings, written by a flusher thread
+    Logger::Initialize();
+    CPU_ZONE("Initialize");
+    uint32_t initializePhase = startupTimeline.Begin("Initialize");
 
 	// Create instance
 	instance = wgpuCreateInstance(nullptr);
 
-	// Get adapter
-	std::cout << "Requesting adapter..." << std::endl;
-	surface = glfwGetWGPUSurface(instance, window); //Get Surface
-	WGPURequestAdapterOptions adapterOpts = {};
-	adapterOpts.nextInChain = nullptr;
-	adapterOpts.compatibleSurface = surface;                        
-	adapter = requestAdapterSync(instance, &adapterOpts);
-	std::cout << "Got adapter: " << adapter << std::endl;
-	// We no longer need to access the instance
-	wgpuInstanceRelease(instance);
-
     #pragma region DeviceConfiguration
-    // Get device
-    std::cout << "Requesting device..." << std::endl;
     deviceDesc = {};
     deviceDesc.nextInChain = nullptr;
     deviceDesc.label = "My Device"; // anything works here, that's your call
@@ -272,29 +217,120 @@ bool Application::Initialize()
 
     // A function that is invoked whenever the device stops being available.
     deviceDesc.deviceLostCallback = [](WGPUDeviceLostReason reason, char const* message, void* /* pUserData */) {
-        std::cout << "Device lost: reason " << reason;
-        if (message) std::cout << " (" << message << ")";
-        std::cout << std::endl;
+        Logger::Error("Device lost", "reason", reason, "message", message);
         };
-    device = requestDeviceSync(adapter, &deviceDesc);
-    std::cout << "Got device: " << device << std::endl;
 
-    // Device error callback
+    // Timestamp queries are optional: the GPU profiler is off without them
+    static WGPUFeatureName const timestampFeature = WGPUFeatureName_TimestampQuery;
+    auto selectFeatures = [this]() {
+        bool timestamps = wgpuAdapterHasFeature(adapter, timestampFeature);
+        deviceDesc.requiredFeatureCount = timestamps ? 1 : 0;
+        deviceDesc.requiredFeatures = timestamps ? &timestampFeature : nullptr;
+        };
+
+    // Get adapter and device on a worker thread while the window opens. The
+    // surface does not exist yet, so compatibility is checked once it does.
+    WGPURequestAdapterOptions adapterOpts = {};
+    adapterOpts.nextInChain = nullptr;
+    adapterOpts.compatibleSurface = nullptr;
+    std::thread deviceThread([this, &adapterOpts, &selectFeatures]() {
+        CpuProfiler::SetThreadName("Device request");
+        {
+            CPU_ZONE("Request adapter");
+            StartupPhase phase(startupTimeline, "Request adapter");
+            adapter = requestAdapterSync(instance, &adapterOpts);
+        }
+        if (!adapter) return;
+        CPU_ZONE("Request device");
+        StartupPhase phase(startupTimeline, "Request device");
+        selectFeatures();
+        device = requestDeviceSync(adapter, &deviceDesc);
+        });
+
+	// Open window, unless headless: then there is no GLFW at all
+    window = nullptr;
+    surface = nullptr;
+    if (!options.headless) {
+        CPU_ZONE("Create window and surface");
+        StartupPhase phase(startupTimeline, "Create window and surface");
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // <-- extra info for glfwCreateWindow
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        window = glfwCreateWindow(options.width, options.height, "Learn WebGPU", nullptr, nullptr);
+        surface = glfwGetWGPUSurface(instance, window); //Get Surface
+
+        // P cycles present modes, J toggles just in time input, L the 60 fps
+        // cap, T dumps the CPU trace, C takes a PNG screenshot (JPEG with Shift),
+        // V starts and stops recording a Y4M video. With a render thread, keys
+        // are queued for it to handle.
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int /* scancode */, int action, int mods) {
+            if (action != GLFW_PRESS) return;
+            Application& app = *reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+            if (app.options.renderThread) {
+                app.renderThread.PushEvent(InputEvent{ InputEventType::Key, key, mods, std::chrono::steady_clock::now() });
+                return;
+            }
+            app.HandleKey(key, mods);
+            });
+        // Exposed or resized by the window system: the surface contents are lost
+        glfwSetWindowRefreshCallback(window, [](GLFWwindow* window) {
+            Application& app = *reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+            if (app.options.renderThread) {
+                app.renderThread.PushEvent(InputEvent{ InputEventType::Refresh, 0, 0, std::chrono::steady_clock::now() });
+                return;
+            }
+            app.redrawScheduler.Invalidate();
+            });
+    }
+
+    {
+        CPU_ZONE("Wait for device");
+        StartupPhase phase(startupTimeline, "Wait for device");
+        deviceThread.join();
+    }
+
+    // Not every adapter can present to every surface: ask again, this time
+    // for one compatible with ours
+    bool compatible = adapter && !surface;
+    if (adapter && surface) {
+        WGPUSurfaceCapabilities capabilities = {};
+        wgpuSurfaceGetCapabilities(surface, adapter, &capabilities);
+        compatible = capabilities.formatCount > 0;
+        wgpuSurfaceCapabilitiesFreeMembers(capabilities);
+    }
+    if (!compatible && surface) {
+        StartupPhase phase(startupTimeline, "Request surface-compatible device");
+        if (device) wgpuDeviceRelease(device);
+        if (adapter) wgpuAdapterRelease(adapter);
+        adapterOpts.compatibleSurface = surface;
+        adapter = requestAdapterSync(instance, &adapterOpts);
+        if (adapter) selectFeatures();
+        device = adapter ? requestDeviceSync(adapter, &deviceDesc) : nullptr;
+    }
+    std::cout << "Got adapter: " << adapter << '\n';
+    std::cout << "Got device: " << device << '\n';
+	// We no longer need to access the instance
+	wgpuInstanceRelease(instance);
+    if (!device) {
+        if (adapter) wgpuAdapterRelease(adapter);
+        return AbortInitialize();
+    }
+
+    // Engine tasks, this thread helps when it waits for them
+    jobSystem.Initialize();
+
+    // Device error callback, may fire every frame: repeats are collapsed
     auto onDeviceError = [](WGPUErrorType type, char const* message, void* /* pUserData */) {
-        std::cout << "Uncaptured device error: type " << type;
-        if (message) std::cout << " (" << message << ")";
-        std::cout << std::endl;
+        // Raised while the pipeline cache validates what it creates
+        if (PipelineCache::CaptureError(type, message)) return;
+        Logger::Error("Uncaptured device error", "type", type, "message", message);
         };
     wgpuDeviceSetUncapturedErrorCallback(device, onDeviceError, nullptr /* pUserData */);
 
     //queue test
     queue = wgpuDeviceGetQueue(device);
 
-    auto onQueueWorkDone = [](WGPUQueueWorkDoneStatus status, void* /* pUserData */) {
-        std::cout << "Queued work finished with status: " << status << std::endl;
-        };
-    wgpuQueueOnSubmittedWorkDone(queue, onQueueWorkDone, nullptr /* pUserData */);
-
     encoderDesc = {};
     encoderDesc.nextInChain = nullptr;
     encoderDesc.label = "My command encoder";
@@ -311,163 +347,600 @@ bool Application::Initialize()
     wgpuCommandEncoderRelease(encoder); // release encoder after it's finished
 
     // Finally submit the command queue
-    std::cout << "Submitting command..." << std::endl;
-    std::cout << "Command submitted." << std::endl;
+    wgpuQueueSubmit(queue, 1, &command);
+    wgpuCommandBufferRelease(command);
 
-    for (int i = 0; i < 5; ++i) {
-        std::cout << "Tick/Poll device..." << std::endl;
-#if defined(WEBGPU_BACKEND_DAWN)
-        wgpuDeviceTick(device);
-#elif defined(WEBGPU_BACKEND_WGPU)
-        wgpuDevicePoll(device, false, nullptr);
-#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
-        emscripten_sleep(100);
-#endif
-    }
+    // Waited for at the very end, once everything else is set up
+    std::atomic<bool> queueWorkDone{ false };
+    auto onQueueWorkDone = [](WGPUQueueWorkDoneStatus status, void* pUserData) {
+        Logger::Info("Queued work finished", "status", status);
+        reinterpret_cast<std::atomic<bool>*>(pUserData)->store(true);
+        };
+    wgpuQueueOnSubmittedWorkDone(queue, onQueueWorkDone, (void*)&queueWorkDone);
     #pragma endregion
 
+    // Pipelines compile on the pipeline manager worker while the surface
+    // gets configured
+    surfaceFormat = surface ? wgpuSurfaceGetPreferredFormat(surface, adapter) : WGPUTextureFormat_RGBA8Unorm;
+    {
+        StartupPhase phase(startupTimeline, "Request pipelines");
+        pipelineCache.Initialize(device);
+        pipelineManager.Initialize(device, pipelineCache);
+        InitializePipeline();
+    }
+
     #pragma region SurfaceConfiguration
     //SURFACE CONFIGURATION
-    WGPUSurfaceConfiguration config = {};
-    config.nextInChain = nullptr;
-    // Configuration of the textures created for the underlying swap chain
-    config.width = 640;
-    config.height = 480;
-    config.usage = WGPUTextureUsage_RenderAttachment;
-    surfaceFormat = wgpuSurfaceGetPreferredFormat(surface, adapter);
-    config.format = surfaceFormat;
-    // And we do not need any particular view format:
-    config.viewFormatCount = 0;
-    config.viewFormats = nullptr;
-    config.device = device;
-
-    config.presentMode = WGPUPresentMode_Fifo;
-    config.alphaMode = WGPUCompositeAlphaMode_Auto;
-    wgpuSurfaceConfigure(surface, &config);
+    if (!surface) {
+        framePacer.Initialize();
+        CreateOffscreenTarget();
+    }
+    else {
+        StartupPhase phase(startupTimeline, "Configure surface");
+        surfaceConfig = {};
+        surfaceConfig.nextInChain = nullptr;
+        // Configuration of the textures created for the underlying swap chain
+        surfaceConfig.width = options.width;
+        surfaceConfig.height = options.height;
+        // CopySrc for screenshots
+        surfaceConfig.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_CopySrc;
+        surfaceConfig.format = surfaceFormat;
+        // And we do not need any particular view format:
+        surfaceConfig.viewFormatCount = 0;
+        surfaceConfig.viewFormats = nullptr;
+        surfaceConfig.device = device;
+
+        // Present modes can be switched at runtime among those the surface supports
+        WGPUSurfaceCapabilities capabilities = {};
+        wgpuSurfaceGetCapabilities(surface, adapter, &capabilities);
+        framePacer.SetSupportedPresentModes(capabilities.presentModes, capabilities.presentModeCount);
+        wgpuSurfaceCapabilitiesFreeMembers(capabilities);
+        framePacer.Initialize();
+
+        surfaceConfig.alphaMode = WGPUCompositeAlphaMode_Auto;
+        SetPresentMode(WGPUPresentMode_Fifo);
+    }
     #pragma endregion
 
     //Adaptater release
     wgpuAdapterRelease(adapter);
 
-    InitializePipeline();
+    frameCapture.Initialize(device, options.width, options.height, surfaceFormat, jobSystem);
+    videoRecorder.Initialize(device, options.width, options.height, surfaceFormat);
+    if (!options.recordPath.empty()) {
+        VideoQueuePolicy policy = options.headless ? VideoQueuePolicy::Block : VideoQueuePolicy::Drop;
+        if (!videoRecorder.Start(options.recordPath, 60, policy)) std::cout << "Could not record to " << options.recordPath << std::endl;
+    }
+
+    // Persistent staging memory for buffer uploads, recycled once the GPU is done
+    uploadRing.Initialize(device, queue);
 
-    //Test Buffer
-    WGPUBufferDescriptor bufferDesc = {};
-    bufferDesc.nextInChain = nullptr;
-    bufferDesc.label = "Some GPU-side data buffer";
-    bufferDesc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc;
-    bufferDesc.size = 16;
-    bufferDesc.mappedAtCreation = false;
-    buffer1 = wgpuDeviceCreateBuffer(device, &bufferDesc);
+    // Small buffers are sub-allocated from shared backing buffers
+    bufferAllocator.Initialize(device);
 
-    bufferDesc.label = "Output buffer";
-    buffer2 = wgpuDeviceCreateBuffer(device, &bufferDesc);
+    //Test Buffer
+    buffer1 = bufferAllocator.Allocate(BufferUsageClass::Storage, 16);
+    buffer2 = bufferAllocator.Allocate(BufferUsageClass::Storage, 16);
 
     // Create some CPU-side data buffer (of size 16 bytes)
     std::vector<uint8_t> numbers(16);
     for (uint8_t i = 0; i < 16; ++i) numbers[i] = i;
     // `numbers` now contains [ 0, 1, 2, ... ]
 
-    // Copy this from `numbers` (RAM) to `buffer1` (VRAM)
-    wgpuQueueWriteBuffer(queue, buffer1, 0, numbers.data(), numbers.size());
+    // Copy this from `numbers` (RAM) to `buffer1` (VRAM) through the staging ring
+    uploadRing.BeginFrame();
+    uploadRing.Upload(buffer1.buffer, buffer1.offset, numbers.data(), numbers.size());
 
-    wgpuBufferRelease(buffer1);
-    wgpuBufferRelease(buffer2);
+    // The triangle is the only instance: bounds around it, seen through an
+    // identity view-projection
+    if (!culling.Initialize(device, pipelineCache, bufferAllocator, 1024)) return AbortInitialize();
+    InstanceBounds triangleBounds;
+    triangleBounds.radius = 0.71f;
+    culling.SetInstances(uploadRing, &triangleBounds, 1);
+    float const identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    cameraFrustum = Frustum::FromViewProjection(identity);
 
     WGPUCommandEncoder encoder2 = wgpuDeviceCreateCommandEncoder(device, nullptr);
 
-    // After creating the command encoder
-    wgpuCommandEncoderCopyBufferToBuffer(encoder2, buffer1, 0, buffer2, 0, 16);
+    // The staging copy must come before the copy reading `buffer1`
+    uploadRing.Flush(encoder2);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder2, buffer1.buffer, buffer1.offset, buffer2.buffer, buffer2.offset, 16);
 
     WGPUCommandBuffer command2 = wgpuCommandEncoderFinish(encoder2, nullptr);
     wgpuCommandEncoderRelease(encoder2);
     wgpuQueueSubmit(queue, 1, &command2);
     wgpuCommandBufferRelease(command2);
+    uploadRing.OnSubmitted();
+
+    bufferAllocator.Free(buffer1);
+    bufferAllocator.Free(buffer2);
+
+    // Resumes coroutines awaiting device work, polled once per frame
+    gpuExecutor.Initialize(nullptr, device);
+    redrawScheduler.Initialize(options.onDemand && window && !options.renderThread);
+
+    if (options.simulationRate > 0.0) {
+        simulation.Start([](SimulationState& state, double /* dt */) {
+            // Pulses the background every four seconds, in place of real work
+            float brightness = 0.75f + 0.25f * (float)std::sin(state.time * 1.5707963);
+            float const base[3] = { 0.9f, 0.1f, 0.2f };
+            for (int i = 0; i < 3; ++i) state.clearColor[i] = base[i] * brightness;
+            }, options.simulationRate);
+        // Every frame shows a different point in time
+        redrawScheduler.BeginAnimation();
+    }
+
+    // Two frames in flight: record frame N+1 while the GPU runs frame N
+    frameRing.Initialize(device, queue, 2);
+    renderGraph.Initialize(device);
+    bundleRecorder.Initialize(device, jobSystem);
+    gpuProfiler.Initialize(device);
+    renderGraph.SetProfiler(&gpuProfiler);
+
+    // Wait for the test submission instead of polling a fixed number of times
+    {
+        CPU_ZONE("Wait for queue");
+        StartupPhase phase(startupTimeline, "Wait for queue");
+        while (!queueWorkDone) {
+#if defined(WEBGPU_BACKEND_DAWN)
+            wgpuDeviceTick(device);
+#elif defined(WEBGPU_BACKEND_WGPU)
+            wgpuDevicePoll(device, true, nullptr);
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+            emscripten_sleep(1);
+#endif
+        }
+    }
+
+    startupTimeline.End(initializePhase);
+    startupTimeline.Report(std::cout);
 
 	return true;
 }
 
+bool Application::AbortInitialize()
+{
+    // The video writer thread, then the encode jobs before the job system
+    videoRecorder.Stop();
+    frameCapture.Terminate();
+    pipelineManager.Terminate();
+    jobSystem.Terminate();
+    if (window) glfwDestroyWindow(window);
+    if (!options.headless) glfwTerminate();
+    Logger::Terminate();
+    return false;
+}
+
 void Application::Terminate()
 {
-    wgpuRenderPipelineRelease(pipeline);
-    wgpuSurfaceUnconfigure(surface);
+    // What was logged so far comes before the reports
+    Logger::Flush();
+    if (!surface) ReportHeadless();
+    if (simulation.IsRunning()) {
+        simulation.Stop();
+        redrawScheduler.EndAnimation();
+        SimulationStats simulationStats = simulation.GetStats();
+        std::cout << "Simulation: " << simulationStats.ticks << " ticks (" << simulationStats.catchUpTicks << " catching up, "
+            << simulationStats.droppedTicks << " dropped), " << simulationStats.averageTickMs << " ms average, "
+            << simulationStats.worstTickMs << " ms worst tick" << '\n';
+        std::cout << "Tick times:";
+        for (size_t i = 0; i < SimulationStats::HistogramBuckets; ++i) {
+            if (simulationStats.tickHistogram[i] == 0) continue;
+            std::cout << ' ' << (i == 0 ? 0 : 1u << i) << "us:" << simulationStats.tickHistogram[i];
+        }
+        std::cout << std::endl;
+    }
+    if (options.renderThread && window) {
+        RenderThreadStats threadStats = renderThread.GetStats();
+        std::cout << "Render thread: " << threadStats.eventsPushed << " events (" << threadStats.eventsDropped << " dropped), "
+            << threadStats.averageLatencyMs << " ms average and " << threadStats.worstLatencyMs << " ms worst event to submit, "
+            << threadStats.snapshotsAcquired << " of " << threadStats.snapshotsPublished << " window states used" << std::endl;
+    }
+    // CPU usage is reported in both modes, to compare idle cost
+    RedrawSchedulerStats redrawStats = redrawScheduler.GetStats();
+    std::cout << "Redraw " << (redrawScheduler.IsOnDemand() ? "on demand" : "continuous") << ": " << redrawStats.framesRendered
+        << " frames rendered, " << redrawStats.framesSkipped << " skipped, " << redrawStats.wakeups << " wakeups, "
+        << redrawStats.waitSeconds << " s of " << redrawStats.wallSeconds << " s waiting for events, "
+        << redrawStats.cpuUsage * 100.0 << "% CPU" << std::endl;
+    frameCapture.Terminate();
+    FrameCaptureStats captureStats = frameCapture.GetStats();
+    if (captureStats.requested > 0) {
+        std::cout << "Screenshots: " << captureStats.written << " written, " << captureStats.dropped << " dropped, "
+            << captureStats.bytesWritten << " bytes, " << captureStats.convertMs << " ms converting on the main thread, "
+            << captureStats.encodeMs << " ms encoding on workers" << std::endl;
+    }
+    videoRecorder.Terminate();
+    VideoRecorderStats videoStats = videoRecorder.GetStats();
+    if (videoStats.framesCaptured > 0) {
+        std::cout << "Video: " << videoStats.framesWritten << " frames written, " << videoStats.framesDropped << " dropped, "
+            << videoStats.bytesWritten << " bytes, " << videoStats.convertMs / videoStats.framesCaptured << " ms per frame converting, "
+            << videoStats.writeMs << " ms writing, " << videoStats.blockedMs << " ms blocked" << std::endl;
+    }
+    // The frames first: tasks still awaiting their GPU work finish after them
+    frameRing.Terminate();
+    gpuExecutor.Terminate();
+
+    JobSystemStats jobStats = jobSystem.GetStats();
+    std::cout << "Job system:";
+    for (size_t i = 0; i < jobStats.workers.size(); ++i) {
+        std::cout << (i == 0 ? " " : ", ") << jobStats.workers[i].jobsExecuted << " jobs (" << jobStats.workers[i].jobsStolen
+            << " stolen) " << jobStats.workers[i].utilization * 100.0 << "% busy";
+    }
+    std::cout << ", " << jobStats.jobsInjected << " from other threads" << std::endl;
+    jobSystem.Terminate();
+
+    FramePacingStats pacingStats = framePacer.GetStats();
+    std::cout << "Frame pacing: " << pacingStats.averageFrameMs << " ms average, " << pacingStats.worstFrameMs << " ms worst, "
+        << pacingStats.estimatedLatencyMs << " ms estimated latency" << std::endl;
+
+    UploadRingStats uploadStats = uploadRing.GetStats();
+    std::cout << "Uploads: " << uploadStats.totalBytes << " bytes, " << uploadStats.bandwidthMBps << " MB/s, "
+        << uploadStats.mergedCopies << " merged copies, " << uploadStats.stallMs << " ms stalled, "
+        << uploadStats.failedMaps << " failed maps" << std::endl;
+    uploadRing.Terminate();
+    bufferAllocator.Report(std::cout);
+    // Gives its ranges back to the allocator
+    culling.Terminate();
+    bufferAllocator.Terminate();
+    renderGraph.Terminate();
+    bundleRecorder.Terminate();
+    gpuProfiler.Report(std::cout);
+    gpuProfiler.Terminate();
+    pipelineManager.Terminate();
+
+    PipelineCacheStats cacheStats = pipelineCache.GetStats();
+    std::cout << "Pipeline cache: " << cacheStats.pipelineHits << " hits, " << cacheStats.pipelineMisses << " misses, "
+        << cacheStats.diskHits << " validated on a previous run, " << cacheStats.validationFailures << " invalid, "
+        << cacheStats.createMs << " ms" << std::endl;
+    pipelineCache.Terminate();
+    offscreenReadback.Terminate();
+    offscreenTexture.Reset();
+    // Everything dropped since the last frame, the GPU is idle by now
+    GpuReleaseQueue::ReleasePending();
+    GpuReleaseQueue::Report(std::cout);
+    if (surface) {
+        wgpuSurfaceUnconfigure(surface);
+        wgpuSurfaceRelease(surface);
+    }
     wgpuQueueRelease(queue);
-    wgpuSurfaceRelease(surface);
     wgpuDeviceRelease(device);
-    glfwDestroyWindow(window);
+    if (window) glfwDestroyWindow(window);
     glfwTerminate();
+
+    Logger::Terminate();
+    LoggerStats logStats = Logger::GetStats();
+    if (logStats.dropped + logStats.repeated + logStats.suppressed > 0) {
+        std::cout << "Log: " << logStats.written << " messages written, " << logStats.repeated << " repeats collapsed, "
+            << logStats.suppressed << " suppressed, " << logStats.dropped << " dropped" << std::endl;
+    }
+}
+
+void Application::HandleKey(int key, int mods)
+{
+    // On demand, every key below may change what is shown or needs a frame
+    redrawScheduler.Invalidate();
+    if (key == GLFW_KEY_P) {
+        WGPUPresentMode const modes[] = { WGPUPresentMode_Fifo, WGPUPresentMode_Mailbox, WGPUPresentMode_Immediate, WGPUPresentMode_FifoRelaxed };
+        presentModeChoice = (presentModeChoice + 1) % 4;
+        SetPresentMode(modes[presentModeChoice]);
+    }
+    else if (key == GLFW_KEY_J) {
+        framePacer.SetJustInTimeInput(!framePacer.IsJustInTimeInput());
+    }
+    else if (key == GLFW_KEY_L) {
+        frameRateCap = !frameRateCap;
+        framePacer.SetTargetFps(frameRateCap ? 60.0 : 0.0);
+    }
+    else if (key == GLFW_KEY_T) {
+        CpuProfiler::RequestDump();
+    }
+    else if (key == GLFW_KEY_C) {
+        bool jpg = (mods & GLFW_MOD_SHIFT) != 0;
+        std::string path = "screenshot-" + std::to_string(screenshotCount++) + (jpg ? ".jpg" : ".png");
+        frameCapture.RequestScreenshot(path, jpg ? CaptureFormat::Jpg : CaptureFormat::Png);
+    }
+    else if (key == GLFW_KEY_V) {
+        if (videoRecorder.IsRecording()) {
+            videoRecorder.Stop();
+        }
+        else {
+            std::string path = "capture-" + std::to_string(recordingCount++) + ".y4m";
+            if (videoRecorder.Start(path)) std::cout << "Recording to " << path << std::endl;
+        }
+    }
+}
+
+void Application::SetPresentMode(WGPUPresentMode presentMode)
+{
+    if (!surface) return;
+    surfaceConfig.presentMode = framePacer.SelectPresentMode(presentMode);
+    wgpuSurfaceConfigure(surface, &surfaceConfig);
+    framePacer.SetPresentMode(surfaceConfig.presentMode);
+    std::cout << "Present mode: " << surfaceConfig.presentMode << '\n';
 }
 
 void Application::MainLoop()
 {
-    glfwPollEvents();
+    // Just in time, this sleeps until shortly before the frame must be
+    // recorded so that the events polled below are as fresh as possible
+    {
+        CPU_ZONE("Wait for input");
+        framePacer.WaitForInput();
+    }
+    if (renderThread.IsRenderThread()) {
+        CPU_ZONE("Drain input events");
+        DrainInputEvents();
+    }
+    else if (window) {
+        // On demand, this blocks until an event, a timer or background work
+        // needs the loop
+        CPU_ZONE("Wait for events");
+        redrawScheduler.SetBusy(gpuExecutor.GetPendingTaskCount() > 0 || !frameCapture.IsIdle()
+            || pipelineManager.GetState(pipeline) == PipelineState::Pending);
+        redrawScheduler.WaitEvents();
+    }
+    framePacer.MarkInputSampled();
+    CpuProfiler::Update();
+    CPU_ZONE("MainLoop");
+    // Resume readbacks, uploads and other coroutines whose GPU work finished
+    gpuExecutor.Poll();
+    if (!surface) {
+        if (framesRendered == 0) firstFrameStart = std::chrono::steady_clock::now();
+        offscreenReadback.Poll();
+    }
+    // Converts landed screenshots and hands them to the encoder workers
+    frameCapture.Poll();
+    videoRecorder.Poll();
+
+    // A recording wants every frame, a screenshot the next one
+    if (videoRecorder.IsRecording() || frameCapture.HasPendingRequest()) redrawScheduler.Invalidate();
+    if (!redrawScheduler.ShouldRender(HashFrameInputs())) return;
+    // Nothing to present to
+    if (windowState.iconified) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return;
+    }
+
+    // Waits only if the GPU still works on the frame that last used this slot
+    FrameContext& frame = frameRing.BeginFrame();
+    // Uploads issued from here on are copied at the start of this frame's encoder
+    uploadRing.BeginFrame();
+    // Collects the pass timings of frames whose readback landed
+    gpuProfiler.BeginFrame();
 
     // Get the next target texture view
-    WGPUTextureView targetView = GetNextSurfaceTextureView();
-    if (!targetView) return;
+    frame.targetView = GetNextSurfaceTextureView();
+    if (!frame.targetView) {
+        // Nothing was presented, try again
+        redrawScheduler.Invalidate();
+        frameRing.AbandonFrame(frame);
+        return;
+    }
+    frameRing.CountAllocation(frame);
+
+    // Resets the indirect draw the culling pass counts visible instances into
+    culling.Prepare(uploadRing, cameraFrustum, 3);
+    uploadRing.Flush(frame.encoder);
 
 //DrawThings
-    //TEST MA GUEULE
-    WGPUCommandEncoderDescriptor encoderDesc = {};
-    encoderDesc.nextInChain = nullptr;
-    encoderDesc.label = "My command encoder";
-    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(device, &encoderDesc);
-    //JSP TROP MAIS RENDER PASS ICI
-    WGPURenderPassDescriptor renderPassDesc = {};
-    renderPassDesc.nextInChain = nullptr;
-
-    //DescribeRenderPass
-    WGPURenderPassColorAttachment renderPassColorAttachment = {};
-        //Decribe render pass atachment
-    renderPassColorAttachment.view = targetView;
-    renderPassColorAttachment.resolveTarget = nullptr;
-    renderPassColorAttachment.loadOp = WGPULoadOp_Clear;
-    renderPassColorAttachment.storeOp = WGPUStoreOp_Store;
-    renderPassColorAttachment.clearValue = WGPUColor{ 0.9, 0.1, 0.2, 1.0 };
-#ifndef WEBGPU_BACKEND_WGPU
-    renderPassColorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
-#endif // NOT WEBGPU_BACKEND_WGPU
-
-    renderPassDesc.colorAttachmentCount = 1;
-    renderPassDesc.colorAttachments = &renderPassColorAttachment;
-    renderPassDesc.depthStencilAttachment = nullptr;
-    renderPassDesc.timestampWrites = nullptr;
-
-    WGPURenderPassEncoder renderPass = wgpuCommandEncoderBeginRenderPass(encoder, &renderPassDesc);
-    
-    // Select which render pipeline to use
-    wgpuRenderPassEncoderSetPipeline(renderPass, pipeline);
-    // Draw 1 instance of a 3-vertices shape
-    wgpuRenderPassEncoderDraw(renderPass, 3, 1, 0, 0);
-
-    wgpuRenderPassEncoderEnd(renderPass);
+    bundleRecorder.BeginFrame();
+    renderGraph.Reset();
+
+    RenderGraphTextureDesc backbufferDesc;
+    backbufferDesc.width = options.width;
+    backbufferDesc.height = options.height;
+    backbufferDesc.format = surfaceFormat;
+    RenderGraphResource backbuffer = renderGraph.ImportTexture("Backbuffer", frame.targetView, backbufferDesc);
+
+    uint32_t cullPass = renderGraph.AddPass("Culling", RenderGraphPassType::Compute, [this](RenderGraphPassContext const& context) {
+        culling.Dispatch(context.computePass);
+        });
+    // Its output is a buffer, which the graph does not track
+    renderGraph.SetSideEffects(cullPass);
+
+    uint32_t mainPass = renderGraph.AddPass("Main pass", RenderGraphPassType::Render, [this](RenderGraphPassContext const& context) {
+        // Select which render pipeline to use, skip the draw while it compiles
+        WGPURenderPipeline trianglePipeline = pipelineManager.Resolve(pipeline);
+        if (!trianglePipeline) return;
+        // Draw the instances that survived culling, the counts come from the GPU
+        DrawItem triangle;
+        triangle.pipeline = trianglePipeline;
+        triangle.indirectBuffer = culling.GetIndirectBuffer();
+
+        // Recorded once, then again only when the fallback pipeline is replaced
+        RenderBundleFormat bundleFormat;
+        bundleFormat.colorFormat = surfaceFormat;
+        std::vector<WGPURenderBundle> const& bundles = bundleRecorder.GetStaticBundles("Triangle", &triangle, 1, bundleFormat);
+        wgpuRenderPassEncoderExecuteBundles(context.renderPass, bundles.size(), bundles.data());
+        });
+    // Between the last two simulation ticks, or the initial state without
+    // a simulation
+    SimulationState simulated = simulation.IsRunning() ? simulation.Sample() : SimulationState{};
+    WGPUColor clearColor = { simulated.clearColor[0], simulated.clearColor[1], simulated.clearColor[2], simulated.clearColor[3] };
+    renderGraph.SetColorAttachment(mainPass, backbuffer, WGPULoadOp_Clear, clearColor);
+
+    if (renderGraph.Compile()) {
+        CPU_ZONE("Execute render graph");
+        renderGraph.Execute(frame.encoder);
+    }
+    frame.allocations += renderGraph.GetStats().encoderPasses;
+    gpuProfiler.EndFrame(frame.encoder);
+    // Dropped rather than waited for if the CPU lags behind the readbacks
+    if (!surface) offscreenReadback.Capture(frame.encoder, offscreenTexture.Get(), frame.frameNumber);
+    if (!surface && !options.screenshotPath.empty() && framesRendered + 1 == options.frameCount) {
+        frameCapture.RequestScreenshot(options.screenshotPath);
+    }
+    frameCapture.Capture(frame.encoder, targetTexture, frame.frameNumber);
+    videoRecorder.Capture(frame.encoder, targetTexture, frame.frameNumber);
+
+    frameRing.Submit(frame);
+    if (renderThread.IsRenderThread()) renderThread.MarkSubmitted();
+    uploadRing.OnSubmitted();
+    gpuProfiler.OnSubmitted();
+    if (!surface) offscreenReadback.OnSubmitted();
+    frameCapture.OnSubmitted();
+    videoRecorder.OnSubmitted();
+    ++framesRendered;
+
+    // Check the first frame's culling against the CPU reference
+    if (frame.frameNumber == 0) gpuExecutor.Spawn(culling.Validate(gpuExecutor, queue));
+
+    framePacer.MarkSubmitted();
+    if (surface) {
+        CPU_ZONE("wgpuSurfacePresent");
+        wgpuSurfacePresent(surface);
+    }
+    framePacer.MarkPresented();
 
-    command = wgpuCommandEncoderFinish(encoder, &cmdBufferDescriptor);
+    wgpuTextureViewRelease(frame.targetView);
+    frame.targetView = nullptr;
 
-    wgpuQueueSubmit(queue, 1, &command);
-    wgpuCommandBufferRelease(command);
+    frameRing.EndFrame(frame);
+}
 
-    wgpuSurfacePresent(surface);
+void Application::RunWithRenderThread()
+{
+    // The frame limit is checked on the render thread, the window on this one
+    PublishWindowState();
+    renderThread.Start([this]() {
+        if (options.frameCount > 0 && framesRendered >= options.frameCount) return false;
+        MainLoop();
+        return true;
+        });
+    while (!renderThread.IsFinished() && !glfwWindowShouldClose(window)) {
+        glfwWaitEvents();
+        PublishWindowState();
+    }
+    renderThread.Stop();
+}
 
-    wgpuTextureViewRelease(targetView);
+void Application::DrainInputEvents()
+{
+    InputEvent event;
+    while (renderThread.PopEvent(event)) {
+        if (event.type == InputEventType::Key) HandleKey(event.key, event.mods);
+        else redrawScheduler.Invalidate();
+    }
+    renderThread.AcquireWindowState(windowState);
+}
 
+void Application::PublishWindowState()
+{
+    WindowState state;
+    glfwGetFramebufferSize(window, &state.framebufferWidth, &state.framebufferHeight);
+    state.iconified = glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0;
+    state.focused = glfwGetWindowAttrib(window, GLFW_FOCUSED) != 0;
+    renderThread.PublishWindowState(state);
 }
 
 bool Application::IsRunning()
 {
-    return !glfwWindowShouldClose(window);
+    if (options.frameCount > 0 && framesRendered >= options.frameCount) return false;
+    return !window || !glfwWindowShouldClose(window);
+}
+
+uint64_t Application::HashFrameInputs() const
+{
+    // The pipeline becoming ready adds the triangle, the clear color and
+    // geometry are constant
+    PipelineState pipelineState = pipelineManager.GetState(pipeline);
+    uint64_t hash = RedrawScheduler::Hash(&pipelineState, sizeof(pipelineState));
+    hash = RedrawScheduler::Hash(&cameraFrustum, sizeof(cameraFrustum), hash);
+    hash = RedrawScheduler::Hash(&surfaceConfig.presentMode, sizeof(surfaceConfig.presentMode), hash);
+    return hash;
+}
+
+void Application::CreateOffscreenTarget()
+{
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.nextInChain = nullptr;
+    textureDesc.label = "Offscreen target";
+    textureDesc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_CopySrc;
+    textureDesc.dimension = WGPUTextureDimension_2D;
+    textureDesc.size = { options.width, options.height, 1 };
+    textureDesc.format = surfaceFormat;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount = 1;
+    textureDesc.viewFormatCount = 0;
+    textureDesc.viewFormats = nullptr;
+    offscreenTexture.Reset(wgpuDeviceCreateTexture(device, &textureDesc));
+
+    offscreenReadback.Initialize(device, options.width, options.height, surfaceFormat);
+    offscreenReadback.SetCallback([this](ReadbackImage const& image) {
+        uint8_t const* center = image.pixels + (size_t)(image.height / 2) * image.bytesPerRow + (size_t)(image.width / 2) * 4;
+        std::copy(center, center + 4, lastReadbackPixel);
+        });
 }
 
-int main() {
+void Application::ReportHeadless()
+{
+    offscreenReadback.WaitIdle();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - firstFrameStart).count();
+    TextureReadbackStats readbackStats = offscreenReadback.GetStats();
+    double megapixels = (double)readbackStats.delivered * options.width * options.height * 1e-6;
+
+    std::cout << "Headless: " << framesRendered << " frames rendered, " << readbackStats.delivered << " read back ("
+        << readbackStats.dropped << " dropped) in " << seconds << " s: " << (seconds > 0.0 ? framesRendered / seconds : 0.0)
+        << " frames/s, " << (seconds > 0.0 ? megapixels / seconds : 0.0) << " MP/s read back" << '\n';
+    std::cout << "Last frame center pixel: " << (int)lastReadbackPixel[0] << ' ' << (int)lastReadbackPixel[1] << ' '
+        << (int)lastReadbackPixel[2] << ' ' << (int)lastReadbackPixel[3] << std::endl;
+}
+
+int main(int argc, char** argv) {
+    // --headless [--frames N] [--size WxH] [--screenshot file.png] [--record file.y4m] [--on-demand] [--render-thread] [--simulate HZ]
+    ApplicationOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            options.frameCount = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--simulate" && i + 1 < argc) {
+            options.simulationRate = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--render-thread") {
+            options.renderThread = true;
+        }
+        else if (arg == "--on-demand") {
+            options.onDemand = true;
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            options.recordPath = argv[++i];
+        }
+        else if (arg == "--screenshot" && i + 1 < argc) {
+            options.screenshotPath = argv[++i];
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            unsigned width = 0, height = 0;
+            if (std::sscanf(argv[++i], "%ux%u", &width, &height) == 2 && width > 0 && height > 0) {
+                options.width = width;
+                options.height = height;
+            }
+        }
+        else {
+            std::cout << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    // Without a window, nothing else would ever stop the loop
+    if (options.headless && options.frameCount == 0) options.frameCount = 300;
+
     Application app;
 
-    if (!app.Initialize()) {
+    if (!app.Initialize(options)) {
         return 1;
     }
 
     // Warning: this is still not Emscripten-friendly, see below
-    while (app.IsRunning()) {
-        app.MainLoop();
+    if (options.renderThread && !options.headless) {
+        app.RunWithRenderThread();
+    }
+    else {
+        while (app.IsRunning()) {
+            app.MainLoop();
+        }
     }
 
     app.Terminate();
@@ -0,0 +1,146 @@
+#include "../include/BuddyAllocator.h"
+
+#include <cassert>
+#include <cstddef>
+
+namespace {
+    bool IsPowerOfTwo(uint64_t value)
+    {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+
+    uint32_t Log2(uint64_t value)
+    {
+        uint32_t result = 0;
+        while (value >>= 1) ++result;
+        return result;
+    }
+}
+
+void BuddyAllocator::Initialize(uint64_t capacity, uint64_t minBlockSize)
+{
+    assert(IsPowerOfTwo(capacity) && IsPowerOfTwo(minBlockSize) && minBlockSize <= capacity);
+    this->capacity = capacity;
+    this->minBlockSize = minBlockSize;
+    maxOrder = Log2(capacity / minBlockSize);
+
+    size_t nodeCount = (size_t)2 * (size_t)(capacity / minBlockSize) - 1;
+    states.assign(nodeCount, NodeState::Unused);
+    previous.assign(nodeCount, InvalidNode);
+    next.assign(nodeCount, InvalidNode);
+    freeLists.assign(maxOrder + 1, InvalidNode);
+
+    stats = {};
+    stats.capacity = capacity;
+    PushFree(maxOrder, 0);
+}
+
+uint32_t BuddyAllocator::NodeOrder(uint32_t node) const
+{
+    // Depth in the tree is log2(node + 1)
+    return maxOrder - Log2((uint64_t)node + 1);
+}
+
+uint64_t BuddyAllocator::NodeOffset(uint32_t node) const
+{
+    uint32_t depth = Log2((uint64_t)node + 1);
+    uint64_t firstAtDepth = (1ull << depth) - 1;
+    return (node - firstAtDepth) * BlockSize(maxOrder - depth);
+}
+
+void BuddyAllocator::PushFree(uint32_t order, uint32_t node)
+{
+    states[node] = NodeState::Free;
+    previous[node] = InvalidNode;
+    next[node] = freeLists[order];
+    if (freeLists[order] != InvalidNode) previous[freeLists[order]] = node;
+    freeLists[order] = node;
+}
+
+void BuddyAllocator::RemoveFree(uint32_t order, uint32_t node)
+{
+    if (previous[node] != InvalidNode) next[previous[node]] = next[node];
+    else freeLists[order] = next[node];
+    if (next[node] != InvalidNode) previous[next[node]] = previous[node];
+    previous[node] = InvalidNode;
+    next[node] = InvalidNode;
+    states[node] = NodeState::Unused;
+}
+
+uint64_t BuddyAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+    assert(IsPowerOfTwo(alignment));
+    uint64_t needed = size > alignment ? size : alignment;
+    if (needed < minBlockSize) needed = minBlockSize;
+    if (needed > capacity) return InvalidOffset;
+
+    uint32_t order = Log2(needed);
+    if (!IsPowerOfTwo(needed)) ++order;
+    order -= Log2(minBlockSize);
+
+    // Smallest free block that fits
+    uint32_t foundOrder = order;
+    while (foundOrder <= maxOrder && freeLists[foundOrder] == InvalidNode) ++foundOrder;
+    if (foundOrder > maxOrder) return InvalidOffset;
+
+    uint32_t node = freeLists[foundOrder];
+    RemoveFree(foundOrder, node);
+
+    // Split it down, giving the right halves back to the free lists
+    while (foundOrder > order) {
+        states[node] = NodeState::Split;
+        --foundOrder;
+        PushFree(foundOrder, 2 * node + 2);
+        node = 2 * node + 1;
+    }
+
+    states[node] = NodeState::Allocated;
+    stats.allocatedBytes += BlockSize(order);
+    ++stats.allocationCount;
+    return NodeOffset(node);
+}
+
+uint64_t BuddyAllocator::Free(uint64_t offset)
+{
+    assert(offset < capacity && offset % minBlockSize == 0);
+
+    // The allocated node is the first one above the leaf at this offset that
+    // is not Unused
+    uint32_t leafCount = (uint32_t)(capacity / minBlockSize);
+    uint32_t node = leafCount - 1 + (uint32_t)(offset / minBlockSize);
+    while (states[node] == NodeState::Unused && node != 0) node = (node - 1) / 2;
+    assert(states[node] == NodeState::Allocated && NodeOffset(node) == offset);
+
+    uint32_t order = NodeOrder(node);
+    uint64_t blockSize = BlockSize(order);
+    stats.allocatedBytes -= blockSize;
+    --stats.allocationCount;
+
+    // Merge with the buddy as long as it is free as well
+    states[node] = NodeState::Unused;
+    while (node != 0) {
+        uint32_t buddy = (node & 1) ? node + 1 : node - 1;
+        if (states[buddy] != NodeState::Free) break;
+        RemoveFree(order, buddy);
+        node = (node - 1) / 2;
+        states[node] = NodeState::Unused;
+        ++order;
+    }
+    PushFree(order, node);
+    return blockSize;
+}
+
+BuddyAllocatorStats BuddyAllocator::GetStats() const
+{
+    BuddyAllocatorStats result = stats;
+    result.largestFreeBlock = 0;
+    for (uint32_t order = maxOrder + 1; order-- > 0;) {
+        if (freeLists[order] != InvalidNode) {
+            result.largestFreeBlock = BlockSize(order);
+            break;
+        }
+    }
+    uint64_t freeBytes = capacity - stats.allocatedBytes;
+    result.fragmentation = freeBytes > 0 ? 1.0 - (double)result.largestFreeBlock / (double)freeBytes : 0.0;
+    return result;
+}
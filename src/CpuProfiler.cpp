@@ -0,0 +1,152 @@
+#include "../include/CpuProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CpuProfiler::Registry {
+    std::mutex mutex;
+    // Never freed: zones of finished threads stay exportable
+    std::vector<ThreadRing*> rings;
+    std::string tracePath = "trace.json";
+    // Calibration point, the rate is measured against it at export
+    uint64_t originTicks = Now();
+    std::chrono::steady_clock::time_point originTime = std::chrono::steady_clock::now();
+};
+
+CpuProfiler::Registry& CpuProfiler::GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+namespace {
+    std::atomic<bool> dumpRequested{ false };
+    static_assert(std::atomic<bool>::is_always_lock_free, "RequestDump() must be async-signal-safe");
+
+    void WriteJsonString(std::ostream& out, char const* text)
+    {
+        out << '"';
+        for (char const* c = text; *c; ++c) {
+            if (*c == '"' || *c == '\\') out << '\\' << *c;
+            else if ((unsigned char)*c < 0x20) out << ' ';
+            else out << *c;
+        }
+        out << '"';
+    }
+}
+
+void CpuProfiler::Initialize(char const* tracePath)
+{
+    Registry& registry = GetRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.tracePath = tracePath;
+    }
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, [](int) { RequestDump(); });
+#endif // SIGUSR1
+}
+
+CpuProfiler::ThreadRing& CpuProfiler::GetThreadRing()
+{
+    if (!threadRing) {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        threadRing = new ThreadRing();
+        threadRing->threadIndex = (uint32_t)registry.rings.size() + 1;
+        threadRing->name = "Thread " + std::to_string(threadRing->threadIndex);
+        registry.rings.push_back(threadRing);
+    }
+    return *threadRing;
+}
+
+void CpuProfiler::SetThreadName(char const* name)
+{
+    ThreadRing& ring = GetThreadRing();
+    std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+    ring.name = name;
+}
+
+void CpuProfiler::RequestDump()
+{
+    dumpRequested.store(true, std::memory_order_relaxed);
+}
+
+void CpuProfiler::Update()
+{
+    if (!dumpRequested.exchange(false, std::memory_order_relaxed)) return;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+        path = GetRegistry().tracePath;
+    }
+    if (WriteTrace(path.c_str())) std::cout << "CPU trace written to " << path << std::endl;
+    else std::cout << "Could not write CPU trace to " << path << std::endl;
+}
+
+bool CpuProfiler::WriteTrace(char const* path)
+{
+    Registry& registry = GetRegistry();
+    std::vector<ThreadRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        rings = registry.rings;
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    // Ticks per microsecond, measured over the whole run so far
+    uint64_t nowTicks = Now();
+    double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - registry.originTime).count();
+    double ticksPerUs = elapsedUs > 0.0 ? (double)(nowTicks - registry.originTicks) / elapsedUs : 1.0;
+    if (ticksPerUs <= 0.0) ticksPerUs = 1.0;
+    auto toUs = [&](uint64_t ticks) {
+        return (double)(int64_t)(ticks - registry.originTicks) / ticksPerUs;
+        };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool firstEvent = true;
+    std::vector<Zone> zones;
+    for (ThreadRing* ring : rings) {
+        {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            out << (firstEvent ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadIndex
+                << ",\"args\":{\"name\":";
+            WriteJsonString(out, ring->name.c_str());
+            out << "}}";
+            firstEvent = false;
+        }
+
+        // Copy, then keep only the zones the thread did not overwrite meanwhile
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > RingSize ? head - RingSize : 0;
+        zones.clear();
+        for (uint64_t i = first; i < head; ++i) {
+            zones.push_back(ring->zones[i & (RingSize - 1)]);
+        }
+        // The thread may be writing record headAfter already, in the slot of
+        // headAfter - RingSize, before it publishes it
+        uint64_t headAfter = ring->head.load(std::memory_order_acquire);
+        uint64_t firstValid = headAfter + 1 > RingSize ? headAfter + 1 - RingSize : 0;
+        size_t skip = firstValid > first ? (size_t)std::min<uint64_t>(firstValid - first, zones.size()) : 0;
+
+        for (size_t i = skip; i < zones.size(); ++i) {
+            Zone const& zone = zones[i];
+            out << ",\n{\"name\":";
+            WriteJsonString(out, zone.name);
+            out << ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->threadIndex << ",\"ts\":" << toUs(zone.begin)
+                << ",\"dur\":" << (double)(zone.end - zone.begin) / ticksPerUs << '}';
+        }
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
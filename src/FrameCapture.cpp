@@ -0,0 +1,213 @@
+#include "../include/FrameCapture.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define FRAME_CAPTURE_SSE2 1
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
+#define STBI_WRITE_NO_STDIO
+#include "../glfw/deps/stb_image_write.h"
+
+namespace {
+    bool IsBgra(WGPUTextureFormat format)
+    {
+        return format == WGPUTextureFormat_BGRA8Unorm || format == WGPUTextureFormat_BGRA8UnormSrgb;
+    }
+
+    // Swap bytes 0 and 2 of every pixel
+    void SwizzleRow(uint8_t const* src, uint8_t* dst, uint32_t width)
+    {
+        uint32_t x = 0;
+#ifdef FRAME_CAPTURE_SSE2
+        __m128i const maskGa = _mm_set1_epi32((int)0xFF00FF00);
+        __m128i const maskRb = _mm_set1_epi32(0x00FF00FF);
+        for (; x + 4 <= width; x += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + x * 4));
+            __m128i ga = _mm_and_si128(pixels, maskGa);
+            __m128i rb = _mm_and_si128(pixels, maskRb);
+            // Within each 32-bit pixel, B moves up to byte 2 and R down to byte 0
+            rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(ga, rb));
+        }
+#endif // FRAME_CAPTURE_SSE2
+        for (; x < width; ++x) {
+            dst[x * 4 + 0] = src[x * 4 + 2];
+            dst[x * 4 + 1] = src[x * 4 + 1];
+            dst[x * 4 + 2] = src[x * 4 + 0];
+            dst[x * 4 + 3] = src[x * 4 + 3];
+        }
+    }
+
+    void AppendToVector(void* context, void* data, int size)
+    {
+        std::vector<uint8_t>& out = *reinterpret_cast<std::vector<uint8_t>*>(context);
+        uint8_t const* bytes = static_cast<uint8_t const*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    // One job per strip, the calling worker helps until they are done
+    void ParallelFor(void* parallelContext, int count, void (*job)(void* jobContext, int index), void* jobContext)
+    {
+        JobSystem& jobSystem = *static_cast<JobSystem*>(parallelContext);
+        jobSystem.ParallelFor(0, (size_t)count, 1, [job, jobContext](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) job(jobContext, (int)i);
+            });
+    }
+}
+
+bool FrameCapture::Initialize(WGPUDevice device, uint32_t width, uint32_t height, WGPUTextureFormat format, JobSystem& jobSystem)
+{
+    this->jobSystem = &jobSystem;
+    if (!readback.Initialize(device, width, height, format)) return false;
+    readback.SetCallback([this](ReadbackImage const& image) { OnReadback(image); });
+    // Not run before Terminate(): it stays unfinished while children come and go
+    encodeJobs = jobSystem.Create(nullptr);
+    return true;
+}
+
+void FrameCapture::Terminate()
+{
+    // Deliver what the GPU already copied, then help encode what is left
+    readback.WaitIdle();
+    readback.Terminate();
+    if (encodeJobs) {
+        jobSystem->Run(encodeJobs);
+        jobSystem->Wait(encodeJobs);
+        encodeJobs = nullptr;
+    }
+    requests.clear();
+    capturing.clear();
+}
+
+void FrameCapture::RequestScreenshot(std::string path, CaptureFormat format, int jpgQuality)
+{
+    Request request;
+    request.path = std::move(path);
+    request.format = format;
+    request.jpgQuality = jpgQuality;
+    requests.push_back(std::move(request));
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stats.requested;
+}
+
+void FrameCapture::Capture(WGPUCommandEncoder encoder, WGPUTexture texture, uint64_t frameNumber)
+{
+    if (requests.empty()) return;
+    // Every readback buffer busy: try again next frame
+    if (!readback.Capture(encoder, texture, frameNumber)) return;
+    capturing.push_back(std::move(requests.front()));
+    requests.pop_front();
+}
+
+void FrameCapture::OnSubmitted()
+{
+    readback.OnSubmitted();
+}
+
+void FrameCapture::Poll()
+{
+    readback.Poll();
+}
+
+void FrameCapture::ConvertToRgba(ReadbackImage const& image, uint8_t* rgba)
+{
+    size_t rowSize = (size_t)image.width * 4;
+    bool bgra = IsBgra(image.format);
+    for (uint32_t y = 0; y < image.height; ++y) {
+        uint8_t const* src = image.pixels + (size_t)y * image.bytesPerRow;
+        uint8_t* dst = rgba + y * rowSize;
+        if (bgra) SwizzleRow(src, dst, image.width);
+        else std::memcpy(dst, src, rowSize);
+    }
+}
+
+void FrameCapture::OnReadback(ReadbackImage const& image)
+{
+    if (capturing.empty()) return;
+    Image pending;
+    pending.request = std::move(capturing.front());
+    capturing.pop_front();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queuedImages >= MaxQueuedImages) {
+            ++stats.dropped;
+            return;
+        }
+    }
+
+    // The buffer is unmapped right after: this copy is needed anyway, so it
+    // also does the swizzle and drops the row padding
+    auto convertStart = std::chrono::steady_clock::now();
+    pending.width = image.width;
+    pending.height = image.height;
+    pending.rgba.resize((size_t)image.width * image.height * 4);
+    ConvertToRgba(image, pending.rgba.data());
+    double convertMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - convertStart).count();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.convertMs += convertMs;
+        images.push_back(std::move(pending));
+        ++queuedImages;
+    }
+    // One job per image; whichever runs first takes the oldest one
+    jobSystem->Spawn([this]() { EncodeNext(); }, encodeJobs);
+}
+
+bool FrameCapture::Encode(Image const& image, std::vector<uint8_t>& encoded) const
+{
+    int width = (int)image.width;
+    int height = (int)image.height;
+    // A single screenshot is usually in flight: encode it on every core
+    int strips = (int)jobSystem->GetThreadCount();
+    if (image.request.format == CaptureFormat::Jpg) {
+        return stbi_write_jpg_to_func_parallel(AppendToVector, &encoded, width, height, 4, image.rgba.data(), image.request.jpgQuality,
+            strips, ParallelFor, jobSystem) != 0;
+    }
+    return stbi_write_png_to_func_parallel(AppendToVector, &encoded, width, height, 4, image.rgba.data(), width * 4,
+        strips, ParallelFor, jobSystem) != 0;
+}
+
+void FrameCapture::EncodeNext()
+{
+    Image image;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        image = std::move(images.front());
+        images.pop_front();
+    }
+
+    auto encodeStart = std::chrono::steady_clock::now();
+    std::vector<uint8_t> encoded;
+    bool ok = Encode(image, encoded);
+    if (ok) {
+        std::ofstream file(image.request.path, std::ios::binary);
+        file.write(reinterpret_cast<char const*>(encoded.data()), (std::streamsize)encoded.size());
+        ok = (bool)file;
+    }
+    double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encodeStart).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.encodeMs += encodeMs;
+    --queuedImages;
+    if (ok) {
+        ++stats.written;
+        stats.bytesWritten += encoded.size();
+    }
+    else {
+        ++stats.dropped;
+    }
+}
+
+FrameCaptureStats FrameCapture::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,152 @@
+#include "../include/FramePacer.h"
+
+#include <algorithm>
+#include <thread>
+
+void FramePacer::Initialize(double targetFps, bool justInTimeInput)
+{
+    SetTargetFps(targetFps);
+    SetJustInTimeInput(justInTimeInput);
+    frameStart = Clock::now();
+    hasPresented = false;
+    stats = {};
+}
+
+void FramePacer::SetSupportedPresentModes(WGPUPresentMode const* modes, size_t count)
+{
+    supportedModes.assign(modes, modes + count);
+}
+
+WGPUPresentMode FramePacer::SelectPresentMode(WGPUPresentMode preferred) const
+{
+    auto supported = [this](WGPUPresentMode mode) {
+        return std::find(supportedModes.begin(), supportedModes.end(), mode) != supportedModes.end();
+        };
+
+    // Low latency modes fall back on each other before giving up on tearing
+    // or vsync, vsync modes only fall back to Fifo
+    WGPUPresentMode fallbacks[3] = { preferred, WGPUPresentMode_Fifo, WGPUPresentMode_Fifo };
+    if (preferred == WGPUPresentMode_Immediate) fallbacks[1] = WGPUPresentMode_Mailbox;
+    if (preferred == WGPUPresentMode_Mailbox) fallbacks[1] = WGPUPresentMode_Immediate;
+
+    for (WGPUPresentMode mode : fallbacks) {
+        if (supported(mode)) return mode;
+    }
+    return WGPUPresentMode_Fifo;
+}
+
+void FramePacer::SetTargetFps(double targetFps)
+{
+    period = targetFps > 0.0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps))
+        : Clock::duration::zero();
+}
+
+void FramePacer::SetJustInTimeInput(bool enabled, double marginMs)
+{
+    justInTimeInput = enabled;
+    margin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(marginMs));
+}
+
+void FramePacer::WaitForInput()
+{
+    Clock::time_point now = Clock::now();
+    Clock::time_point wakeUp = now;
+
+    if (justInTimeInput && hasPresented) {
+        // Next present: on the schedule of the cap if there is one, otherwise
+        // at the pace the presentation engine imposed so far (vsync with Fifo)
+        Clock::duration work = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(predictedWorkMs));
+        if (period > Clock::duration::zero()) {
+            presentTarget = hasPresentTarget ? presentTarget + period : lastPresent + period;
+            if (presentTarget < now + work) presentTarget = now + work;
+            hasPresentTarget = true;
+        }
+        else {
+            presentTarget = lastPresent + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(predictedFrameMs));
+            hasPresentTarget = false;
+        }
+        wakeUp = presentTarget - work - margin;
+    }
+    else if (period > Clock::duration::zero()) {
+        hasPresentTarget = false;
+        wakeUp = frameStart + period;
+        // Too late by more than a frame: restart the cadence from now
+        if (wakeUp + period < now) wakeUp = now;
+    }
+
+    if (wakeUp > now) PreciseSleepUntil(wakeUp);
+
+    Clock::time_point start = Clock::now();
+    stats.waitMs = ToMs(start - now);
+    frameStart = wakeUp > now ? wakeUp : start;
+}
+
+void FramePacer::MarkInputSampled()
+{
+    inputSampled = Clock::now();
+}
+
+void FramePacer::MarkSubmitted()
+{
+    submitted = Clock::now();
+    stats.workMs = ToMs(submitted - inputSampled);
+    // Track the slow frames quickly, forget them slowly
+    double alpha = stats.workMs > predictedWorkMs ? 0.5 : 0.1;
+    predictedWorkMs += alpha * (stats.workMs - predictedWorkMs);
+}
+
+void FramePacer::MarkPresented()
+{
+    Clock::time_point now = Clock::now();
+    if (hasPresented) {
+        stats.frameMs = ToMs(now - lastPresent);
+        predictedFrameMs = predictedFrameMs > 0.0 ? predictedFrameMs + 0.1 * (stats.frameMs - predictedFrameMs) : stats.frameMs;
+
+        history[historyNext] = stats.frameMs;
+        historyNext = (historyNext + 1) % HistorySize;
+        historyCount = std::min(historyCount + 1, HistorySize);
+
+        double total = 0.0;
+        stats.worstFrameMs = 0.0;
+        for (size_t i = 0; i < historyCount; ++i) {
+            total += history[i];
+            stats.worstFrameMs = std::max(stats.worstFrameMs, history[i]);
+        }
+        stats.averageFrameMs = total / (double)historyCount;
+    }
+    lastPresent = now;
+    hasPresented = true;
+    ++stats.frames;
+
+    // A queued image waits for the next vblank with Fifo, about half a frame
+    // on average with Mailbox, and not at all with Immediate
+    double queuedFrames = 0.0;
+    switch (stats.presentMode) {
+    case WGPUPresentMode_Fifo:
+    case WGPUPresentMode_FifoRelaxed:
+        queuedFrames = 1.0;
+        break;
+    case WGPUPresentMode_Mailbox:
+        queuedFrames = 0.5;
+        break;
+    default:
+        break;
+    }
+    stats.inputToPresentMs = ToMs(now - inputSampled);
+    stats.estimatedLatencyMs = stats.inputToPresentMs + queuedFrames * stats.averageFrameMs;
+}
+
+void FramePacer::PreciseSleepUntil(Clock::time_point deadline)
+{
+    // Sleep 1 ms at a time while the worst observed sleep still fits
+    while (ToMs(deadline - Clock::now()) > sleepOvershootMs) {
+        Clock::time_point before = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double sleptMs = ToMs(Clock::now() - before);
+        sleepOvershootMs = std::max(sleptMs, sleepOvershootMs * 0.99);
+    }
+    while (Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,174 @@
+#include "../include/FrameRing.h"
+#include "../include/GpuHandle.h"
+#include "../include/Logger.h"
+
+#include <webgpu/webgpu.h>
+#ifdef WEBGPU_BACKEND_WGPU
+#  include <webgpu/wgpu.h>
+#endif // WEBGPU_BACKEND_WGPU
+
+#include <cassert>
+#include <thread>
+
+namespace {
+    // After the blocking poll, how long another thread polling the device
+    // may take to finish running the callback
+    constexpr uint32_t MaxFenceYields = 1000;
+
+    double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool FrameRing::Initialize(WGPUDevice device, WGPUQueue queue, uint32_t framesInFlight)
+{
+    assert(framesInFlight > 0 && framesInFlight <= MaxFramesInFlight);
+    this->device = device;
+    this->queue = queue;
+    this->framesInFlight = framesInFlight;
+
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        FrameContext& frame = frames[i];
+        frame.index = i;
+
+        frame.encoderDesc.nextInChain = nullptr;
+        frame.encoderDesc.label = "Frame command encoder";
+
+        frame.cmdBufferDescriptor.nextInChain = nullptr;
+        frame.cmdBufferDescriptor.label = "Frame command buffer";
+
+        // Reserve once so that tracking transients never allocates in the loop
+        frame.transients.reserve(16);
+    }
+    return true;
+}
+
+void FrameRing::Terminate()
+{
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        WaitForFence(frames[i]);
+        ReleaseTransients(frames[i]);
+    }
+    // Nothing is in flight anymore
+    GpuReleaseQueue::ReleasePending();
+    framesInFlight = 0;
+}
+
+FrameContext& FrameRing::BeginFrame()
+{
+    ReleaseCompleted();
+    FrameContext& frame = frames[current];
+    current = (current + 1) % framesInFlight;
+
+    // Only blocks when the CPU is a full ring ahead of the GPU
+    auto waitStart = std::chrono::steady_clock::now();
+    WaitForFence(frame);
+    stats.fenceWaitMs = MillisecondsSince(waitStart);
+    ReleaseTransients(frame);
+
+    frame.frameNumber = frameNumber++;
+    frame.allocations = 0;
+    frame.beginTime = std::chrono::steady_clock::now();
+
+    frame.encoder = wgpuDeviceCreateCommandEncoder(device, &frame.encoderDesc);
+    CountAllocation(frame);
+
+    return frame;
+}
+
+void FrameRing::Submit(FrameContext& frame)
+{
+    WGPUCommandBuffer command = wgpuCommandEncoderFinish(frame.encoder, &frame.cmdBufferDescriptor);
+    CountAllocation(frame);
+    wgpuCommandEncoderRelease(frame.encoder);
+    frame.encoder = nullptr;
+
+#ifdef WEBGPU_BACKEND_WGPU
+    frame.submissionIndex = wgpuQueueSubmitForIndex(queue, 1, &command);
+#else
+    wgpuQueueSubmit(queue, 1, &command);
+#endif // WEBGPU_BACKEND_WGPU
+    wgpuCommandBufferRelease(command);
+    GpuReleaseQueue::TakePending(frame.transients);
+
+    // The callback fires once everything submitted so far, this frame
+    // included, has been executed by the GPU
+    auto onFrameWorkDone = [](WGPUQueueWorkDoneStatus /* status */, void* pUserData) {
+        FrameContext& frame = *reinterpret_cast<FrameContext*>(pUserData);
+        frame.fenceSignaled = true;
+        };
+    frame.inFlight = true;
+    frame.fenceSignaled = false;
+    wgpuQueueOnSubmittedWorkDone(queue, onFrameWorkDone, (void*)&frame);
+}
+
+void FrameRing::EndFrame(FrameContext& frame)
+{
+    stats.cpuFrameMs = MillisecondsSince(frame.beginTime);
+    stats.allocations = frame.allocations;
+    if (frame.inFlight) ++stats.framesSubmitted;
+}
+
+void FrameRing::AbandonFrame(FrameContext& frame)
+{
+    assert(!frame.inFlight);
+    wgpuCommandEncoderRelease(frame.encoder);
+    frame.encoder = nullptr;
+    EndFrame(frame);
+}
+
+void FrameRing::Track(FrameContext& frame, void* handle, void (*release)(void*))
+{
+    frame.transients.push_back(FrameTransient{ handle, release });
+}
+
+void FrameRing::WaitForFence(FrameContext& frame)
+{
+    if (!frame.inFlight) return;
+
+#if defined(WEBGPU_BACKEND_DAWN)
+    while (!frame.fenceSignaled) {
+        wgpuDeviceTick(device);
+    }
+#elif defined(WEBGPU_BACKEND_WGPU)
+    // Fire any pending callback first, then block on this slot's submission,
+    // which runs the callbacks of everything it waited for
+    wgpuDevicePoll(device, false, nullptr);
+    if (!frame.fenceSignaled) {
+        WGPUWrappedSubmissionIndex wrappedIndex = {};
+        wrappedIndex.queue = queue;
+        wrappedIndex.submissionIndex = frame.submissionIndex;
+        wgpuDevicePoll(device, true, &wrappedIndex);
+    }
+    for (uint32_t i = 0; i < MaxFenceYields && !frame.fenceSignaled; ++i) {
+        std::this_thread::yield();
+    }
+    if (!frame.fenceSignaled) {
+        // Device lost: nothing will run on the GPU anymore
+        Logger::Warning("Frame fence did not fire", "slot", frame.index, "submission", frame.submissionIndex);
+    }
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+    while (!frame.fenceSignaled) {
+        emscripten_sleep(1);
+    }
+#endif
+    frame.inFlight = false;
+}
+
+void FrameRing::ReleaseCompleted()
+{
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        FrameContext& frame = frames[i];
+        if (!frame.inFlight || !frame.fenceSignaled) continue;
+        frame.inFlight = false;
+        ReleaseTransients(frame);
+    }
+}
+
+void FrameRing::ReleaseTransients(FrameContext& frame)
+{
+    for (FrameTransient const& transient : frame.transients) {
+        transient.release(transient.handle);
+    }
+    frame.transients.clear();
+}
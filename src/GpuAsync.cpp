@@ -0,0 +1,167 @@
+#include "../include/GpuAsync.h"
+
+#include <webgpu/webgpu.h>
+#ifdef WEBGPU_BACKEND_WGPU
+#  include <webgpu/wgpu.h>
+#endif // WEBGPU_BACKEND_WGPU
+
+#include "../include/Logger.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+    // Consecutive polls resuming nothing before Terminate() gives up on the
+    // tasks still pending
+    constexpr uint32_t MaxIdlePolls = 1000;
+}
+
+void GpuExecutor::Initialize(WGPUInstance instance, WGPUDevice device)
+{
+    this->instance = instance;
+    this->device = device;
+}
+
+void GpuExecutor::Terminate()
+{
+    // A suspended task's awaiter is the userdata of a pending callback:
+    // destroying its frame now would let the callback write into freed
+    // memory, and skip the cleanup after its co_await
+    uint32_t idlePolls = 0;
+    while (!detached.empty() && idlePolls < MaxIdlePolls) {
+#ifdef WEBGPU_BACKEND_WGPU
+        // Wait for the submitted work instead of spinning on it
+        if (device) wgpuDevicePoll(device, true, nullptr);
+#endif // WEBGPU_BACKEND_WGPU
+        if (Poll()) idlePolls = 0;
+        else {
+            ++idlePolls;
+            std::this_thread::yield();
+        }
+    }
+
+    if (!detached.empty()) {
+        Logger::Warning("GPU tasks still pending at shutdown", "count", (uint64_t)detached.size());
+        for (GpuTask<void>& task : detached) {
+            task.Abandon();
+        }
+    }
+    detached.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.clear();
+}
+
+bool GpuExecutor::Poll()
+{
+#if defined(WEBGPU_BACKEND_DAWN)
+    if (device) wgpuDeviceTick(device);
+    else if (instance) wgpuInstanceProcessEvents(instance);
+#elif defined(WEBGPU_BACKEND_WGPU)
+    // wgpu-native runs adapter and device callbacks synchronously, only
+    // device work needs polling
+    if (device) wgpuDevicePoll(device, false, nullptr);
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+    emscripten_sleep(0);
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        resuming.swap(ready);
+    }
+    bool resumed = !resuming.empty();
+    for (std::coroutine_handle<> handle : resuming) {
+        handle.resume();
+    }
+    resuming.clear();
+
+    detached.erase(std::remove_if(detached.begin(), detached.end(), [](GpuTask<void> const& task) {
+        return task.IsDone();
+        }), detached.end());
+
+    return resumed;
+}
+
+void GpuExecutor::Schedule(std::coroutine_handle<> handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.push_back(handle);
+}
+
+void GpuExecutor::Spawn(GpuTask<void> task)
+{
+    if (!task.IsDone()) detached.push_back(std::move(task));
+}
+
+bool GpuAwaiterBase::Suspend(std::coroutine_handle<> awaiting)
+{
+    handle = awaiting;
+    // The callback already ran: keep going without suspending
+    return !rendezvous.exchange(true);
+}
+
+void GpuAwaiterBase::Complete()
+{
+    // await_suspend already returned: the coroutine is parked, wake it up
+    if (rendezvous.exchange(true)) executor.Schedule(handle);
+}
+
+bool GpuRequestAdapter::await_suspend(std::coroutine_handle<> awaiting)
+{
+    auto onAdapterRequestEnded = [](WGPURequestAdapterStatus status, WGPUAdapter adapter, char const* message, void* pUserData) {
+        GpuRequestAdapter& self = *reinterpret_cast<GpuRequestAdapter*>(pUserData);
+        self.result.ok = status == WGPURequestAdapterStatus_Success;
+        self.result.value = self.result.ok ? adapter : nullptr;
+        if (message) self.result.message = message;
+        self.Complete();
+        };
+    wgpuInstanceRequestAdapter(instance, options, onAdapterRequestEnded, (void*)this);
+    return Suspend(awaiting);
+}
+
+bool GpuRequestDevice::await_suspend(std::coroutine_handle<> awaiting)
+{
+    auto onDeviceRequestEnded = [](WGPURequestDeviceStatus status, WGPUDevice device, char const* message, void* pUserData) {
+        GpuRequestDevice& self = *reinterpret_cast<GpuRequestDevice*>(pUserData);
+        self.result.ok = status == WGPURequestDeviceStatus_Success;
+        self.result.value = self.result.ok ? device : nullptr;
+        if (message) self.result.message = message;
+        self.Complete();
+        };
+    wgpuAdapterRequestDevice(adapter, descriptor, onDeviceRequestEnded, (void*)this);
+    return Suspend(awaiting);
+}
+
+bool GpuMapBuffer::await_suspend(std::coroutine_handle<> awaiting)
+{
+    auto onBufferMapped = [](WGPUBufferMapAsyncStatus status, void* pUserData) {
+        GpuMapBuffer& self = *reinterpret_cast<GpuMapBuffer*>(pUserData);
+        self.status = status;
+        self.Complete();
+        };
+    wgpuBufferMapAsync(buffer, mode, offset, size, onBufferMapped, (void*)this);
+    return Suspend(awaiting);
+}
+
+bool GpuQueueWorkDone::await_suspend(std::coroutine_handle<> awaiting)
+{
+    auto onQueueWorkDone = [](WGPUQueueWorkDoneStatus status, void* pUserData) {
+        GpuQueueWorkDone& self = *reinterpret_cast<GpuQueueWorkDone*>(pUserData);
+        self.status = status;
+        self.Complete();
+        };
+    wgpuQueueOnSubmittedWorkDone(queue, onQueueWorkDone, (void*)this);
+    return Suspend(awaiting);
+}
+
+bool GpuPopErrorScope::await_suspend(std::coroutine_handle<> awaiting)
+{
+    auto onErrorScopePopped = [](WGPUErrorType type, char const* message, void* pUserData) {
+        GpuPopErrorScope& self = *reinterpret_cast<GpuPopErrorScope*>(pUserData);
+        self.result.value = type;
+        self.result.ok = type == WGPUErrorType_NoError;
+        if (message) self.result.message = message;
+        self.Complete();
+        };
+    wgpuDevicePopErrorScope(device, onErrorScopePopped, (void*)this);
+    return Suspend(awaiting);
+}
@@ -0,0 +1,172 @@
+#include "../include/GpuBufferAllocator.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    uint64_t NextPowerOfTwo(uint64_t value)
+    {
+        uint64_t result = 1;
+        while (result < value) result <<= 1;
+        return result;
+    }
+}
+
+bool GpuBufferAllocator::Initialize(WGPUDevice device, uint64_t blockSize)
+{
+    this->device = device;
+    this->blockSize = NextPowerOfTwo(blockSize);
+
+    // Uniform and storage bindings must start on the device offset alignment
+    WGPUSupportedLimits supportedLimits = {};
+    supportedLimits.nextInChain = nullptr;
+    uint64_t uniformAlignment = 256;
+    uint64_t storageAlignment = 256;
+    if (wgpuDeviceGetLimits(device, &supportedLimits)) {
+        uniformAlignment = supportedLimits.limits.minUniformBufferOffsetAlignment;
+        storageAlignment = supportedLimits.limits.minStorageBufferOffsetAlignment;
+    }
+
+    Pool& vertex = pools[(size_t)BufferUsageClass::Vertex];
+    vertex.name = "Vertex";
+    vertex.usage = WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst;
+    vertex.alignment = 4;
+
+    Pool& index = pools[(size_t)BufferUsageClass::Index];
+    index.name = "Index";
+    index.usage = WGPUBufferUsage_Index | WGPUBufferUsage_CopyDst;
+    index.alignment = 4;
+
+    Pool& uniform = pools[(size_t)BufferUsageClass::Uniform];
+    uniform.name = "Uniform";
+    uniform.usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst;
+    uniform.alignment = uniformAlignment;
+
+    Pool& storage = pools[(size_t)BufferUsageClass::Storage];
+    storage.name = "Storage";
+    storage.usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc;
+    storage.alignment = storageAlignment;
+
+    return true;
+}
+
+void GpuBufferAllocator::Terminate()
+{
+    for (Pool& pool : pools) {
+        for (auto& block : pool.blocks) {
+            if (block) wgpuBufferRelease(block->buffer);
+        }
+        pool.blocks.clear();
+    }
+}
+
+GpuBufferAllocator::Block* GpuBufferAllocator::CreateBlock(Pool& pool, uint64_t capacity, uint32_t& index)
+{
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.nextInChain = nullptr;
+    bufferDesc.label = pool.name;
+    bufferDesc.usage = pool.usage;
+    bufferDesc.size = capacity;
+    bufferDesc.mappedAtCreation = false;
+    WGPUBuffer buffer = wgpuDeviceCreateBuffer(device, &bufferDesc);
+    if (!buffer) return nullptr;
+
+    std::unique_ptr<Block> block(new Block());
+    block->buffer = buffer;
+    // Smaller blocks would only grow the allocator's bookkeeping
+    block->allocator.Initialize(capacity, pool.alignment > MinBlockSize ? pool.alignment : MinBlockSize);
+
+    // Reuse the slot of a released block if there is one
+    for (index = 0; index < pool.blocks.size(); ++index) {
+        if (!pool.blocks[index]) break;
+    }
+    if (index == pool.blocks.size()) pool.blocks.emplace_back();
+    pool.blocks[index] = std::move(block);
+    return pool.blocks[index].get();
+}
+
+BufferAllocation GpuBufferAllocator::Allocate(BufferUsageClass usageClass, uint64_t size)
+{
+    BufferAllocation allocation;
+    Pool& pool = pools[(size_t)usageClass];
+    // Copies work on multiples of 4 bytes
+    uint64_t alignedSize = (size + 3) & ~3ull;
+
+    Block* block = nullptr;
+    uint32_t index = 0;
+    uint64_t offset = BuddyAllocator::InvalidOffset;
+    for (index = 0; index < pool.blocks.size(); ++index) {
+        if (!pool.blocks[index]) continue;
+        offset = pool.blocks[index]->allocator.Allocate(alignedSize, pool.alignment);
+        if (offset != BuddyAllocator::InvalidOffset) {
+            block = pool.blocks[index].get();
+            break;
+        }
+    }
+
+    if (!block) {
+        uint64_t capacity = alignedSize > blockSize ? NextPowerOfTwo(alignedSize) : blockSize;
+        block = CreateBlock(pool, capacity, index);
+        if (!block) return allocation;
+        offset = block->allocator.Allocate(alignedSize, pool.alignment);
+    }
+
+    block->requestedBytes += size;
+    allocation.buffer = block->buffer;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.usageClass = usageClass;
+    allocation.block = index;
+    return allocation;
+}
+
+void GpuBufferAllocator::Free(BufferAllocation& allocation)
+{
+    if (!allocation.IsValid()) return;
+    Pool& pool = pools[(size_t)allocation.usageClass];
+    std::unique_ptr<Block>& block = pool.blocks[allocation.block];
+    block->allocator.Free(allocation.offset);
+    block->requestedBytes -= allocation.size;
+
+    // Give empty blocks back, except the first one of each pool
+    if (block->allocator.IsEmpty() && allocation.block != 0) {
+        wgpuBufferRelease(block->buffer);
+        block.reset();
+    }
+    allocation = BufferAllocation();
+}
+
+void GpuBufferAllocator::Report(std::ostream& out) const
+{
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+    report << "Buffer allocator:\n";
+    for (Pool const& pool : pools) {
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        uint64_t capacity = 0;
+        uint64_t allocated = 0;
+        uint64_t requested = 0;
+        uint64_t largestFree = 0;
+        double fragmentation = 0.0;
+        for (auto const& block : pool.blocks) {
+            if (!block) continue;
+            BuddyAllocatorStats stats = block->allocator.GetStats();
+            ++blockCount;
+            allocationCount += stats.allocationCount;
+            capacity += stats.capacity;
+            allocated += stats.allocatedBytes;
+            requested += block->requestedBytes;
+            if (stats.largestFreeBlock > largestFree) largestFree = stats.largestFreeBlock;
+            // Worst block is what limits the next large allocation
+            if (stats.fragmentation > fragmentation) fragmentation = stats.fragmentation;
+        }
+        if (blockCount == 0) continue;
+
+        report << "  " << std::setw(8) << pool.name << ": " << allocationCount << " allocations in " << blockCount << " blocks, "
+            << (capacity ? 100.0 * (double)allocated / (double)capacity : 0.0) << "% occupied, "
+            << (allocated ? 100.0 * (double)(allocated - requested) / (double)allocated : 0.0) << "% rounding waste, "
+            << "largest free " << largestFree << " bytes, fragmentation " << 100.0 * fragmentation << "%\n";
+    }
+    out << report.str() << std::flush;
+}
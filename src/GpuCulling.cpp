@@ -0,0 +1,296 @@
+#include "../include/GpuCulling.h"
+#include "../include/Logger.h"
+#include "../include/PipelineCache.h"
+#include "../include/UploadRing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define CULLING_USE_SSE
+#  include <emmintrin.h>
+#endif
+
+namespace {
+    const char* cullingShaderSource = R"(
+struct Frustum {
+    planes: array<vec4f, 6>,
+    instanceCount: u32,
+}
+
+struct DrawArgs {
+    vertexCount: u32,
+    instanceCount: atomic<u32>,
+    firstVertex: u32,
+    firstInstance: u32,
+}
+
+@group(0) @binding(0) var<uniform> frustum: Frustum;
+@group(0) @binding(1) var<storage, read> bounds: array<vec4f>;
+@group(0) @binding(2) var<storage, read_write> visible: array<u32>;
+@group(0) @binding(3) var<storage, read_write> args: DrawArgs;
+
+@compute @workgroup_size(64)
+fn cs_main(@builtin(global_invocation_id) id: vec3u) {
+    let index = id.x;
+    if (index >= frustum.instanceCount) {
+        return;
+    }
+    let sphere = bounds[index];
+    for (var i = 0u; i < 6u; i++) {
+        let plane = frustum.planes[i];
+        if (dot(plane.xyz, sphere.xyz) + plane.w < -sphere.w) {
+            return;
+        }
+    }
+    let slot = atomicAdd(&args.instanceCount, 1u);
+    visible[slot] = index;
+}
+)";
+
+    // Matches the WGSL Frustum struct, padded to 16 bytes
+    struct FrustumUniform {
+        float planes[6][4];
+        uint32_t instanceCount;
+        uint32_t padding[3];
+    };
+
+    struct DrawIndirectArgs {
+        uint32_t vertexCount;
+        uint32_t instanceCount;
+        uint32_t firstVertex;
+        uint32_t firstInstance;
+    };
+}
+
+Frustum Frustum::FromViewProjection(float const* matrix)
+{
+    // Row i of a column-major matrix
+    auto row = [matrix](int i, int j) { return matrix[j * 4 + i]; };
+
+    Frustum frustum;
+    for (int j = 0; j < 4; ++j) {
+        frustum.planes[0][j] = row(3, j) + row(0, j); // left
+        frustum.planes[1][j] = row(3, j) - row(0, j); // right
+        frustum.planes[2][j] = row(3, j) + row(1, j); // bottom
+        frustum.planes[3][j] = row(3, j) - row(1, j); // top
+        frustum.planes[4][j] = row(2, j);             // near, z >= 0
+        frustum.planes[5][j] = row(3, j) - row(2, j); // far
+    }
+
+    // Normalize so that plane distances compare with radii
+    for (float* plane : frustum.planes) {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (int j = 0; j < 4; ++j) plane[j] /= length;
+        }
+    }
+    return frustum;
+}
+
+void CullInstancesCpu(Frustum const& frustum, InstanceBounds const* bounds, uint32_t count, std::vector<uint32_t>& visible)
+{
+    visible.clear();
+    uint32_t index = 0;
+
+#ifdef CULLING_USE_SSE
+    for (; index + 4 <= count; index += 4) {
+        // Transpose four spheres into x, y, z and radius lanes
+        __m128 x = _mm_loadu_ps(reinterpret_cast<float const*>(&bounds[index + 0]));
+        __m128 y = _mm_loadu_ps(reinterpret_cast<float const*>(&bounds[index + 1]));
+        __m128 z = _mm_loadu_ps(reinterpret_cast<float const*>(&bounds[index + 2]));
+        __m128 r = _mm_loadu_ps(reinterpret_cast<float const*>(&bounds[index + 3]));
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (float const* plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x), _mm_mul_ps(_mm_set1_ps(plane[1]), y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), z), _mm_set1_ps(plane[3])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            if (mask & (1 << lane)) visible.push_back(index + lane);
+        }
+    }
+#endif // CULLING_USE_SSE
+
+    for (; index < count; ++index) {
+        InstanceBounds const& sphere = bounds[index];
+        bool inside = true;
+        for (float const* plane : frustum.planes) {
+            float distance = plane[0] * sphere.center[0] + plane[1] * sphere.center[1] + plane[2] * sphere.center[2] + plane[3];
+            if (distance < -sphere.radius) {
+                inside = false;
+                break;
+            }
+        }
+        if (inside) visible.push_back(index);
+    }
+}
+
+bool GpuCulling::Initialize(WGPUDevice device, PipelineCache& cache, GpuBufferAllocator& allocator, uint32_t maxInstances)
+{
+    this->device = device;
+    this->allocator = &allocator;
+    this->maxInstances = maxInstances;
+
+    frustumUniform = allocator.Allocate(BufferUsageClass::Uniform, sizeof(FrustumUniform));
+    instanceBounds = allocator.Allocate(BufferUsageClass::Storage, (uint64_t)maxInstances * sizeof(InstanceBounds));
+    visibleInstances = allocator.Allocate(BufferUsageClass::Storage, (uint64_t)maxInstances * sizeof(uint32_t));
+
+    // Written by the shader, read by the draw, and copied for validation
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.nextInChain = nullptr;
+    bufferDesc.label = "Culling indirect arguments";
+    bufferDesc.usage = WGPUBufferUsage_Indirect | WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc;
+    bufferDesc.size = sizeof(DrawIndirectArgs);
+    bufferDesc.mappedAtCreation = false;
+    indirectBuffer.Reset(wgpuDeviceCreateBuffer(device, &bufferDesc));
+    if (!frustumUniform.IsValid() || !instanceBounds.IsValid() || !visibleInstances.IsValid() || !indirectBuffer) return false;
+
+    WGPUComputePipelineDescriptor pipelineDesc = {};
+    pipelineDesc.nextInChain = nullptr;
+    pipelineDesc.label = "Frustum culling";
+    // Let the bind group layout be deduced from the shader
+    pipelineDesc.layout = nullptr;
+    pipelineDesc.compute.nextInChain = nullptr;
+    pipelineDesc.compute.module = cache.GetShaderModule(cullingShaderSource);
+    if (!pipelineDesc.compute.module) return false;
+    pipelineDesc.compute.entryPoint = "cs_main";
+    pipelineDesc.compute.constantCount = 0;
+    pipelineDesc.compute.constants = nullptr;
+    pipeline.Reset(wgpuDeviceCreateComputePipeline(device, &pipelineDesc));
+    if (!pipeline) return false;
+
+    WGPUBindGroupEntry entries[4] = {};
+    entries[0].binding = 0;
+    entries[0].buffer = frustumUniform.buffer;
+    entries[0].offset = frustumUniform.offset;
+    entries[0].size = sizeof(FrustumUniform);
+    entries[1].binding = 1;
+    entries[1].buffer = instanceBounds.buffer;
+    entries[1].offset = instanceBounds.offset;
+    entries[1].size = instanceBounds.size;
+    entries[2].binding = 2;
+    entries[2].buffer = visibleInstances.buffer;
+    entries[2].offset = visibleInstances.offset;
+    entries[2].size = visibleInstances.size;
+    entries[3].binding = 3;
+    entries[3].buffer = indirectBuffer.Get();
+    entries[3].offset = 0;
+    entries[3].size = sizeof(DrawIndirectArgs);
+
+    WGPUBindGroupLayout bindGroupLayout = wgpuComputePipelineGetBindGroupLayout(pipeline.Get(), 0);
+    WGPUBindGroupDescriptor bindGroupDesc = {};
+    bindGroupDesc.nextInChain = nullptr;
+    bindGroupDesc.label = "Frustum culling";
+    bindGroupDesc.layout = bindGroupLayout;
+    bindGroupDesc.entryCount = 4;
+    bindGroupDesc.entries = entries;
+    bindGroup.Reset(wgpuDeviceCreateBindGroup(device, &bindGroupDesc));
+    wgpuBindGroupLayoutRelease(bindGroupLayout);
+
+    return (bool)bindGroup;
+}
+
+void GpuCulling::Terminate()
+{
+    // Released once the frames still using them are done
+    bindGroup.Reset();
+    pipeline.Reset();
+    indirectBuffer.Reset();
+
+    allocator->Free(frustumUniform);
+    allocator->Free(instanceBounds);
+    allocator->Free(visibleInstances);
+}
+
+void GpuCulling::SetInstances(UploadRing& uploads, InstanceBounds const* bounds, uint32_t count)
+{
+    count = std::min(count, maxInstances);
+    cpuBounds.assign(bounds, bounds + count);
+    uploads.Upload(instanceBounds.buffer, instanceBounds.offset, bounds, (uint64_t)count * sizeof(InstanceBounds));
+}
+
+void GpuCulling::Prepare(UploadRing& uploads, Frustum const& frustum, uint32_t vertexCount)
+{
+    cpuFrustum = frustum;
+    this->vertexCount = vertexCount;
+
+    FrustumUniform uniform = {};
+    std::memcpy(uniform.planes, frustum.planes, sizeof(uniform.planes));
+    uniform.instanceCount = (uint32_t)cpuBounds.size();
+    uploads.Upload(frustumUniform.buffer, frustumUniform.offset, &uniform, sizeof(uniform));
+
+    // The shader counts the survivors into instanceCount
+    DrawIndirectArgs args = {};
+    args.vertexCount = vertexCount;
+    uploads.Upload(indirectBuffer.Get(), 0, &args, sizeof(args));
+}
+
+void GpuCulling::Dispatch(WGPUComputePassEncoder pass)
+{
+    uint32_t count = (uint32_t)cpuBounds.size();
+    if (count == 0) return;
+    wgpuComputePassEncoderSetPipeline(pass, pipeline.Get());
+    wgpuComputePassEncoderSetBindGroup(pass, 0, bindGroup.Get(), 0, nullptr);
+    wgpuComputePassEncoderDispatchWorkgroups(pass, (count + WorkgroupSize - 1) / WorkgroupSize, 1, 1);
+}
+
+GpuTask<void> GpuCulling::Validate(GpuExecutor& executor, WGPUQueue queue)
+{
+    uint32_t count = (uint32_t)cpuBounds.size();
+    uint64_t readbackSize = sizeof(DrawIndirectArgs) + (uint64_t)std::max(count, 1u) * sizeof(uint32_t);
+
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.nextInChain = nullptr;
+    bufferDesc.label = "Culling readback";
+    bufferDesc.usage = WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst;
+    bufferDesc.size = readbackSize;
+    bufferDesc.mappedAtCreation = false;
+    WGPUBuffer readback = wgpuDeviceCreateBuffer(device, &bufferDesc);
+
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(device, nullptr);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, indirectBuffer.Get(), 0, readback, 0, sizeof(DrawIndirectArgs));
+    if (count > 0) {
+        wgpuCommandEncoderCopyBufferToBuffer(encoder, visibleInstances.buffer, visibleInstances.offset,
+            readback, sizeof(DrawIndirectArgs), (uint64_t)count * sizeof(uint32_t));
+    }
+    WGPUCommandBuffer command = wgpuCommandEncoderFinish(encoder, nullptr);
+    wgpuCommandEncoderRelease(encoder);
+    wgpuQueueSubmit(queue, 1, &command);
+    wgpuCommandBufferRelease(command);
+
+    // The reference runs while the GPU copies
+    std::vector<uint32_t> expected;
+    CullInstancesCpu(cpuFrustum, cpuBounds.data(), count, expected);
+
+    WGPUBufferMapAsyncStatus status = co_await GpuMapBuffer(executor, readback, WGPUMapMode_Read, 0, (size_t)readbackSize);
+    if (status != WGPUBufferMapAsyncStatus_Success) {
+        Logger::Error("Culling validation could not map the readback buffer", "status", (uint32_t)status);
+        validationResult = 0;
+        wgpuBufferRelease(readback);
+        co_return;
+    }
+
+    uint8_t const* data = static_cast<uint8_t const*>(wgpuBufferGetConstMappedRange(readback, 0, (size_t)readbackSize));
+    DrawIndirectArgs args;
+    std::memcpy(&args, data, sizeof(args));
+    uint32_t visibleCount = std::min(args.instanceCount, count);
+    std::vector<uint32_t> actual(visibleCount);
+    if (visibleCount > 0) std::memcpy(actual.data(), data + sizeof(args), visibleCount * sizeof(uint32_t));
+    wgpuBufferUnmap(readback);
+    wgpuBufferRelease(readback);
+
+    // Atomics make the GPU order arbitrary
+    std::sort(actual.begin(), actual.end());
+    bool match = args.instanceCount == expected.size() && args.vertexCount == vertexCount && actual == expected;
+    validationResult = match ? 1 : 0;
+    if (match) Logger::Info("Culling validation matched", "gpuVisible", args.instanceCount, "cpuVisible", (uint64_t)expected.size(), "instances", count);
+    else Logger::Error("Culling validation mismatch", "gpuVisible", args.instanceCount, "cpuVisible", (uint64_t)expected.size(), "instances", count);
+}
@@ -0,0 +1,89 @@
+#include "../include/GpuHandle.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+
+namespace {
+    struct Counters {
+        std::atomic<uint64_t> live{ 0 };
+        std::atomic<uint64_t> pending{ 0 };
+        std::atomic<uint64_t> released{ 0 };
+    };
+    std::array<Counters, (size_t)GpuObjectType::Count> counts;
+
+    std::mutex pendingMutex;
+    std::vector<FrameTransient> pending;
+
+    char const* const typeNames[] = {
+        "buffers", "textures", "texture views", "samplers", "bind groups", "bind group layouts",
+        "pipeline layouts", "shader modules", "render pipelines", "compute pipelines", "query sets", "render bundles",
+    };
+    static_assert(sizeof(typeNames) / sizeof(typeNames[0]) == (size_t)GpuObjectType::Count, "One name per type");
+}
+
+void GpuReleaseQueue::Defer(void* handle, void (*release)(void*), GpuObjectType type)
+{
+    counts[(size_t)type].pending.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pending.push_back(FrameTransient{ handle, release });
+}
+
+void GpuReleaseQueue::TakePending(std::vector<FrameTransient>& transients)
+{
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    transients.insert(transients.end(), pending.begin(), pending.end());
+    pending.clear();
+}
+
+void GpuReleaseQueue::ReleasePending()
+{
+    std::vector<FrameTransient> released;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        released.swap(pending);
+    }
+    for (FrameTransient const& transient : released) transient.release(transient.handle);
+}
+
+void GpuReleaseQueue::OnAdopted(GpuObjectType type)
+{
+    counts[(size_t)type].live.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GpuReleaseQueue::OnDetached(GpuObjectType type)
+{
+    counts[(size_t)type].live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void GpuReleaseQueue::OnReleased(GpuObjectType type)
+{
+    counts[(size_t)type].pending.fetch_sub(1, std::memory_order_relaxed);
+    counts[(size_t)type].released.fetch_add(1, std::memory_order_relaxed);
+}
+
+GpuObjectCounts GpuReleaseQueue::GetCounts(GpuObjectType type)
+{
+    Counters const& counters = counts[(size_t)type];
+    GpuObjectCounts result;
+    result.live = counters.live.load(std::memory_order_relaxed);
+    result.pending = counters.pending.load(std::memory_order_relaxed);
+    result.released = counters.released.load(std::memory_order_relaxed);
+    return result;
+}
+
+char const* GpuReleaseQueue::GetTypeName(GpuObjectType type)
+{
+    return typeNames[(size_t)type];
+}
+
+void GpuReleaseQueue::Report(std::ostream& out)
+{
+    out << "GPU objects (live / pending / released):";
+    for (size_t i = 0; i < (size_t)GpuObjectType::Count; ++i) {
+        GpuObjectCounts typeCounts = GetCounts((GpuObjectType)i);
+        if (typeCounts.live + typeCounts.pending + typeCounts.released == 0) continue;
+        out << ' ' << typeNames[i] << ' ' << typeCounts.live << '/' << typeCounts.pending << '/' << typeCounts.released << ';';
+    }
+    out << '\n';
+}
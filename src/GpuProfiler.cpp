@@ -0,0 +1,248 @@
+#include "../include/GpuProfiler.h"
+
+#include <webgpu/webgpu.h>
+#ifdef WEBGPU_BACKEND_WGPU
+#  include <webgpu/wgpu.h>
+#endif // WEBGPU_BACKEND_WGPU
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+struct GpuProfiler::Slot {
+    WGPUQuerySet querySet = nullptr;
+    // QueryResolve | CopySrc, resolved into every frame
+    WGPUBuffer resolveBuffer = nullptr;
+    // MapRead | CopyDst
+    WGPUBuffer readbackBuffer = nullptr;
+    // Names of the passes, two queries each
+    std::vector<std::string> passes;
+    // Written by the map callback, possibly from another polling thread
+    std::atomic<SlotState> state{ SlotState::Free };
+};
+
+GpuProfiler::GpuProfiler() = default;
+GpuProfiler::~GpuProfiler() = default;
+
+bool GpuProfiler::Initialize(WGPUDevice device)
+{
+    this->device = device;
+    enabled = device != nullptr && wgpuDeviceHasFeature(device, WGPUFeatureName_TimestampQuery);
+    stats = {};
+    stats.enabled = enabled;
+    if (!enabled) return false;
+
+    uint64_t bufferSize = (uint64_t)MaxPassesPerFrame * 2 * sizeof(uint64_t);
+    for (std::unique_ptr<Slot>& slot : slots) {
+        slot.reset(new Slot());
+
+        WGPUQuerySetDescriptor querySetDesc = {};
+        querySetDesc.nextInChain = nullptr;
+        querySetDesc.label = "Pass timestamps";
+        querySetDesc.type = WGPUQueryType_Timestamp;
+        querySetDesc.count = MaxPassesPerFrame * 2;
+        slot->querySet = wgpuDeviceCreateQuerySet(device, &querySetDesc);
+
+        WGPUBufferDescriptor bufferDesc = {};
+        bufferDesc.nextInChain = nullptr;
+        bufferDesc.label = "Timestamp resolve";
+        bufferDesc.usage = WGPUBufferUsage_QueryResolve | WGPUBufferUsage_CopySrc;
+        bufferDesc.size = bufferSize;
+        bufferDesc.mappedAtCreation = false;
+        slot->resolveBuffer = wgpuDeviceCreateBuffer(device, &bufferDesc);
+
+        bufferDesc.label = "Timestamp readback";
+        bufferDesc.usage = WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst;
+        slot->readbackBuffer = wgpuDeviceCreateBuffer(device, &bufferDesc);
+
+        if (!slot->querySet || !slot->resolveBuffer || !slot->readbackBuffer) {
+            Terminate();
+            return false;
+        }
+    }
+    return true;
+}
+
+void GpuProfiler::Terminate()
+{
+    for (std::unique_ptr<Slot>& slot : slots) {
+        if (!slot) continue;
+        // Pending map callbacks reference the slot: let them land first
+        while (slot->state.load(std::memory_order_acquire) == SlotState::Mapping) {
+#if defined(WEBGPU_BACKEND_DAWN)
+            wgpuDeviceTick(device);
+#elif defined(WEBGPU_BACKEND_WGPU)
+            wgpuDevicePoll(device, true, nullptr);
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+            emscripten_sleep(1);
+#endif
+        }
+        if (slot->state == SlotState::Mapped) wgpuBufferUnmap(slot->readbackBuffer);
+        if (slot->readbackBuffer) {
+            wgpuBufferDestroy(slot->readbackBuffer);
+            wgpuBufferRelease(slot->readbackBuffer);
+        }
+        if (slot->resolveBuffer) wgpuBufferRelease(slot->resolveBuffer);
+        if (slot->querySet) {
+            wgpuQuerySetDestroy(slot->querySet);
+            wgpuQuerySetRelease(slot->querySet);
+        }
+        slot.reset();
+    }
+    recording = nullptr;
+    enabled = false;
+}
+
+void GpuProfiler::BeginFrame()
+{
+    if (!enabled) return;
+    // The previous frame was abandoned before being submitted
+    if (recording) recording->state.store(SlotState::Free, std::memory_order_relaxed);
+    recording = nullptr;
+
+    for (std::unique_ptr<Slot>& slot : slots) {
+        SlotState state = slot->state.load(std::memory_order_acquire);
+        if (state == SlotState::Mapped) Collect(*slot);
+        else if (state == SlotState::Failed) slot->state.store(SlotState::Free, std::memory_order_relaxed);
+    }
+
+    Slot& slot = *slots[current];
+    if (slot.state.load(std::memory_order_acquire) != SlotState::Free) {
+        ++stats.framesSkipped;
+        return;
+    }
+    current = (current + 1) % ReadbackRingSize;
+    slot.passes.clear();
+    slot.state.store(SlotState::Recording, std::memory_order_relaxed);
+    recording = &slot;
+}
+
+uint32_t GpuProfiler::AllocatePass(char const* name)
+{
+    if (!recording) return ~0u;
+    if (recording->passes.size() >= MaxPassesPerFrame) {
+        ++stats.passesDropped;
+        return ~0u;
+    }
+    recording->passes.push_back(name ? name : "(unnamed)");
+    return (uint32_t)(recording->passes.size() - 1) * 2;
+}
+
+WGPURenderPassTimestampWrites const* GpuProfiler::RenderPassWrites(char const* name)
+{
+    uint32_t query = AllocatePass(name);
+    if (query == ~0u) return nullptr;
+    renderWrites.querySet = recording->querySet;
+    renderWrites.beginningOfPassWriteIndex = query;
+    renderWrites.endOfPassWriteIndex = query + 1;
+    return &renderWrites;
+}
+
+WGPUComputePassTimestampWrites const* GpuProfiler::ComputePassWrites(char const* name)
+{
+    uint32_t query = AllocatePass(name);
+    if (query == ~0u) return nullptr;
+    computeWrites.querySet = recording->querySet;
+    computeWrites.beginningOfPassWriteIndex = query;
+    computeWrites.endOfPassWriteIndex = query + 1;
+    return &computeWrites;
+}
+
+void GpuProfiler::EndFrame(WGPUCommandEncoder encoder)
+{
+    if (!recording) return;
+    if (recording->passes.empty()) {
+        recording->state.store(SlotState::Free, std::memory_order_relaxed);
+        recording = nullptr;
+        return;
+    }
+    uint32_t queryCount = (uint32_t)recording->passes.size() * 2;
+    wgpuCommandEncoderResolveQuerySet(encoder, recording->querySet, 0, queryCount, recording->resolveBuffer, 0);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, recording->resolveBuffer, 0, recording->readbackBuffer, 0, queryCount * sizeof(uint64_t));
+}
+
+void GpuProfiler::OnSubmitted()
+{
+    if (!recording) return;
+    Slot& slot = *recording;
+    recording = nullptr;
+
+    // Completes once the copy above ran, never waited for
+    auto onReadbackMapped = [](WGPUBufferMapAsyncStatus status, void* pUserData) {
+        Slot& slot = *reinterpret_cast<Slot*>(pUserData);
+        slot.state.store(status == WGPUBufferMapAsyncStatus_Success ? SlotState::Mapped : SlotState::Failed, std::memory_order_release);
+        };
+    slot.state.store(SlotState::Mapping, std::memory_order_relaxed);
+    size_t size = slot.passes.size() * 2 * sizeof(uint64_t);
+    wgpuBufferMapAsync(slot.readbackBuffer, WGPUMapMode_Read, 0, size, onReadbackMapped, (void*)&slot);
+}
+
+void GpuProfiler::Collect(Slot& slot)
+{
+    size_t size = slot.passes.size() * 2 * sizeof(uint64_t);
+    uint64_t const* timestamps = static_cast<uint64_t const*>(wgpuBufferGetConstMappedRange(slot.readbackBuffer, 0, size));
+
+    for (size_t pass = 0; timestamps && pass < slot.passes.size(); ++pass) {
+        uint64_t begin = timestamps[2 * pass];
+        uint64_t end = timestamps[2 * pass + 1];
+        // Timestamps are in nanoseconds. Some drivers reset or go backwards
+        // across power states: drop those samples.
+        if (end < begin) continue;
+        float ms = (float)((double)(end - begin) * 1e-6);
+
+        auto found = historyIndex.find(slot.passes[pass]);
+        if (found == historyIndex.end()) {
+            found = historyIndex.emplace(slot.passes[pass], history.size()).first;
+            history.emplace_back();
+            history.back().name = slot.passes[pass];
+        }
+        PassHistory& entry = history[found->second];
+        entry.samples[entry.next] = ms;
+        entry.next = (entry.next + 1) % HistorySize;
+        entry.count = std::min(entry.count + 1, HistorySize);
+        entry.lastMs = ms;
+    }
+
+    wgpuBufferUnmap(slot.readbackBuffer);
+    slot.state.store(SlotState::Free, std::memory_order_relaxed);
+    ++stats.framesResolved;
+}
+
+std::vector<GpuPassTiming> GpuProfiler::GetPassTimings() const
+{
+    std::vector<GpuPassTiming> timings;
+    timings.reserve(history.size());
+    for (PassHistory const& entry : history) {
+        GpuPassTiming timing;
+        timing.name = entry.name;
+        timing.lastMs = entry.lastMs;
+        timing.samples = entry.count;
+        double total = 0.0;
+        for (uint32_t i = 0; i < entry.count; ++i) {
+            total += entry.samples[i];
+            timing.maxMs = std::max(timing.maxMs, (double)entry.samples[i]);
+        }
+        timing.averageMs = entry.count > 0 ? total / entry.count : 0.0;
+        timings.push_back(timing);
+    }
+    return timings;
+}
+
+void GpuProfiler::Report(std::ostream& out) const
+{
+    std::ostringstream report;
+    if (!enabled) {
+        report << "GPU profiler: timestamp queries not available\n";
+        out << report.str() << std::flush;
+        return;
+    }
+
+    report << std::fixed << std::setprecision(3);
+    report << "GPU pass times (ms, last " << HistorySize << " frames): " << stats.framesResolved << " frames resolved, "
+        << stats.framesSkipped << " skipped\n";
+    for (GpuPassTiming const& timing : GetPassTimings()) {
+        report << "  " << std::setw(16) << timing.name << "  avg " << timing.averageMs << "  max " << timing.maxMs
+            << "  last " << timing.lastMs << '\n';
+    }
+    out << report.str() << std::flush;
+}
@@ -0,0 +1,270 @@
+#include "../include/JobSystem.h"
+#include "../include/CpuProfiler.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+    // The worker owning the calling thread, for the JobSystem it belongs to
+    thread_local void* currentWorker = nullptr;
+    // Where threads without a deque start looking for jobs to steal
+    thread_local uint32_t nextVictim = 0;
+}
+
+// Chase and Lev, "Dynamic Circular Work-Stealing Deque", with the C11
+// orderings of Lê et al. Sequentially consistent operations stand in for
+// the fences, which also keeps ThreadSanitizer able to follow it.
+bool JobDeque::Push(Job* job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= Capacity) return false;
+    jobs[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+Job* JobDeque::Pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job* job = jobs[b & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last one: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::Steal()
+{
+    int64_t t = top.load(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) return nullptr;
+    Job* job = jobs[t & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return job;
+}
+
+void JobSystem::Initialize(uint32_t workerCount)
+{
+    if (workerCount == 0) {
+        // Jobs nobody waits for (screenshot encoding) need a worker to run
+        // on, even with a single core
+        uint32_t cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 1;
+    }
+    start = std::chrono::steady_clock::now();
+    stopping = false;
+
+    // The calling thread gets the first deque, to help while it waits
+    for (uint32_t i = 0; i <= workerCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->system = this;
+        workers.back()->index = i;
+    }
+    currentWorker = workers[0].get();
+    for (uint32_t i = 1; i <= workerCount; ++i) {
+        workers[i]->thread = std::thread(&JobSystem::WorkerMain, this, workers[i].get());
+    }
+}
+
+void JobSystem::Terminate()
+{
+    if (workers.empty()) return;
+    Worker* worker = GetCurrentWorker();
+    while (Job* job = FindJob(worker)) Execute(job, worker);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::unique_ptr<Worker>& other : workers) {
+        if (other->thread.joinable()) other->thread.join();
+    }
+    if (currentWorker == workers[0].get()) currentWorker = nullptr;
+    workers.clear();
+}
+
+Job* JobSystem::Create(std::function<void()> function, Job* parent)
+{
+    Job* job = new Job;
+    job->function = std::move(function);
+    job->parent = parent;
+    if (parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::Run(Job* job)
+{
+    Worker* worker = GetCurrentWorker();
+    queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    if (worker) {
+        if (!worker->deque.Push(job)) {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            Execute(job, worker);
+            return;
+        }
+    }
+    else {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        injected.push_back(job);
+        ++jobsInjected;
+    }
+    // Idle workers check queuedJobs under the lock before they sleep
+    if (sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_one();
+    }
+}
+
+void JobSystem::Spawn(std::function<void()> function, Job* parent)
+{
+    Job* job = Create(std::move(function), parent);
+    Run(job);
+    Release(job);
+}
+
+void JobSystem::Wait(Job* job)
+{
+    CPU_ZONE("Wait for job");
+    Worker* worker = GetCurrentWorker();
+    while (!IsFinished(job)) {
+        if (Job* other = FindJob(worker)) {
+            Execute(other, worker);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    Release(job);
+}
+
+void JobSystem::Release(Job* job)
+{
+    if (job->references.fetch_sub(1, std::memory_order_acq_rel) == 1) delete job;
+}
+
+void JobSystem::ParallelFor(size_t begin, size_t end, size_t grain, std::function<void(size_t first, size_t last)> const& body)
+{
+    if (begin >= end) return;
+    grain = std::max<size_t>(grain, 1);
+    if (end - begin <= grain) {
+        body(begin, end);
+        return;
+    }
+    // An empty parent, finished once every chunk is
+    Job* root = Create(nullptr);
+    for (size_t first = begin; first < end; first += std::min(grain, end - first)) {
+        size_t last = first + std::min(grain, end - first);
+        Spawn([&body, first, last]() { body(first, last); }, root);
+    }
+    Run(root);
+    Wait(root);
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+    JobSystemStats result;
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (std::unique_ptr<Worker> const& worker : workers) {
+        JobWorkerStats stats;
+        stats.jobsExecuted = worker->jobsExecuted.load(std::memory_order_relaxed);
+        stats.jobsStolen = worker->jobsStolen.load(std::memory_order_relaxed);
+        stats.sleeps = worker->sleeps.load(std::memory_order_relaxed);
+        stats.busyMs = (double)worker->busyNs.load(std::memory_order_relaxed) * 1e-6;
+        stats.utilization = wallMs > 0.0 ? stats.busyMs / wallMs : 0.0;
+        result.workers.push_back(stats);
+    }
+    std::lock_guard<std::mutex> lock(injectedMutex);
+    result.jobsInjected = jobsInjected;
+    return result;
+}
+
+JobSystem::Worker* JobSystem::GetCurrentWorker() const
+{
+    Worker* worker = static_cast<Worker*>(currentWorker);
+    return worker && worker->system == this ? worker : nullptr;
+}
+
+Job* JobSystem::FindJob(Worker* worker)
+{
+    if (worker) {
+        if (Job* job = worker->deque.Pop()) {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    size_t count = workers.size();
+    size_t first = worker ? worker->index + 1 : nextVictim++;
+    for (size_t i = 0; i < count; ++i) {
+        Worker* victim = workers[(first + i) % count].get();
+        if (victim == worker) continue;
+        if (Job* job = victim->deque.Steal()) {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            if (worker) worker->jobsStolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    std::lock_guard<std::mutex> lock(injectedMutex);
+    if (injected.empty()) return nullptr;
+    Job* job = injected.front();
+    injected.pop_front();
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::Execute(Job* job, Worker* worker)
+{
+    auto jobStart = std::chrono::steady_clock::now();
+    if (job->function) job->function();
+    if (worker) {
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - jobStart).count();
+        worker->busyNs.fetch_add(ns, std::memory_order_relaxed);
+        worker->jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+    }
+    Finish(job);
+}
+
+void JobSystem::Finish(Job* job)
+{
+    while (job && job->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Job* parent = job->parent;
+        Release(job);
+        job = parent;
+    }
+}
+
+void JobSystem::WorkerMain(Worker* worker)
+{
+    currentWorker = worker;
+    std::string name = "Job worker " + std::to_string(worker->index);
+    CpuProfiler::SetThreadName(name.c_str());
+
+    uint32_t idleSpins = 0;
+    while (true) {
+        if (Job* job = FindJob(worker)) {
+            Execute(job, worker);
+            idleSpins = 0;
+            continue;
+        }
+        // Only once nothing is left, Terminate() runs the queue dry
+        if (stopping.load(std::memory_order_acquire)) return;
+        if (++idleSpins < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        worker->sleeps.fetch_add(1, std::memory_order_relaxed);
+        wakeUp.wait(lock, [this]() { return stopping.load(std::memory_order_relaxed) || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+        sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        idleSpins = 0;
+    }
+}
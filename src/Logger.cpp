@@ -0,0 +1,262 @@
+#include "../include/Logger.h"
+#include "../include/CpuProfiler.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    char const* const levelNames[] = { "debug", "info", "warning", "error" };
+
+    // How often the flusher wakes up
+    constexpr std::chrono::milliseconds flushInterval{ 10 };
+    // Window of the rate limit, and the longest a repeat count waits
+    constexpr std::chrono::seconds reportInterval{ 1 };
+
+    struct RateLimit {
+        Clock::time_point windowStart;
+        uint32_t count = 0;
+        uint64_t suppressed = 0;
+    };
+}
+
+struct Logger::Registry {
+    std::mutex mutex;
+    // Never freed: messages of finished threads still get written
+    std::vector<ThreadRing*> rings;
+
+    FILE* output = stdout;
+    uint32_t maxPerSecond = 20;
+    Clock::time_point start = Clock::now();
+
+    std::thread flusher;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    // Everything below belongs to whoever drains, under drainMutex
+    std::mutex drainMutex;
+    std::vector<Record> batch;
+    std::string text;
+    Record last = {};
+    bool hasLast = false;
+    uint64_t repeats = 0;
+    Clock::time_point lastRepeatReport;
+    std::unordered_map<char const*, RateLimit> rateLimits;
+    LoggerStats stats;
+
+    // Exiting without Terminate() still writes everything and joins the flusher
+    ~Registry()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        if (flusher.joinable()) flusher.join();
+        Logger::Drain(*this);
+    }
+};
+
+Logger::Registry& Logger::GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+Logger::ThreadRing& Logger::GetThreadRing()
+{
+    if (!threadRing) {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        threadRing = new ThreadRing();
+        registry.rings.push_back(threadRing);
+    }
+    return *threadRing;
+}
+
+void Logger::Initialize(LogLevel minLevel, FILE* output, uint32_t maxPerSecond)
+{
+    Logger::minLevel.store(minLevel, std::memory_order_relaxed);
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.output = output;
+    registry.maxPerSecond = std::max(maxPerSecond, 1u);
+    registry.start = Clock::now();
+    registry.stopping = false;
+    if (!registry.flusher.joinable()) registry.flusher = std::thread(&Logger::FlusherMain);
+}
+
+void Logger::Terminate()
+{
+    Registry& registry = GetRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.stopping = true;
+    }
+    registry.wakeUp.notify_all();
+    if (registry.flusher.joinable()) registry.flusher.join();
+    Flush();
+}
+
+void Logger::Flush()
+{
+    Drain(GetRegistry());
+}
+
+LoggerStats Logger::GetStats()
+{
+    Registry& registry = GetRegistry();
+    LoggerStats result;
+    {
+        std::lock_guard<std::mutex> lock(registry.drainMutex);
+        result = registry.stats;
+    }
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (ThreadRing* ring : registry.rings) result.dropped += ring->dropped.load(std::memory_order_relaxed);
+    return result;
+}
+
+void Logger::FlusherMain()
+{
+    CpuProfiler::SetThreadName("Logger");
+    Registry& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    while (!registry.wakeUp.wait_for(lock, flushInterval, [&registry]() { return registry.stopping; })) {
+        lock.unlock();
+        Drain(registry);
+        lock.lock();
+    }
+}
+
+void Logger::Drain(Registry& registry)
+{
+    std::lock_guard<std::mutex> drainLock(registry.drainMutex);
+    std::vector<ThreadRing*> rings;
+    FILE* output;
+    uint32_t maxPerSecond;
+    Clock::time_point start;
+    bool final;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        rings = registry.rings;
+        output = registry.output;
+        maxPerSecond = registry.maxPerSecond;
+        start = registry.start;
+        // Terminate(): report what is pending without waiting
+        final = registry.stopping;
+    }
+
+    // Every thread's messages, in the order they were logged
+    std::vector<Record>& batch = registry.batch;
+    batch.clear();
+    for (ThreadRing* ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (uint64_t i = tail; i < head; ++i) batch.push_back(ring->records[i & (RingSize - 1)]);
+        ring->tail.store(head, std::memory_order_release);
+    }
+    std::stable_sort(batch.begin(), batch.end(), [](Record const& a, Record const& b) { return a.time < b.time; });
+
+    std::string& text = registry.text;
+    text.clear();
+    char number[64];
+    auto writePrefix = [&](Clock::time_point time, LogLevel level) {
+        std::snprintf(number, sizeof(number), "[%10.3f] %-7s ", std::chrono::duration<double>(time - start).count(), levelNames[(int)level]);
+        text += number;
+        };
+    auto writeRepeats = [&](Clock::time_point time) {
+        writePrefix(time, registry.last.level);
+        text += registry.last.event;
+        text += ": last message repeated " + std::to_string(registry.repeats) + " times\n";
+        registry.repeats = 0;
+        registry.lastRepeatReport = time;
+        };
+    auto writeSuppressed = [&](Clock::time_point time, char const* event, RateLimit& limit) {
+        writePrefix(time, LogLevel::Warning);
+        text += event;
+        text += ": " + std::to_string(limit.suppressed) + " messages suppressed\n";
+        limit.suppressed = 0;
+        };
+
+    for (Record const& record : batch) {
+        ++registry.stats.logged;
+        if (registry.hasLast && IsSameMessage(record, registry.last)) {
+            ++registry.repeats;
+            ++registry.stats.repeated;
+            continue;
+        }
+        if (registry.repeats > 0) writeRepeats(record.time);
+        registry.last = record;
+        registry.hasLast = true;
+        registry.lastRepeatReport = record.time;
+
+        RateLimit& limit = registry.rateLimits[record.event];
+        if (record.time - limit.windowStart >= reportInterval) {
+            if (limit.suppressed > 0) writeSuppressed(record.time, record.event, limit);
+            limit.windowStart = record.time;
+            limit.count = 0;
+        }
+        if (limit.count >= maxPerSecond) {
+            ++limit.suppressed;
+            ++registry.stats.suppressed;
+            continue;
+        }
+        ++limit.count;
+
+        writePrefix(record.time, record.level);
+        text += record.event;
+        for (uint32_t i = 0; i < record.fieldCount; ++i) {
+            Field const& field = record.fields[i];
+            text += ' ';
+            text += field.key;
+            text += '=';
+            switch (field.type) {
+            case FieldType::Int: text += std::to_string(field.i); break;
+            case FieldType::UInt: text += std::to_string(field.u); break;
+            case FieldType::Double: std::snprintf(number, sizeof(number), "%g", field.d); text += number; break;
+            case FieldType::Pointer: std::snprintf(number, sizeof(number), "%p", (void const*)(uintptr_t)field.u); text += number; break;
+            case FieldType::String:
+                text += '"';
+                text.append(record.text + field.textOffset, field.textLength);
+                text += '"';
+                break;
+            }
+        }
+        text += '\n';
+        ++registry.stats.written;
+    }
+
+    // Runs still going, and suppressed messages, are reported once a second
+    Clock::time_point now = Clock::now();
+    if (registry.repeats > 0 && (final || now - registry.lastRepeatReport >= reportInterval)) writeRepeats(now);
+    for (auto& [event, limit] : registry.rateLimits) {
+        if (limit.suppressed > 0 && (final || now - limit.windowStart >= reportInterval)) writeSuppressed(now, event, limit);
+    }
+
+    if (!text.empty()) {
+        std::fwrite(text.data(), 1, text.size(), output);
+        std::fflush(output);
+    }
+}
+
+bool Logger::IsSameMessage(Record const& a, Record const& b)
+{
+    if (a.event != b.event || a.level != b.level || a.fieldCount != b.fieldCount || a.textUsed != b.textUsed) return false;
+    for (uint32_t i = 0; i < a.fieldCount; ++i) {
+        Field const& x = a.fields[i];
+        Field const& y = b.fields[i];
+        if (x.key != y.key || x.type != y.type) return false;
+        if (x.type == FieldType::String) {
+            if (x.textLength != y.textLength || std::memcmp(a.text + x.textOffset, b.text + y.textOffset, x.textLength) != 0) return false;
+        }
+        // Every other type fills the whole 64 bits
+        else if (x.u != y.u) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,313 @@
+#include "../include/PipelineCache.h"
+#include "../include/Logger.h"
+
+#include <webgpu/webgpu.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+
+namespace {
+    // FNV-1a, fed field by field so that struct padding never leaks in
+    struct Hasher {
+        uint64_t value = 14695981039346656037ull;
+
+        void Bytes(void const* data, size_t size) {
+            unsigned char const* bytes = static_cast<unsigned char const*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                value ^= bytes[i];
+                value *= 1099511628211ull;
+            }
+        }
+        void String(char const* string) {
+            // Hash the terminator too so that "ab"+"c" differs from "a"+"bc"
+            if (string) Bytes(string, std::char_traits<char>::length(string) + 1);
+            else Value<uint8_t>(0);
+        }
+        template <typename T>
+        void Value(T value) {
+            Bytes(&value, sizeof(T));
+        }
+    };
+
+    void HashConstants(Hasher& hasher, size_t constantCount, WGPUConstantEntry const* constants) {
+        hasher.Value<uint64_t>(constantCount);
+        for (size_t i = 0; i < constantCount; ++i) {
+            hasher.String(constants[i].key);
+            hasher.Value(constants[i].value);
+        }
+    }
+
+    void HashBlendComponent(Hasher& hasher, WGPUBlendComponent const& component) {
+        hasher.Value<uint32_t>(component.operation);
+        hasher.Value<uint32_t>(component.srcFactor);
+        hasher.Value<uint32_t>(component.dstFactor);
+    }
+
+    void HashStencilFace(Hasher& hasher, WGPUStencilFaceState const& face) {
+        hasher.Value<uint32_t>(face.compare);
+        hasher.Value<uint32_t>(face.failOp);
+        hasher.Value<uint32_t>(face.depthFailOp);
+        hasher.Value<uint32_t>(face.passOp);
+    }
+
+    double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+uint64_t PipelineCache::HashShader(char const* wgslSource)
+{
+    Hasher hasher;
+    hasher.String(wgslSource);
+    return hasher.value;
+}
+
+uint64_t PipelineCache::HashRenderPipeline(uint64_t shaderKey, WGPURenderPipelineDescriptor const& descriptor)
+{
+    Hasher hasher;
+    hasher.Value(shaderKey);
+    // Explicit layouts can only be told apart by their handle
+    hasher.Value<uint64_t>((uint64_t)(uintptr_t)descriptor.layout);
+
+    WGPUVertexState const& vertex = descriptor.vertex;
+    hasher.String(vertex.entryPoint);
+    HashConstants(hasher, vertex.constantCount, vertex.constants);
+    hasher.Value<uint64_t>(vertex.bufferCount);
+    for (size_t i = 0; i < vertex.bufferCount; ++i) {
+        WGPUVertexBufferLayout const& layout = vertex.buffers[i];
+        hasher.Value(layout.arrayStride);
+        hasher.Value<uint32_t>(layout.stepMode);
+        hasher.Value<uint64_t>(layout.attributeCount);
+        for (size_t j = 0; j < layout.attributeCount; ++j) {
+            hasher.Value<uint32_t>(layout.attributes[j].format);
+            hasher.Value(layout.attributes[j].offset);
+            hasher.Value(layout.attributes[j].shaderLocation);
+        }
+    }
+
+    hasher.Value<uint32_t>(descriptor.primitive.topology);
+    hasher.Value<uint32_t>(descriptor.primitive.stripIndexFormat);
+    hasher.Value<uint32_t>(descriptor.primitive.frontFace);
+    hasher.Value<uint32_t>(descriptor.primitive.cullMode);
+
+    hasher.Value<uint8_t>(descriptor.depthStencil != nullptr);
+    if (descriptor.depthStencil) {
+        WGPUDepthStencilState const& depthStencil = *descriptor.depthStencil;
+        hasher.Value<uint32_t>(depthStencil.format);
+        hasher.Value<uint32_t>(depthStencil.depthWriteEnabled);
+        hasher.Value<uint32_t>(depthStencil.depthCompare);
+        HashStencilFace(hasher, depthStencil.stencilFront);
+        HashStencilFace(hasher, depthStencil.stencilBack);
+        hasher.Value(depthStencil.stencilReadMask);
+        hasher.Value(depthStencil.stencilWriteMask);
+        hasher.Value(depthStencil.depthBias);
+        hasher.Value(depthStencil.depthBiasSlopeScale);
+        hasher.Value(depthStencil.depthBiasClamp);
+    }
+
+    hasher.Value(descriptor.multisample.count);
+    hasher.Value(descriptor.multisample.mask);
+    hasher.Value<uint32_t>(descriptor.multisample.alphaToCoverageEnabled);
+
+    hasher.Value<uint8_t>(descriptor.fragment != nullptr);
+    if (descriptor.fragment) {
+        WGPUFragmentState const& fragment = *descriptor.fragment;
+        hasher.String(fragment.entryPoint);
+        HashConstants(hasher, fragment.constantCount, fragment.constants);
+        hasher.Value<uint64_t>(fragment.targetCount);
+        for (size_t i = 0; i < fragment.targetCount; ++i) {
+            WGPUColorTargetState const& target = fragment.targets[i];
+            hasher.Value<uint32_t>(target.format);
+            hasher.Value<uint32_t>(target.writeMask);
+            hasher.Value<uint8_t>(target.blend != nullptr);
+            if (target.blend) {
+                HashBlendComponent(hasher, target.blend->color);
+                HashBlendComponent(hasher, target.blend->alpha);
+            }
+        }
+    }
+
+    return hasher.value;
+}
+
+bool PipelineCache::Initialize(WGPUDevice device, char const* indexPath)
+{
+    this->device = device;
+    this->indexPath = indexPath;
+    LoadIndex();
+    return true;
+}
+
+void PipelineCache::Terminate()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (indexDirty) SaveIndex();
+
+    for (auto& entry : renderPipelines) {
+        wgpuRenderPipelineRelease(entry.second);
+    }
+    renderPipelines.clear();
+    for (auto& entry : shaderModules) {
+        wgpuShaderModuleRelease(entry.second);
+    }
+    shaderModules.clear();
+}
+
+WGPUShaderModule PipelineCache::GetShaderModule(char const* wgslSource)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    uint64_t key = HashShader(wgslSource);
+    auto it = shaderModules.find(key);
+    if (it != shaderModules.end()) {
+        ++stats.shaderHits;
+        return it->second;
+    }
+    ++stats.shaderMisses;
+
+    auto createStart = std::chrono::steady_clock::now();
+
+    WGPUShaderModuleDescriptor shaderDesc{};
+#ifdef WEBGPU_BACKEND_WGPU
+    shaderDesc.hintCount = 0;
+    shaderDesc.hints = nullptr;
+#endif
+    WGPUShaderModuleWGSLDescriptor shaderCodeDesc{};
+    shaderCodeDesc.chain.next = nullptr;
+    shaderCodeDesc.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
+    shaderDesc.nextInChain = &shaderCodeDesc.chain;
+    shaderCodeDesc.code = wgslSource;
+
+    Validation shaderValidation;
+    BeginValidation(shaderValidation, key);
+    WGPUShaderModule shaderModule = wgpuDeviceCreateShaderModule(device, &shaderDesc);
+    bool valid = EndValidation(shaderValidation, key);
+
+    stats.createMs += MillisecondsSince(createStart);
+
+    // wgpu hands out a handle even for an invalid module: keep it out of the
+    // cache so that a fixed source gets another try
+    if (!valid) {
+        ++stats.validationFailures;
+        wgpuShaderModuleRelease(shaderModule);
+        return nullptr;
+    }
+    shaderModules[key] = shaderModule;
+    return shaderModule;
+}
+
+WGPURenderPipeline PipelineCache::GetRenderPipeline(char const* wgslSource, WGPURenderPipelineDescriptor const& descriptor)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    uint64_t shaderKey = HashShader(wgslSource);
+    uint64_t key = HashRenderPipeline(shaderKey, descriptor);
+    auto it = renderPipelines.find(key);
+    if (it != renderPipelines.end()) {
+        ++stats.pipelineHits;
+        return it->second;
+    }
+    ++stats.pipelineMisses;
+
+    WGPUShaderModule shaderModule = GetShaderModule(wgslSource);
+    if (!shaderModule) return nullptr;
+
+    auto createStart = std::chrono::steady_clock::now();
+
+    // Patch the module into a copy of the caller's descriptor
+    WGPURenderPipelineDescriptor pipelineDesc = descriptor;
+    pipelineDesc.vertex.module = shaderModule;
+    WGPUFragmentState fragmentState{};
+    if (descriptor.fragment) {
+        fragmentState = *descriptor.fragment;
+        fragmentState.module = shaderModule;
+        pipelineDesc.fragment = &fragmentState;
+    }
+
+    Validation pipelineValidation;
+    pipelineValidation.persistent = descriptor.layout == nullptr;
+    BeginValidation(pipelineValidation, key);
+    WGPURenderPipeline pipeline = wgpuDeviceCreateRenderPipeline(device, &pipelineDesc);
+    bool valid = EndValidation(pipelineValidation, key);
+
+    stats.createMs += MillisecondsSince(createStart);
+
+    if (!valid) {
+        ++stats.validationFailures;
+        wgpuRenderPipelineRelease(pipeline);
+        return nullptr;
+    }
+    renderPipelines[key] = pipeline;
+    return pipeline;
+}
+
+PipelineCacheStats PipelineCache::GetStats()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return stats;
+}
+
+bool PipelineCache::CaptureError(WGPUErrorType type, char const* message)
+{
+    if (!validation) return false;
+    validation->failed = true;
+    Logger::Warning("Pipeline cache validation failed", "type", type, "message", message ? message : "");
+    return true;
+}
+
+void PipelineCache::BeginValidation(Validation& current, uint64_t key)
+{
+    if (current.persistent) {
+        if (indexedKeys.count(key)) ++stats.diskHits;
+        else ++stats.diskMisses;
+    }
+    assert(!validation);
+    validation = &current;
+}
+
+bool PipelineCache::EndValidation(Validation& current, uint64_t key)
+{
+    assert(validation == &current);
+    validation = nullptr;
+    if (current.failed) return false;
+    if (current.persistent) {
+        usedKeys.push_back(key);
+        indexDirty = true;
+    }
+    return true;
+}
+
+void PipelineCache::LoadIndex()
+{
+    std::ifstream file(indexPath);
+    if (!file) return;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        uint64_t key = std::strtoull(line.c_str(), nullptr, 16);
+        if (indexedKeys.insert(key).second) indexOrder.push_back(key);
+    }
+}
+
+void PipelineCache::SaveIndex()
+{
+    std::ofstream file(indexPath, std::ios::trunc);
+    if (!file) {
+        Logger::Warning("Pipeline cache index not written", "path", indexPath.c_str());
+        return;
+    }
+
+    file << "# WGSL shader and render pipeline keys that passed validation\n";
+    file << std::hex;
+    // This run's keys first, then the older ones until the index is full.
+    // Keys no run uses any more fall off the end.
+    std::unordered_set<uint64_t> written;
+    for (std::vector<uint64_t> const* keys : { &usedKeys, &indexOrder }) {
+        for (uint64_t key : *keys) {
+            if (written.size() == MaxIndexKeys) break;
+            if (written.insert(key).second) file << key << '\n';
+        }
+    }
+    indexDirty = false;
+}
@@ -0,0 +1,226 @@
+#include "../include/PipelineManager.h"
+#include "../include/PipelineCache.h"
+#include "../include/Logger.h"
+
+#include <webgpu/webgpu.h>
+
+#include <cassert>
+#include <chrono>
+#include <string>
+
+namespace {
+    // Deep copy of a WGPURenderPipelineDescriptor, so that the request can
+    // outlive the caller's stack frame
+    struct OwnedRenderPipelineDescriptor {
+        WGPURenderPipelineDescriptor desc = {};
+        std::string label;
+        std::string vertexEntryPoint;
+        std::string fragmentEntryPoint;
+        std::vector<std::string> constantKeys;
+        std::vector<WGPUConstantEntry> vertexConstants;
+        std::vector<WGPUConstantEntry> fragmentConstants;
+        std::vector<WGPUVertexBufferLayout> buffers;
+        std::vector<std::vector<WGPUVertexAttribute>> attributes;
+        WGPUDepthStencilState depthStencil = {};
+        WGPUFragmentState fragment = {};
+        std::vector<WGPUColorTargetState> targets;
+        std::vector<WGPUBlendState> blends;
+
+        void CopyFrom(WGPURenderPipelineDescriptor const& source) {
+            desc = source;
+            desc.nextInChain = nullptr;
+            if (source.label) label = source.label;
+            desc.label = source.label ? label.c_str() : nullptr;
+
+            // Reserve first so that the pointers taken below stay valid
+            constantKeys.reserve(source.vertex.constantCount + (source.fragment ? source.fragment->constantCount : 0));
+
+            vertexEntryPoint = source.vertex.entryPoint ? source.vertex.entryPoint : "";
+            desc.vertex.entryPoint = vertexEntryPoint.c_str();
+            CopyConstants(source.vertex.constantCount, source.vertex.constants, vertexConstants);
+            desc.vertex.constants = vertexConstants.data();
+
+            buffers.assign(source.vertex.buffers, source.vertex.buffers + source.vertex.bufferCount);
+            attributes.resize(buffers.size());
+            for (size_t i = 0; i < buffers.size(); ++i) {
+                attributes[i].assign(buffers[i].attributes, buffers[i].attributes + buffers[i].attributeCount);
+                buffers[i].attributes = attributes[i].data();
+            }
+            desc.vertex.buffers = buffers.data();
+
+            if (source.depthStencil) {
+                depthStencil = *source.depthStencil;
+                depthStencil.nextInChain = nullptr;
+                desc.depthStencil = &depthStencil;
+            }
+
+            if (source.fragment) {
+                fragment = *source.fragment;
+                fragment.nextInChain = nullptr;
+                fragmentEntryPoint = source.fragment->entryPoint ? source.fragment->entryPoint : "";
+                fragment.entryPoint = fragmentEntryPoint.c_str();
+                CopyConstants(source.fragment->constantCount, source.fragment->constants, fragmentConstants);
+                fragment.constants = fragmentConstants.data();
+
+                targets.assign(source.fragment->targets, source.fragment->targets + source.fragment->targetCount);
+                blends.resize(targets.size());
+                for (size_t i = 0; i < targets.size(); ++i) {
+                    if (targets[i].blend) {
+                        blends[i] = *targets[i].blend;
+                        targets[i].blend = &blends[i];
+                    }
+                }
+                fragment.targets = targets.data();
+                desc.fragment = &fragment;
+            }
+        }
+
+        void CopyConstants(size_t count, WGPUConstantEntry const* source, std::vector<WGPUConstantEntry>& destination) {
+            destination.assign(source, source + count);
+            for (WGPUConstantEntry& constant : destination) {
+                constantKeys.push_back(constant.key ? constant.key : "");
+                constant.key = constantKeys.back().c_str();
+            }
+        }
+    };
+
+    double MillisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
+
+struct PipelineManager::Entry {
+    std::string name;
+    std::string wgslSource;
+    OwnedRenderPipelineDescriptor descriptor;
+    PipelineHandle fallback = InvalidPipelineHandle;
+
+    // Written by the worker, `pipeline` before `state`
+    WGPURenderPipeline pipeline = nullptr;
+    std::atomic<PipelineState> state{ PipelineState::Pending };
+
+    std::chrono::steady_clock::time_point requestTime;
+    std::chrono::steady_clock::time_point readyTime;
+};
+
+PipelineManager::PipelineManager() = default;
+
+PipelineManager::~PipelineManager()
+{
+    assert(!worker.joinable());
+}
+
+void PipelineManager::Initialize(WGPUDevice device, PipelineCache& cache)
+{
+    this->device = device;
+    this->cache = &cache;
+    stopping = false;
+    worker = std::thread(&PipelineManager::WorkerMain, this);
+}
+
+void PipelineManager::Terminate()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobAvailable.notify_all();
+    if (worker.joinable()) worker.join();
+    // Pipelines are owned by the cache
+    entries.clear();
+}
+
+PipelineHandle PipelineManager::Request(char const* name, char const* wgslSource, WGPURenderPipelineDescriptor const& descriptor, PipelineHandle fallback)
+{
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->name = name ? name : "";
+    entry->wgslSource = wgslSource;
+    entry->descriptor.CopyFrom(descriptor);
+    entry->fallback = fallback;
+    entry->requestTime = std::chrono::steady_clock::now();
+
+    PipelineHandle handle;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.push_back(std::move(entry));
+        handle = (PipelineHandle)(entries.size() - 1);
+        jobs.push_back(handle);
+    }
+    jobAvailable.notify_one();
+    return handle;
+}
+
+WGPURenderPipeline PipelineManager::Resolve(PipelineHandle handle)
+{
+    // Follow the fallback chain until something usable shows up
+    bool substituted = false;
+    while (handle != InvalidPipelineHandle) {
+        Entry& entry = *entries[handle];
+        if (entry.state.load(std::memory_order_acquire) == PipelineState::Ready) {
+            if (substituted) ++fallbackDraws;
+            return entry.pipeline;
+        }
+        handle = entry.fallback;
+        substituted = true;
+    }
+    ++skippedDraws;
+    return nullptr;
+}
+
+PipelineState PipelineManager::GetState(PipelineHandle handle) const
+{
+    return entries[handle]->state.load(std::memory_order_acquire);
+}
+
+double PipelineManager::GetTimeToReadyMs(PipelineHandle handle) const
+{
+    Entry const& entry = *entries[handle];
+    if (entry.state.load(std::memory_order_acquire) == PipelineState::Pending) {
+        return MillisecondsBetween(entry.requestTime, std::chrono::steady_clock::now());
+    }
+    return MillisecondsBetween(entry.requestTime, entry.readyTime);
+}
+
+PipelineManagerStats PipelineManager::GetStats() const
+{
+    PipelineManagerStats stats;
+    for (auto const& entry : entries) {
+        switch (entry->state.load(std::memory_order_acquire)) {
+        case PipelineState::Pending: ++stats.pending; break;
+        case PipelineState::Ready: ++stats.ready; break;
+        case PipelineState::Failed: ++stats.failed; break;
+        }
+    }
+    stats.fallbackDraws = fallbackDraws;
+    stats.skippedDraws = skippedDraws;
+    return stats;
+}
+
+void PipelineManager::WorkerMain()
+{
+    for (;;) {
+        Entry* entry = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            entry = entries[jobs.front()].get();
+            jobs.pop_front();
+        }
+
+        // nullptr if validation failed
+        Finish(*entry, cache->GetRenderPipeline(entry->wgslSource.c_str(), entry->descriptor.desc));
+    }
+}
+
+void PipelineManager::Finish(Entry& entry, WGPURenderPipeline pipeline)
+{
+    entry.readyTime = std::chrono::steady_clock::now();
+    entry.pipeline = pipeline;
+    entry.state.store(pipeline ? PipelineState::Ready : PipelineState::Failed, std::memory_order_release);
+
+    double readyMs = MillisecondsBetween(entry.requestTime, entry.readyTime);
+    if (pipeline) Logger::Info("Pipeline ready", "name", entry.name, "ms", readyMs);
+    else Logger::Error("Pipeline failed", "name", entry.name, "ms", readyMs);
+}
@@ -0,0 +1,135 @@
+#include "../include/RedrawScheduler.h"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <ctime>
+#endif // _WIN32
+
+namespace {
+    // CPU time of all threads of the process. std::clock() is wall time on
+    // MSVC, which would always report one busy core.
+    double ProcessCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+        auto toTicks = [](FILETIME const& time) {
+            return ((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime;
+            };
+        // 100 ns units
+        return (double)(toTicks(kernel) + toTicks(user)) * 1e-7;
+#else
+        timespec time;
+        if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) return 0.0;
+        return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+#endif // _WIN32
+    }
+}
+
+void RedrawScheduler::Initialize(bool onDemand, double busyPollMs)
+{
+    this->onDemand = onDemand;
+    busyPoll = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(busyPollMs));
+    mainThread = std::this_thread::get_id();
+    invalidated = true;
+    hasLastInputs = false;
+    start = Clock::now();
+    cpuStart = ProcessCpuSeconds();
+    stats = {};
+}
+
+void RedrawScheduler::Invalidate()
+{
+    invalidated.store(true, std::memory_order_release);
+    // The main thread checks the flag before it waits
+    if (onDemand && std::this_thread::get_id() != mainThread) glfwPostEmptyEvent();
+}
+
+void RedrawScheduler::BeginAnimation()
+{
+    animations.fetch_add(1, std::memory_order_relaxed);
+    Invalidate();
+}
+
+void RedrawScheduler::EndAnimation()
+{
+    animations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void RedrawScheduler::ScheduleRedraw(Clock::time_point when)
+{
+    timers.push(when);
+}
+
+bool RedrawScheduler::IsFrameDue() const
+{
+    if (invalidated.load(std::memory_order_acquire) || animations.load(std::memory_order_relaxed) > 0) return true;
+    return !timers.empty() && timers.top() <= Clock::now();
+}
+
+void RedrawScheduler::WaitEvents()
+{
+    if (!onDemand || IsFrameDue()) {
+        glfwPollEvents();
+        return;
+    }
+
+    Clock::time_point waitStart = Clock::now();
+    Clock::time_point deadline = timers.empty() ? Clock::time_point::max() : timers.top();
+    if (busy) deadline = std::min(deadline, waitStart + busyPoll);
+    if (deadline == Clock::time_point::max()) {
+        glfwWaitEvents();
+    }
+    else {
+        glfwWaitEventsTimeout(std::chrono::duration<double>(deadline - waitStart).count());
+    }
+    stats.waitSeconds += std::chrono::duration<double>(Clock::now() - waitStart).count();
+    ++stats.wakeups;
+}
+
+bool RedrawScheduler::ShouldRender(uint64_t frameInputs)
+{
+    bool timerDue = false;
+    Clock::time_point now = Clock::now();
+    while (!timers.empty() && timers.top() <= now) {
+        timers.pop();
+        timerDue = true;
+    }
+    bool wasInvalidated = invalidated.exchange(false, std::memory_order_acq_rel);
+    bool damaged = !hasLastInputs || frameInputs != lastInputs;
+
+    bool render = !onDemand || wasInvalidated || timerDue || damaged || animations.load(std::memory_order_relaxed) > 0;
+    if (!render) {
+        ++stats.framesSkipped;
+        return false;
+    }
+    lastInputs = frameInputs;
+    hasLastInputs = true;
+    ++stats.framesRendered;
+    return true;
+}
+
+RedrawSchedulerStats RedrawScheduler::GetStats() const
+{
+    RedrawSchedulerStats result = stats;
+    result.wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double cpuSeconds = ProcessCpuSeconds() - cpuStart;
+    result.cpuUsage = result.wallSeconds > 0.0 ? cpuSeconds / result.wallSeconds : 0.0;
+    return result;
+}
+
+uint64_t RedrawScheduler::Hash(void const* data, size_t size, uint64_t hash)
+{
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
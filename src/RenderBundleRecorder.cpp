@@ -0,0 +1,168 @@
+#include "../include/RenderBundleRecorder.h"
+#include "../include/GpuHandle.h"
+#include "../include/JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    // FNV-1a over the raw draw items, which hold only handles and integers
+    uint64_t HashDraws(DrawItem const* draws, size_t drawCount, RenderBundleFormat const& format)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](void const* data, size_t size) {
+            uint8_t const* bytes = static_cast<uint8_t const*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            };
+        mix(&format.colorFormat, sizeof(format.colorFormat));
+        mix(&format.depthStencilFormat, sizeof(format.depthStencilFormat));
+        mix(&drawCount, sizeof(drawCount));
+        for (size_t i = 0; i < drawCount; ++i) {
+            DrawItem const& draw = draws[i];
+            mix(&draw.pipeline, sizeof(draw.pipeline));
+            mix(&draw.bindGroup, sizeof(draw.bindGroup));
+            mix(&draw.vertexBuffer, sizeof(draw.vertexBuffer));
+            mix(&draw.vertexOffset, sizeof(draw.vertexOffset));
+            mix(&draw.vertexSize, sizeof(draw.vertexSize));
+            mix(&draw.indexBuffer, sizeof(draw.indexBuffer));
+            mix(&draw.indexFormat, sizeof(draw.indexFormat));
+            mix(&draw.indexOffset, sizeof(draw.indexOffset));
+            mix(&draw.indexSize, sizeof(draw.indexSize));
+            mix(&draw.count, sizeof(draw.count));
+            mix(&draw.instanceCount, sizeof(draw.instanceCount));
+            mix(&draw.first, sizeof(draw.first));
+            mix(&draw.firstInstance, sizeof(draw.firstInstance));
+            mix(&draw.indirectBuffer, sizeof(draw.indirectBuffer));
+            mix(&draw.indirectOffset, sizeof(draw.indirectOffset));
+        }
+        return hash;
+    }
+}
+
+void RenderBundleRecorder::Initialize(WGPUDevice device, JobSystem& jobSystem)
+{
+    this->device = device;
+    this->jobSystem = &jobSystem;
+}
+
+void RenderBundleRecorder::Terminate()
+{
+    for (auto& entry : staticBundles) {
+        for (WGPURenderBundle bundle : entry.second.bundles) wgpuRenderBundleRelease(bundle);
+    }
+    staticBundles.clear();
+}
+
+void RenderBundleRecorder::BeginFrame()
+{
+    stats = {};
+}
+
+WGPURenderBundle RenderBundleRecorder::RecordSlice(Slice const& slice) const
+{
+    WGPURenderBundleEncoderDescriptor encoderDesc = {};
+    encoderDesc.nextInChain = nullptr;
+    encoderDesc.label = "Draw list slice";
+    encoderDesc.colorFormatCount = 1;
+    encoderDesc.colorFormats = &slice.format.colorFormat;
+    encoderDesc.depthStencilFormat = slice.format.depthStencilFormat;
+    encoderDesc.sampleCount = 1;
+    encoderDesc.depthReadOnly = false;
+    encoderDesc.stencilReadOnly = false;
+    WGPURenderBundleEncoder encoder = wgpuDeviceCreateRenderBundleEncoder(device, &encoderDesc);
+
+    // Skip redundant state changes between consecutive draws
+    WGPURenderPipeline pipeline = nullptr;
+    WGPUBindGroup bindGroup = nullptr;
+    WGPUBuffer vertexBuffer = nullptr;
+    uint64_t vertexOffset = 0;
+    WGPUBuffer indexBuffer = nullptr;
+    uint64_t indexOffset = 0;
+
+    for (size_t i = 0; i < slice.drawCount; ++i) {
+        DrawItem const& draw = slice.draws[i];
+        if (draw.pipeline != pipeline) {
+            pipeline = draw.pipeline;
+            wgpuRenderBundleEncoderSetPipeline(encoder, pipeline);
+        }
+        if (draw.bindGroup && draw.bindGroup != bindGroup) {
+            bindGroup = draw.bindGroup;
+            wgpuRenderBundleEncoderSetBindGroup(encoder, 0, bindGroup, 0, nullptr);
+        }
+        if (draw.vertexBuffer && (draw.vertexBuffer != vertexBuffer || draw.vertexOffset != vertexOffset)) {
+            vertexBuffer = draw.vertexBuffer;
+            vertexOffset = draw.vertexOffset;
+            wgpuRenderBundleEncoderSetVertexBuffer(encoder, 0, vertexBuffer, vertexOffset, draw.vertexSize);
+        }
+
+        if (draw.indexBuffer) {
+            if (draw.indexBuffer != indexBuffer || draw.indexOffset != indexOffset) {
+                indexBuffer = draw.indexBuffer;
+                indexOffset = draw.indexOffset;
+                wgpuRenderBundleEncoderSetIndexBuffer(encoder, indexBuffer, draw.indexFormat, indexOffset, draw.indexSize);
+            }
+            if (draw.indirectBuffer) wgpuRenderBundleEncoderDrawIndexedIndirect(encoder, draw.indirectBuffer, draw.indirectOffset);
+            else wgpuRenderBundleEncoderDrawIndexed(encoder, draw.count, draw.instanceCount, draw.first, 0, draw.firstInstance);
+        }
+        else {
+            if (draw.indirectBuffer) wgpuRenderBundleEncoderDrawIndirect(encoder, draw.indirectBuffer, draw.indirectOffset);
+            else wgpuRenderBundleEncoderDraw(encoder, draw.count, draw.instanceCount, draw.first, draw.firstInstance);
+        }
+    }
+
+    WGPURenderBundleDescriptor bundleDesc = {};
+    bundleDesc.nextInChain = nullptr;
+    bundleDesc.label = "Draw list slice";
+    WGPURenderBundle bundle = wgpuRenderBundleEncoderFinish(encoder, &bundleDesc);
+    wgpuRenderBundleEncoderRelease(encoder);
+    return bundle;
+}
+
+void RenderBundleRecorder::Record(DrawItem const* draws, size_t drawCount, RenderBundleFormat const& format, std::vector<WGPURenderBundle>& bundles)
+{
+    if (drawCount == 0) return;
+    auto recordStart = std::chrono::steady_clock::now();
+
+    size_t sliceCount = (drawCount + MinDrawsPerSlice - 1) / MinDrawsPerSlice;
+    sliceCount = std::min<size_t>(sliceCount, jobSystem->GetThreadCount());
+    size_t drawsPerSlice = (drawCount + sliceCount - 1) / sliceCount;
+
+    slices.assign(sliceCount, Slice());
+    for (size_t i = 0; i < sliceCount; ++i) {
+        Slice& slice = slices[i];
+        slice.draws = draws + i * drawsPerSlice;
+        slice.drawCount = std::min(drawsPerSlice, drawCount - i * drawsPerSlice);
+        slice.format = format;
+    }
+
+    // A single slice is recorded right here
+    jobSystem->ParallelFor(0, sliceCount, 1, [this](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) slices[i].bundle = RecordSlice(slices[i]);
+        });
+
+    for (Slice const& slice : slices) bundles.push_back(slice.bundle);
+
+    stats.bundlesRecorded += (uint32_t)sliceCount;
+    stats.drawsRecorded += (uint32_t)drawCount;
+    stats.recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+}
+
+std::vector<WGPURenderBundle> const& RenderBundleRecorder::GetStaticBundles(char const* name, DrawItem const* draws, size_t drawCount, RenderBundleFormat const& format)
+{
+    StaticBundles& entry = staticBundles[name];
+    uint64_t hash = HashDraws(draws, drawCount, format);
+    if (hash == entry.hash && !entry.bundles.empty()) {
+        stats.bundlesReused += (uint32_t)entry.bundles.size();
+        return entry.bundles;
+    }
+
+    // Released once the frames in flight that replay them are done
+    for (WGPURenderBundle bundle : entry.bundles) GpuDeferRelease(bundle);
+    entry.bundles.clear();
+    entry.hash = hash;
+    Record(draws, drawCount, format, entry.bundles);
+    return entry.bundles;
+}
@@ -0,0 +1,455 @@
+#include "../include/RenderGraph.h"
+#include "../include/GpuProfiler.h"
+
+#include <webgpu/webgpu.h>
+#ifdef WEBGPU_BACKEND_WGPU
+#  include <webgpu/wgpu.h>
+#endif // WEBGPU_BACKEND_WGPU
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace {
+    double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void RenderGraph::Initialize(WGPUDevice device)
+{
+    this->device = device;
+}
+
+void RenderGraph::Terminate()
+{
+    Reset();
+    for (PhysicalTexture& physical : pool) {
+        wgpuTextureViewRelease(physical.view);
+        wgpuTextureDestroy(physical.texture);
+        wgpuTextureRelease(physical.texture);
+    }
+    pool.clear();
+}
+
+void RenderGraph::Reset()
+{
+    passes.clear();
+    resources.clear();
+    batches.clear();
+}
+
+RenderGraphResource RenderGraph::ImportTexture(char const* name, WGPUTextureView view, RenderGraphTextureDesc const& desc)
+{
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.imported = true;
+    resource.importedView = view;
+    resources.push_back(resource);
+    return (RenderGraphResource)(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateTexture(char const* name, RenderGraphTextureDesc const& desc)
+{
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resources.push_back(resource);
+    return (RenderGraphResource)(resources.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(char const* name, RenderGraphPassType type, RenderGraphExecute execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.type = type;
+    pass.execute = std::move(execute);
+    passes.push_back(std::move(pass));
+    return (uint32_t)(passes.size() - 1);
+}
+
+void RenderGraph::SetColorAttachment(uint32_t pass, RenderGraphResource texture, WGPULoadOp loadOp, WGPUColor clearValue)
+{
+    assert(passes[pass].type == RenderGraphPassType::Render);
+    Attachment attachment;
+    attachment.texture = texture;
+    attachment.loadOp = loadOp;
+    attachment.clearValue = clearValue;
+    passes[pass].colorAttachments.push_back(attachment);
+}
+
+void RenderGraph::SetDepthAttachment(uint32_t pass, RenderGraphResource texture, WGPULoadOp loadOp, float clearDepth)
+{
+    assert(passes[pass].type == RenderGraphPassType::Render);
+    Attachment& attachment = passes[pass].depthAttachment;
+    attachment.texture = texture;
+    attachment.loadOp = loadOp;
+    attachment.clearDepth = clearDepth;
+}
+
+void RenderGraph::Read(uint32_t pass, RenderGraphResource texture)
+{
+    passes[pass].reads.push_back(texture);
+}
+
+void RenderGraph::Write(uint32_t pass, RenderGraphResource texture)
+{
+    passes[pass].writes.push_back(texture);
+}
+
+void RenderGraph::SetSideEffects(uint32_t pass)
+{
+    passes[pass].sideEffects = true;
+}
+
+bool RenderGraph::Compile()
+{
+    auto compileStart = std::chrono::steady_clock::now();
+
+    // Nothing of the previous frame survives a failed Compile()
+    stats = RenderGraphStats();
+    stats.declaredPasses = (uint32_t)passes.size();
+
+    CullPasses();
+    ComputeLifetimes();
+    AliasTransients();
+    BuildBatches();
+
+    stats.compileMs = MillisecondsSince(compileStart);
+    return !batches.empty();
+}
+
+void RenderGraph::CullPasses()
+{
+    // Reference counting: a pass lives as long as one of its outputs is read
+    // by a living pass or is imported. Loading an attachment reads what the
+    // previous writer left in it, so it references that pass, not the texture:
+    // otherwise the loading pass would keep itself alive.
+    for (Resource& resource : resources) {
+        resource.refCount = resource.imported ? 1 : 0;
+    }
+    lastWriters.assign(resources.size(), ~0u);
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        Pass& pass = passes[i];
+        pass.culled = false;
+        pass.refCount = (uint32_t)(pass.writes.size() + pass.colorAttachments.size());
+        if (pass.depthAttachment.texture != InvalidRenderGraphResource) ++pass.refCount;
+        if (pass.sideEffects) ++pass.refCount;
+
+        for (RenderGraphResource read : pass.reads) ++resources[read].refCount;
+
+        pass.loadedFrom.clear();
+        auto load = [this, &pass](Attachment const& attachment) {
+            if (attachment.loadOp != WGPULoadOp_Load) return;
+            uint32_t producer = lastWriters[attachment.texture];
+            if (producer == ~0u) return;
+            ++passes[producer].refCount;
+            pass.loadedFrom.push_back(producer);
+            };
+        for (Attachment const& attachment : pass.colorAttachments) load(attachment);
+        if (pass.depthAttachment.texture != InvalidRenderGraphResource) load(pass.depthAttachment);
+
+        for (RenderGraphResource write : pass.writes) lastWriters[write] = i;
+        for (Attachment const& attachment : pass.colorAttachments) lastWriters[attachment.texture] = i;
+        if (pass.depthAttachment.texture != InvalidRenderGraphResource) lastWriters[pass.depthAttachment.texture] = i;
+    }
+
+    // Culled passes go on culledStack until they released what they read
+    culledStack.clear();
+    auto cull = [this](uint32_t index) {
+        passes[index].culled = true;
+        ++stats.culledPasses;
+        culledStack.push_back(index);
+        };
+
+    // Every resource goes on the stack once: the unread ones now, the others
+    // when a culled pass drops their last reader
+    cullStack.clear();
+    for (RenderGraphResource texture = 0; texture < resources.size(); ++texture) {
+        if (resources[texture].refCount == 0) cullStack.push_back(texture);
+    }
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        if (passes[i].refCount == 0) cull(i);
+    }
+
+    while (!cullStack.empty() || !culledStack.empty()) {
+        if (!culledStack.empty()) {
+            Pass const& pass = passes[culledStack.back()];
+            culledStack.pop_back();
+            for (RenderGraphResource read : pass.reads) {
+                if (--resources[read].refCount == 0) cullStack.push_back(read);
+            }
+            for (uint32_t producer : pass.loadedFrom) {
+                if (--passes[producer].refCount == 0) cull(producer);
+            }
+            continue;
+        }
+
+        RenderGraphResource texture = cullStack.back();
+        cullStack.pop_back();
+
+        for (uint32_t i = 0; i < passes.size(); ++i) {
+            Pass& pass = passes[i];
+            if (pass.culled) continue;
+            bool writes = std::find(pass.writes.begin(), pass.writes.end(), texture) != pass.writes.end()
+                || IsAttachmentOf(pass, texture);
+            if (!writes) continue;
+            if (--pass.refCount == 0) cull(i);
+        }
+    }
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+    for (Resource& resource : resources) {
+        resource.firstUse = ~0u;
+        resource.lastUse = 0;
+        resource.lastRead = 0;
+        resource.read = false;
+        resource.physical = ~0u;
+    }
+
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        Pass const& pass = passes[i];
+        if (pass.culled) continue;
+
+        auto use = [this, i](RenderGraphResource texture, bool read) {
+            Resource& resource = resources[texture];
+            resource.firstUse = std::min(resource.firstUse, i);
+            resource.lastUse = std::max(resource.lastUse, i);
+            if (read) {
+                resource.read = true;
+                resource.lastRead = std::max(resource.lastRead, i);
+            }
+            };
+        for (RenderGraphResource read : pass.reads) use(read, true);
+        for (RenderGraphResource write : pass.writes) use(write, false);
+        for (Attachment const& attachment : pass.colorAttachments) {
+            use(attachment.texture, attachment.loadOp == WGPULoadOp_Load);
+        }
+        if (pass.depthAttachment.texture != InvalidRenderGraphResource) {
+            use(pass.depthAttachment.texture, pass.depthAttachment.loadOp == WGPULoadOp_Load);
+        }
+    }
+}
+
+void RenderGraph::AliasTransients()
+{
+    for (PhysicalTexture& physical : pool) {
+        physical.busyUntil = ~0u;
+    }
+
+    // Hand out physical textures in order of first use so that a texture
+    // whose last user already ran can be taken over by a later one
+    cullStack.clear();
+    for (RenderGraphResource texture = 0; texture < resources.size(); ++texture) {
+        Resource const& resource = resources[texture];
+        if (!resource.imported && resource.firstUse != ~0u) cullStack.push_back(texture);
+    }
+    std::sort(cullStack.begin(), cullStack.end(), [this](RenderGraphResource a, RenderGraphResource b) {
+        return resources[a].firstUse < resources[b].firstUse;
+        });
+
+    for (RenderGraphResource texture : cullStack) {
+        Resource& resource = resources[texture];
+        resource.physical = AcquirePhysical(resource.desc, resource.firstUse, resource.lastUse);
+        ++stats.transientTextures;
+    }
+
+    for (PhysicalTexture const& physical : pool) {
+        if (physical.busyUntil != ~0u) ++stats.physicalTextures;
+    }
+}
+
+uint32_t RenderGraph::AcquirePhysical(RenderGraphTextureDesc const& desc, uint32_t firstUse, uint32_t lastUse)
+{
+    for (uint32_t i = 0; i < pool.size(); ++i) {
+        PhysicalTexture& physical = pool[i];
+        bool free = physical.busyUntil == ~0u || physical.busyUntil < firstUse;
+        if (free && physical.desc == desc) {
+            physical.busyUntil = lastUse;
+            return i;
+        }
+    }
+
+    PhysicalTexture physical;
+    physical.desc = desc;
+    physical.busyUntil = lastUse;
+
+    WGPUTextureDescriptor textureDesc = {};
+    textureDesc.nextInChain = nullptr;
+    textureDesc.label = "Render graph transient texture";
+    textureDesc.usage = desc.usage;
+    textureDesc.dimension = WGPUTextureDimension_2D;
+    textureDesc.size = { desc.width, desc.height, 1 };
+    textureDesc.format = desc.format;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount = 1;
+    textureDesc.viewFormatCount = 0;
+    textureDesc.viewFormats = nullptr;
+    physical.texture = wgpuDeviceCreateTexture(device, &textureDesc);
+
+    WGPUTextureViewDescriptor viewDescriptor = {};
+    viewDescriptor.nextInChain = nullptr;
+    viewDescriptor.label = "Render graph transient view";
+    viewDescriptor.format = desc.format;
+    viewDescriptor.dimension = WGPUTextureViewDimension_2D;
+    viewDescriptor.baseMipLevel = 0;
+    viewDescriptor.mipLevelCount = 1;
+    viewDescriptor.baseArrayLayer = 0;
+    viewDescriptor.arrayLayerCount = 1;
+    viewDescriptor.aspect = WGPUTextureAspect_All;
+    physical.view = wgpuTextureCreateView(physical.texture, &viewDescriptor);
+
+    pool.push_back(physical);
+    return (uint32_t)(pool.size() - 1);
+}
+
+bool RenderGraph::IsAttachmentOf(Pass const& pass, RenderGraphResource texture) const
+{
+    if (pass.depthAttachment.texture == texture) return true;
+    for (Attachment const& attachment : pass.colorAttachments) {
+        if (attachment.texture == texture) return true;
+    }
+    return false;
+}
+
+bool RenderGraph::CanMerge(Batch const& batch, Pass const& pass) const
+{
+    if (batch.type != RenderGraphPassType::Render || pass.type != RenderGraphPassType::Render) return false;
+
+    // Same targets, and the pass continues what the batch already drew
+    Pass const& first = passes[batch.passes.front()];
+    if (first.colorAttachments.size() != pass.colorAttachments.size()) return false;
+    if (first.depthAttachment.texture != pass.depthAttachment.texture) return false;
+    if (pass.depthAttachment.texture != InvalidRenderGraphResource && pass.depthAttachment.loadOp != WGPULoadOp_Load) return false;
+    for (size_t i = 0; i < pass.colorAttachments.size(); ++i) {
+        if (first.colorAttachments[i].texture != pass.colorAttachments[i].texture) return false;
+        if (pass.colorAttachments[i].loadOp != WGPULoadOp_Load) return false;
+    }
+
+    // A pass sampling one of the attachments needs the previous pass ended
+    for (RenderGraphResource read : pass.reads) {
+        if (IsAttachmentOf(first, read)) return false;
+    }
+    return true;
+}
+
+void RenderGraph::BuildBatches()
+{
+    batches.clear();
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        Pass const& pass = passes[i];
+        if (pass.culled) continue;
+
+        if (!batches.empty() && CanMerge(batches.back(), pass)) {
+            batches.back().passes.push_back(i);
+            ++stats.mergedPasses;
+            continue;
+        }
+
+        Batch batch;
+        batch.type = pass.type;
+        batch.passes.push_back(i);
+        batches.push_back(std::move(batch));
+    }
+}
+
+WGPUStoreOp RenderGraph::StoreOpFor(RenderGraphResource texture, uint32_t batchEnd) const
+{
+    Resource const& resource = resources[texture];
+    if (resource.imported) return WGPUStoreOp_Store;
+    if (resource.read && resource.lastRead > batchEnd) return WGPUStoreOp_Store;
+    return WGPUStoreOp_Discard;
+}
+
+WGPUTextureView RenderGraph::GetTextureView(RenderGraphResource texture) const
+{
+    Resource const& resource = resources[texture];
+    if (resource.imported) return resource.importedView;
+    if (resource.physical == ~0u) return nullptr;
+    return pool[resource.physical].view;
+}
+
+void RenderGraph::Execute(WGPUCommandEncoder encoder)
+{
+    auto executeStart = std::chrono::steady_clock::now();
+    stats.encoderPasses = 0;
+
+    for (Batch const& batch : batches) {
+        Pass const& first = passes[batch.passes.front()];
+        uint32_t batchEnd = batch.passes.back();
+        RenderGraphPassContext context;
+
+        if (batch.type == RenderGraphPassType::Compute) {
+            WGPUComputePassDescriptor computePassDesc = {};
+            computePassDesc.nextInChain = nullptr;
+            computePassDesc.label = first.name;
+            computePassDesc.timestampWrites = profiler ? profiler->ComputePassWrites(first.name) : nullptr;
+            context.computePass = wgpuCommandEncoderBeginComputePass(encoder, &computePassDesc);
+            ++stats.encoderPasses;
+
+            for (uint32_t pass : batch.passes) {
+                if (passes[pass].execute) passes[pass].execute(context);
+            }
+
+            wgpuComputePassEncoderEnd(context.computePass);
+            wgpuComputePassEncoderRelease(context.computePass);
+            continue;
+        }
+
+        colorAttachments.clear();
+        for (Attachment const& attachment : first.colorAttachments) {
+            WGPURenderPassColorAttachment renderPassColorAttachment = {};
+            renderPassColorAttachment.view = GetTextureView(attachment.texture);
+            renderPassColorAttachment.resolveTarget = nullptr;
+            renderPassColorAttachment.loadOp = attachment.loadOp;
+            renderPassColorAttachment.storeOp = StoreOpFor(attachment.texture, batchEnd);
+            renderPassColorAttachment.clearValue = attachment.clearValue;
+#ifndef WEBGPU_BACKEND_WGPU
+            renderPassColorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+            colorAttachments.push_back(renderPassColorAttachment);
+        }
+
+        WGPURenderPassDepthStencilAttachment depthStencilAttachment = {};
+        bool hasDepth = first.depthAttachment.texture != InvalidRenderGraphResource;
+        if (hasDepth) {
+            depthStencilAttachment.view = GetTextureView(first.depthAttachment.texture);
+            depthStencilAttachment.depthLoadOp = first.depthAttachment.loadOp;
+            depthStencilAttachment.depthStoreOp = StoreOpFor(first.depthAttachment.texture, batchEnd);
+            depthStencilAttachment.depthClearValue = first.depthAttachment.clearDepth;
+            depthStencilAttachment.depthReadOnly = false;
+#ifdef WEBGPU_BACKEND_WGPU
+            depthStencilAttachment.stencilLoadOp = WGPULoadOp_Clear;
+            depthStencilAttachment.stencilStoreOp = WGPUStoreOp_Store;
+#else
+            depthStencilAttachment.stencilLoadOp = WGPULoadOp_Undefined;
+            depthStencilAttachment.stencilStoreOp = WGPUStoreOp_Undefined;
+#endif // WEBGPU_BACKEND_WGPU
+            depthStencilAttachment.stencilClearValue = 0;
+            depthStencilAttachment.stencilReadOnly = true;
+        }
+
+        WGPURenderPassDescriptor renderPassDesc = {};
+        renderPassDesc.nextInChain = nullptr;
+        renderPassDesc.label = first.name;
+        renderPassDesc.colorAttachmentCount = colorAttachments.size();
+        renderPassDesc.colorAttachments = colorAttachments.data();
+        renderPassDesc.depthStencilAttachment = hasDepth ? &depthStencilAttachment : nullptr;
+        renderPassDesc.timestampWrites = profiler ? profiler->RenderPassWrites(first.name) : nullptr;
+
+        context.renderPass = wgpuCommandEncoderBeginRenderPass(encoder, &renderPassDesc);
+        ++stats.encoderPasses;
+
+        for (uint32_t pass : batch.passes) {
+            if (passes[pass].execute) passes[pass].execute(context);
+        }
+
+        wgpuRenderPassEncoderEnd(context.renderPass);
+        wgpuRenderPassEncoderRelease(context.renderPass);
+    }
+
+    stats.executeMs = MillisecondsSince(executeStart);
+}
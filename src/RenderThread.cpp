@@ -0,0 +1,101 @@
+#include "../include/RenderThread.h"
+#include "../include/CpuProfiler.h"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+bool InputEventQueue::Push(InputEvent const& event)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+    events[t % Capacity] = event;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputEventQueue::Pop(InputEvent& event)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    event = events[h % Capacity];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+void RenderThread::Start(std::function<bool()> frame)
+{
+    stopping = false;
+    finished = false;
+    thread = std::thread(&RenderThread::ThreadMain, this, std::move(frame));
+}
+
+void RenderThread::Stop()
+{
+    if (!thread.joinable()) return;
+    stopping.store(true, std::memory_order_release);
+    thread.join();
+    renderThreadId.store(std::thread::id(), std::memory_order_relaxed);
+}
+
+void RenderThread::ThreadMain(std::function<bool()> frame)
+{
+    renderThreadId.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    CpuProfiler::SetThreadName("Render");
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (!frame()) break;
+    }
+    finished.store(true, std::memory_order_release);
+    // The main thread may be blocked in glfwWaitEvents
+    glfwPostEmptyEvent();
+}
+
+void RenderThread::PushEvent(InputEvent const& event)
+{
+    ++eventsPushed;
+    if (!events.Push(event)) ++eventsDropped;
+}
+
+void RenderThread::PublishWindowState(WindowState const& state)
+{
+    windowState.GetWriteSlot() = state;
+    windowState.Publish();
+    ++snapshotsPublished;
+}
+
+bool RenderThread::PopEvent(InputEvent& event)
+{
+    if (!events.Pop(event)) return false;
+    unsubmitted.push_back(event.time);
+    return true;
+}
+
+bool RenderThread::AcquireWindowState(WindowState& state)
+{
+    if (!windowState.Acquire()) return false;
+    state = windowState.GetReadSlot();
+    ++renderStats.snapshotsAcquired;
+    return true;
+}
+
+void RenderThread::MarkSubmitted()
+{
+    if (unsubmitted.empty()) return;
+    Clock::time_point now = Clock::now();
+    for (Clock::time_point received : unsubmitted) {
+        double latencyMs = std::chrono::duration<double, std::milli>(now - received).count();
+        latencySumMs += latencyMs;
+        renderStats.worstLatencyMs = std::max(renderStats.worstLatencyMs, latencyMs);
+        ++renderStats.latencySamples;
+    }
+    unsubmitted.clear();
+}
+
+RenderThreadStats RenderThread::GetStats() const
+{
+    RenderThreadStats result = renderStats;
+    result.eventsPushed = eventsPushed;
+    result.eventsDropped = eventsDropped;
+    result.snapshotsPublished = snapshotsPublished;
+    result.averageLatencyMs = result.latencySamples > 0 ? latencySumMs / result.latencySamples : 0.0;
+    return result;
+}
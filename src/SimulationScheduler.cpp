@@ -0,0 +1,110 @@
+#include "../include/SimulationScheduler.h"
+#include "../include/CpuProfiler.h"
+
+#include <algorithm>
+#include <bit>
+
+void SimulationScheduler::Start(TickFunction tick, double ticksPerSecond, uint32_t maxCatchUpTicks, SimulationState const& initial)
+{
+    this->tick = std::move(tick);
+    step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ticksPerSecond));
+    this->maxCatchUpTicks = std::max(maxCatchUpTicks, 1u);
+    stopping = false;
+    stats = {};
+    tickSumMs = 0.0;
+
+    // Something to sample before the first tick
+    Snapshot& snapshot = snapshots.GetWriteSlot();
+    snapshot.previous = initial;
+    snapshot.current = initial;
+    snapshot.currentTime = Clock::now();
+    snapshots.Publish();
+
+    thread = std::thread(&SimulationScheduler::ThreadMain, this, initial);
+}
+
+void SimulationScheduler::Stop()
+{
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    thread.join();
+}
+
+void SimulationScheduler::ThreadMain(SimulationState state)
+{
+    CpuProfiler::SetThreadName("Simulation");
+    double const dt = std::chrono::duration<double>(step).count();
+    Clock::time_point due = Clock::now() + step;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wakeUp.wait_until(lock, due, [this]() { return stopping; })) {
+        lock.unlock();
+
+        // Every tick due by now, but never more than the cap in a burst: the
+        // time of the others is dropped
+        Clock::time_point now = Clock::now();
+        uint64_t pending = 1 + (uint64_t)((now - due) / step);
+        uint64_t dropped = pending > maxCatchUpTicks ? pending - maxCatchUpTicks : 0;
+        due += step * dropped;
+        pending -= dropped;
+
+        for (uint64_t i = 0; i < pending; ++i) {
+            SimulationState previous = state;
+            Clock::time_point tickStart = Clock::now();
+            {
+                CPU_ZONE("Simulation tick");
+                tick(state, dt);
+            }
+            ++state.tick;
+            state.time += dt;
+            double tickMs = std::chrono::duration<double, std::milli>(Clock::now() - tickStart).count();
+
+            Snapshot& snapshot = snapshots.GetWriteSlot();
+            snapshot.previous = previous;
+            snapshot.current = state;
+            snapshot.currentTime = due;
+            snapshots.Publish();
+            due += step;
+
+            std::lock_guard<std::mutex> statsLock(mutex);
+            ++stats.ticks;
+            if (i > 0) ++stats.catchUpTicks;
+            tickSumMs += tickMs;
+            stats.worstTickMs = std::max(stats.worstTickMs, tickMs);
+            uint64_t microseconds = (uint64_t)(tickMs * 1000.0);
+            size_t bucket = microseconds > 0 ? (size_t)std::bit_width(microseconds) - 1 : 0;
+            ++stats.tickHistogram[std::min(bucket, SimulationStats::HistogramBuckets - 1)];
+        }
+        lock.lock();
+        stats.droppedTicks += dropped;
+    }
+}
+
+SimulationState SimulationScheduler::Sample()
+{
+    if (snapshots.Acquire()) sampled = snapshots.GetReadSlot();
+    double alpha = std::chrono::duration<double>(Clock::now() - sampled.currentTime) / std::chrono::duration<double>(step);
+    return Interpolate(sampled.previous, sampled.current, (float)std::clamp(alpha, 0.0, 1.0));
+}
+
+SimulationStats SimulationScheduler::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    SimulationStats result = stats;
+    result.averageTickMs = stats.ticks > 0 ? tickSumMs / stats.ticks : 0.0;
+    return result;
+}
+
+SimulationState SimulationScheduler::Interpolate(SimulationState const& previous, SimulationState const& current, float alpha)
+{
+    SimulationState result = current;
+    result.time = previous.time + (current.time - previous.time) * alpha;
+    for (int i = 0; i < 4; ++i) {
+        result.clearColor[i] = previous.clearColor[i] + (current.clearColor[i] - previous.clearColor[i]) * alpha;
+    }
+    return result;
+}
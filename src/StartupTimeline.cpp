@@ -0,0 +1,62 @@
+#include "../include/StartupTimeline.h"
+
+#include <iomanip>
+#include <sstream>
+
+StartupTimeline::StartupTimeline()
+    : origin(std::chrono::steady_clock::now())
+{
+    phases.reserve(32);
+}
+
+uint32_t StartupTimeline::Begin(char const* phase)
+{
+    Phase entry;
+    entry.name = phase;
+    entry.thread = std::this_thread::get_id();
+    entry.beginMs = ElapsedMs();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    phases.push_back(entry);
+    return (uint32_t)(phases.size() - 1);
+}
+
+void StartupTimeline::End(uint32_t phase)
+{
+    double endMs = ElapsedMs();
+    std::lock_guard<std::mutex> lock(mutex);
+    phases[phase].endMs = endMs;
+}
+
+double StartupTimeline::ElapsedMs() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void StartupTimeline::Report(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Number threads in order of appearance rather than printing raw ids
+    std::vector<std::thread::id> threads;
+    double totalMs = 0.0;
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "Startup timeline (ms):\n";
+    for (Phase const& phase : phases) {
+        size_t thread = 0;
+        while (thread < threads.size() && threads[thread] != phase.thread) ++thread;
+        if (thread == threads.size()) threads.push_back(phase.thread);
+
+        double endMs = phase.endMs < 0.0 ? phase.beginMs : phase.endMs;
+        if (endMs > totalMs) totalMs = endMs;
+
+        report << "  [thread " << thread << "] "
+            << std::setw(8) << phase.beginMs << " -> " << std::setw(8) << endMs
+            << "  " << std::setw(8) << (endMs - phase.beginMs) << "  " << phase.name << '\n';
+    }
+    report << "startup_total_ms=" << totalMs << '\n';
+
+    out << report.str() << std::flush;
+}
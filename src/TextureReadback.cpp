@@ -0,0 +1,159 @@
+#include "../include/TextureReadback.h"
+
+#include <webgpu/webgpu.h>
+#ifdef WEBGPU_BACKEND_WGPU
+#  include <webgpu/wgpu.h>
+#endif // WEBGPU_BACKEND_WGPU
+
+TextureReadback::TextureReadback() = default;
+TextureReadback::~TextureReadback() = default;
+
+bool TextureReadback::Initialize(WGPUDevice device, uint32_t width, uint32_t height, WGPUTextureFormat format, uint32_t bufferCount)
+{
+    this->device = device;
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    // Copies need rows aligned to 256 bytes
+    bytesPerRow = (width * 4 + 255) & ~255u;
+    stats = {};
+
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.nextInChain = nullptr;
+    bufferDesc.label = "Texture readback";
+    bufferDesc.usage = WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst;
+    bufferDesc.size = (uint64_t)bytesPerRow * height;
+    bufferDesc.mappedAtCreation = false;
+    for (uint32_t i = 0; i < bufferCount; ++i) {
+        std::unique_ptr<Slot> slot(new Slot());
+        slot->buffer = wgpuDeviceCreateBuffer(device, &bufferDesc);
+        if (!slot->buffer) {
+            Terminate();
+            return false;
+        }
+        slots.push_back(std::move(slot));
+    }
+    return true;
+}
+
+void TextureReadback::Terminate()
+{
+    // Pending map callbacks reference the slots: let them land first
+    while (!inFlight.empty()) {
+        Slot& slot = *inFlight.front();
+        SlotState state = slot.state.load(std::memory_order_acquire);
+        if (state == SlotState::Mapping) {
+            PollDevice();
+            continue;
+        }
+        if (state == SlotState::Mapped) wgpuBufferUnmap(slot.buffer);
+        slot.state.store(SlotState::Free, std::memory_order_relaxed);
+        inFlight.pop_front();
+    }
+    for (std::unique_ptr<Slot>& slot : slots) {
+        wgpuBufferDestroy(slot->buffer);
+        wgpuBufferRelease(slot->buffer);
+    }
+    slots.clear();
+}
+
+bool TextureReadback::Capture(WGPUCommandEncoder encoder, WGPUTexture texture, uint64_t tag)
+{
+    Slot* free = nullptr;
+    for (std::unique_ptr<Slot>& slot : slots) {
+        if (slot->state.load(std::memory_order_acquire) == SlotState::Free) {
+            free = slot.get();
+            break;
+        }
+    }
+    if (!free) {
+        ++stats.dropped;
+        return false;
+    }
+
+    WGPUImageCopyTexture source = {};
+    source.nextInChain = nullptr;
+    source.texture = texture;
+    source.mipLevel = 0;
+    source.origin = { 0, 0, 0 };
+    source.aspect = WGPUTextureAspect_All;
+
+    WGPUImageCopyBuffer destination = {};
+    destination.nextInChain = nullptr;
+    destination.buffer = free->buffer;
+    destination.layout.nextInChain = nullptr;
+    destination.layout.offset = 0;
+    destination.layout.bytesPerRow = bytesPerRow;
+    destination.layout.rowsPerImage = height;
+
+    WGPUExtent3D copySize = { width, height, 1 };
+    wgpuCommandEncoderCopyTextureToBuffer(encoder, &source, &destination, &copySize);
+
+    free->tag = tag;
+    free->state.store(SlotState::Recorded, std::memory_order_relaxed);
+    inFlight.push_back(free);
+    ++stats.captured;
+    return true;
+}
+
+void TextureReadback::OnSubmitted()
+{
+    auto onBufferMapped = [](WGPUBufferMapAsyncStatus status, void* pUserData) {
+        Slot& slot = *reinterpret_cast<Slot*>(pUserData);
+        slot.state.store(status == WGPUBufferMapAsyncStatus_Success ? SlotState::Mapped : SlotState::Failed, std::memory_order_release);
+        };
+    for (Slot* slot : inFlight) {
+        if (slot->state.load(std::memory_order_relaxed) != SlotState::Recorded) continue;
+        slot->state.store(SlotState::Mapping, std::memory_order_relaxed);
+        wgpuBufferMapAsync(slot->buffer, WGPUMapMode_Read, 0, (size_t)bytesPerRow * height, onBufferMapped, (void*)slot);
+    }
+}
+
+void TextureReadback::Poll()
+{
+    // Maps complete in submission order, stop at the first one still pending
+    while (!inFlight.empty()) {
+        Slot& slot = *inFlight.front();
+        SlotState state = slot.state.load(std::memory_order_acquire);
+        if (state == SlotState::Mapped) {
+            size_t size = (size_t)bytesPerRow * height;
+            ReadbackImage image;
+            image.pixels = static_cast<uint8_t const*>(wgpuBufferGetConstMappedRange(slot.buffer, 0, size));
+            image.width = width;
+            image.height = height;
+            image.bytesPerRow = bytesPerRow;
+            image.format = format;
+            image.tag = slot.tag;
+            if (image.pixels && callback) callback(image);
+            wgpuBufferUnmap(slot.buffer);
+            ++stats.delivered;
+            stats.bytes += size;
+        }
+        else if (state != SlotState::Failed) {
+            break;
+        }
+        slot.state.store(SlotState::Free, std::memory_order_relaxed);
+        inFlight.pop_front();
+    }
+}
+
+void TextureReadback::WaitIdle()
+{
+    while (!inFlight.empty()) {
+        // Recorded but never submitted: nothing will ever map it
+        if (inFlight.front()->state.load(std::memory_order_relaxed) == SlotState::Recorded) break;
+        Poll();
+        if (!inFlight.empty()) PollDevice();
+    }
+}
+
+void TextureReadback::PollDevice()
+{
+#if defined(WEBGPU_BACKEND_DAWN)
+    wgpuDeviceTick(device);
+#elif defined(WEBGPU_BACKEND_WGPU)
+    wgpuDevicePoll(device, true, nullptr);
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+    emscripten_sleep(1);
+#endif
+}
@@ -0,0 +1,266 @@
+#include "../include/UploadRing.h"
+
+#include <webgpu/webgpu.h>
+#ifdef WEBGPU_BACKEND_WGPU
+#  include <webgpu/wgpu.h>
+#endif // WEBGPU_BACKEND_WGPU
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+bool UploadRing::Initialize(WGPUDevice device, WGPUQueue queue, uint64_t chunkSize, uint32_t chunkCount, uint64_t frameBudget)
+{
+    assert(chunkSize % CopyAlignment == 0);
+    this->device = device;
+    this->queue = queue;
+    this->chunkSize = chunkSize;
+    this->frameBudget = frameBudget;
+    startTime = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < chunkCount; ++i) {
+        std::unique_ptr<Chunk> chunk = CreateChunk();
+        if (!chunk) return false;
+        chunks.push_back(std::move(chunk));
+    }
+    current = 0;
+    return true;
+}
+
+void UploadRing::Terminate()
+{
+    // Callbacks still pending reference the chunks: let them land first
+    for (auto& chunk : chunks) {
+        if (chunk->state == ChunkState::InFlight && !chunk->fenceArmed) {
+            chunk->state = ChunkState::Mapped;
+            continue;
+        }
+        WaitUntilMapped(*chunk);
+    }
+    for (auto& chunk : chunks) {
+        wgpuBufferRelease(chunk->buffer);
+    }
+    chunks.clear();
+    copies.clear();
+    deferred.clear();
+}
+
+std::unique_ptr<UploadRing::Chunk> UploadRing::CreateChunk()
+{
+    WGPUBufferDescriptor bufferDesc = {};
+    bufferDesc.nextInChain = nullptr;
+    bufferDesc.label = "Upload staging chunk";
+    bufferDesc.usage = WGPUBufferUsage_MapWrite | WGPUBufferUsage_CopySrc;
+    bufferDesc.size = chunkSize;
+    bufferDesc.mappedAtCreation = true;
+
+    std::unique_ptr<Chunk> chunk(new Chunk());
+    chunk->ring = this;
+    chunk->buffer = wgpuDeviceCreateBuffer(device, &bufferDesc);
+    if (!chunk->buffer) return nullptr;
+    chunk->mapped = static_cast<uint8_t*>(wgpuBufferGetMappedRange(chunk->buffer, 0, chunkSize));
+    if (!chunk->mapped) {
+        wgpuBufferRelease(chunk->buffer);
+        return nullptr;
+    }
+    return chunk;
+}
+
+void UploadRing::BeginFrame()
+{
+    frameBytes = 0;
+    stats.frameStallMs = 0.0;
+
+    while (!deferred.empty()) {
+        DeferredUpload& upload = deferred.front();
+        uint64_t size = upload.data.size();
+        if (frameBytes > 0 && frameBytes + size > frameBudget) break;
+
+        Write(upload.destination, upload.destinationOffset, upload.data.data(), size);
+        stats.deferredBytes -= size;
+        deferred.pop_front();
+    }
+}
+
+bool UploadRing::Upload(WGPUBuffer destination, uint64_t destinationOffset, void const* data, uint64_t size)
+{
+    assert(size % CopyAlignment == 0 && destinationOffset % CopyAlignment == 0);
+    if (size == 0) return true;
+
+    // Anything already deferred goes first to keep uploads ordered. A single
+    // upload larger than the budget still goes out on an otherwise empty frame.
+    if (!deferred.empty() || (frameBytes > 0 && frameBytes + size > frameBudget)) {
+        DeferredUpload upload;
+        upload.destination = destination;
+        upload.destinationOffset = destinationOffset;
+        upload.data.assign(static_cast<uint8_t const*>(data), static_cast<uint8_t const*>(data) + size);
+        deferred.push_back(std::move(upload));
+        stats.deferredBytes += size;
+        return false;
+    }
+
+    Write(destination, destinationOffset, static_cast<uint8_t const*>(data), size);
+    return true;
+}
+
+void UploadRing::Write(WGPUBuffer destination, uint64_t destinationOffset, uint8_t const* data, uint64_t size)
+{
+    frameBytes += size;
+    stats.totalBytes += size;
+
+    // Uploads larger than a chunk are split
+    while (size > 0) {
+        uint64_t pieceSize = std::min(size, chunkSize);
+        Chunk* chunk = nullptr;
+        uint64_t offset = 0;
+        uint8_t* target = Allocate(pieceSize, chunk, offset);
+        if (!target) {
+            // No staging memory, the device is likely lost: let the queue
+            // copy it. It lands ahead of this frame's copies.
+            wgpuQueueWriteBuffer(queue, destination, destinationOffset, data, (size_t)pieceSize);
+            stats.directBytes += pieceSize;
+            data += pieceSize;
+            destinationOffset += pieceSize;
+            size -= pieceSize;
+            continue;
+        }
+        std::memcpy(target, data, (size_t)pieceSize);
+
+        // Contiguous on both sides of the previous copy: extend it
+        if (!copies.empty()) {
+            Copy& last = copies.back();
+            if (last.source == chunk->buffer && last.sourceOffset + last.size == offset
+                && last.destination == destination && last.destinationOffset + last.size == destinationOffset) {
+                last.size += pieceSize;
+                ++stats.mergedCopies;
+                data += pieceSize;
+                destinationOffset += pieceSize;
+                size -= pieceSize;
+                continue;
+            }
+        }
+
+        Copy copy;
+        copy.source = chunk->buffer;
+        copy.sourceOffset = offset;
+        copy.destination = destination;
+        copy.destinationOffset = destinationOffset;
+        copy.size = pieceSize;
+        copies.push_back(copy);
+
+        data += pieceSize;
+        destinationOffset += pieceSize;
+        size -= pieceSize;
+    }
+}
+
+uint8_t* UploadRing::Allocate(uint64_t size, Chunk*& chunk, uint64_t& offset)
+{
+    Chunk* candidate = chunks[current].get();
+    ChunkState state = candidate->state.load(std::memory_order_acquire);
+    bool writable = state == ChunkState::Mapped || state == ChunkState::Pending;
+    if (!writable || candidate->cursor + size > chunkSize) {
+        // Move on to the next chunk. If it was already written this frame
+        // the ring is too small: grow it rather than flushing mid-frame.
+        current = (current + 1) % (uint32_t)chunks.size();
+        candidate = chunks[current].get();
+        if (candidate->state.load(std::memory_order_acquire) == ChunkState::Pending) {
+            std::unique_ptr<Chunk> grown = CreateChunk();
+            if (!grown) return nullptr;
+            chunks.push_back(std::move(grown));
+            current = (uint32_t)(chunks.size() - 1);
+            candidate = chunks.back().get();
+        }
+        else if (WaitUntilMapped(*candidate)) {
+            candidate->cursor = 0;
+        }
+        else {
+            // Skip the failed chunk for good: a new one takes its slot
+            ++stats.failedMaps;
+            std::unique_ptr<Chunk> replacement = CreateChunk();
+            if (!replacement) return nullptr;
+            wgpuBufferRelease(candidate->buffer);
+            chunks[current] = std::move(replacement);
+            candidate = chunks[current].get();
+        }
+    }
+
+    candidate->state.store(ChunkState::Pending, std::memory_order_relaxed);
+    offset = candidate->cursor;
+    candidate->cursor = (candidate->cursor + size + CopyAlignment - 1) & ~(CopyAlignment - 1);
+    chunk = candidate;
+    return candidate->mapped + offset;
+}
+
+bool UploadRing::WaitUntilMapped(Chunk& chunk)
+{
+    auto landed = [&chunk]() {
+        ChunkState state = chunk.state.load(std::memory_order_acquire);
+        return state == ChunkState::Mapped || state == ChunkState::Failed;
+        };
+    if (landed()) return chunk.state.load(std::memory_order_relaxed) == ChunkState::Mapped;
+
+    auto stallStart = std::chrono::steady_clock::now();
+    while (!landed()) {
+#if defined(WEBGPU_BACKEND_DAWN)
+        wgpuDeviceTick(device);
+#elif defined(WEBGPU_BACKEND_WGPU)
+        wgpuDevicePoll(device, true, nullptr);
+#elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
+        emscripten_sleep(1);
+#endif
+    }
+    double stallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stallStart).count();
+    stats.stallMs += stallMs;
+    stats.frameStallMs += stallMs;
+    return chunk.state.load(std::memory_order_relaxed) == ChunkState::Mapped;
+}
+
+void UploadRing::Flush(WGPUCommandEncoder encoder)
+{
+    for (auto& chunk : chunks) {
+        if (chunk->state.load(std::memory_order_relaxed) != ChunkState::Pending) continue;
+        wgpuBufferUnmap(chunk->buffer);
+        chunk->mapped = nullptr;
+        chunk->fenceArmed = false;
+        chunk->state.store(ChunkState::InFlight, std::memory_order_relaxed);
+    }
+
+    uint64_t bytes = 0;
+    for (Copy const& copy : copies) {
+        wgpuCommandEncoderCopyBufferToBuffer(encoder, copy.source, copy.sourceOffset, copy.destination, copy.destinationOffset, copy.size);
+        bytes += copy.size;
+    }
+    stats.frameBytes = bytes;
+    stats.frameCopies = (uint32_t)copies.size();
+    copies.clear();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    if (seconds > 0.0) stats.bandwidthMBps = (double)stats.totalBytes / (1024.0 * 1024.0) / seconds;
+}
+
+void UploadRing::OnSubmitted()
+{
+    // Once the copies ran, map the chunk again so that it can be refilled
+    auto onCopiesDone = [](WGPUQueueWorkDoneStatus /* status */, void* pUserData) {
+        auto onChunkMapped = [](WGPUBufferMapAsyncStatus status, void* pUserData) {
+            Chunk& chunk = *reinterpret_cast<Chunk*>(pUserData);
+            chunk.mapped = nullptr;
+            if (status == WGPUBufferMapAsyncStatus_Success) {
+                chunk.mapped = static_cast<uint8_t*>(wgpuBufferGetMappedRange(chunk.buffer, 0, chunk.ring->chunkSize));
+            }
+            chunk.cursor = 0;
+            // Never Mapped without memory behind it
+            chunk.state.store(chunk.mapped ? ChunkState::Mapped : ChunkState::Failed, std::memory_order_release);
+            };
+        Chunk& chunk = *reinterpret_cast<Chunk*>(pUserData);
+        chunk.state.store(ChunkState::Mapping, std::memory_order_relaxed);
+        wgpuBufferMapAsync(chunk.buffer, WGPUMapMode_Write, 0, (size_t)chunk.ring->chunkSize, onChunkMapped, pUserData);
+        };
+
+    for (auto& chunk : chunks) {
+        if (chunk->state.load(std::memory_order_relaxed) != ChunkState::InFlight || chunk->fenceArmed) continue;
+        chunk->fenceArmed = true;
+        wgpuQueueOnSubmittedWorkDone(queue, onCopiesDone, (void*)chunk.get());
+    }
+}
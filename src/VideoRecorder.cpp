@@ -0,0 +1,304 @@
+#include "../include/VideoRecorder.h"
+
+#include <chrono>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define VIDEO_RECORDER_SSE2 1
+#endif
+
+#ifdef _WIN32
+#  define popen _popen
+#  define pclose _pclose
+#endif // _WIN32
+
+namespace {
+    // BT.601 limited range in 8.8 fixed point
+    constexpr int YR = 66, YG = 129, YB = 25;
+    constexpr int UR = -38, UG = -74, UB = 112;
+    constexpr int VR = 112, VG = -94, VB = -18;
+
+    uint8_t Clamp8(int value)
+    {
+        return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+
+#ifdef VIDEO_RECORDER_SSE2
+    // Four pixels or chroma sums, two per register as 16-bit B/G/R/A
+    // (in memory order), dotted with `coefficients`
+    __m128i Dot4(__m128i first, __m128i second, __m128i coefficients)
+    {
+        __m128 s0 = _mm_castsi128_ps(_mm_madd_epi16(first, coefficients));
+        __m128 s1 = _mm_castsi128_ps(_mm_madd_epi16(second, coefficients));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1)));
+        return _mm_add_epi32(even, odd);
+    }
+
+    // Sum of the channels of the two pixels of `pair`, in the low half
+    __m128i SumPair(__m128i pair)
+    {
+        return _mm_add_epi16(pair, _mm_srli_si128(pair, 8));
+    }
+#endif // VIDEO_RECORDER_SSE2
+}
+
+void VideoRecorder::ConvertToYuv420(uint8_t const* pixels, uint32_t width, uint32_t height, uint32_t bytesPerRow, bool bgra,
+    uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane)
+{
+    uint32_t chromaWidth = (width + 1) / 2;
+    int const r = bgra ? 2 : 0;
+    int const b = bgra ? 0 : 2;
+
+#ifdef VIDEO_RECORDER_SSE2
+    // Coefficients in the memory order of the channels
+    auto coefficients = [bgra](int cr, int cg, int cb) {
+        short c0 = (short)(bgra ? cb : cr);
+        short c2 = (short)(bgra ? cr : cb);
+        return _mm_setr_epi16(c0, (short)cg, c2, 0, c0, (short)cg, c2, 0);
+        };
+    __m128i const yCoefficients = coefficients(YR, YG, YB);
+    __m128i const uCoefficients = coefficients(UR, UG, UB);
+    __m128i const vCoefficients = coefficients(VR, VG, VB);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const yRound = _mm_set1_epi32(128);
+    __m128i const yOffset = _mm_set1_epi16(16);
+    __m128i const chromaRound = _mm_set1_epi32(512);
+    __m128i const chromaOffset = _mm_set1_epi16(128);
+#endif // VIDEO_RECORDER_SSE2
+
+    for (uint32_t y = 0; y < height; y += 2) {
+        // An odd last row pairs with itself for chroma
+        bool hasSecondRow = y + 1 < height;
+        uint8_t const* rows[2] = { pixels + (size_t)y * bytesPerRow, pixels + (size_t)(hasSecondRow ? y + 1 : y) * bytesPerRow };
+        uint8_t* yRows[2] = { yPlane + (size_t)y * width, yPlane + (size_t)(y + 1) * width };
+        uint8_t* uRow = uPlane + (size_t)(y / 2) * chromaWidth;
+        uint8_t* vRow = vPlane + (size_t)(y / 2) * chromaWidth;
+
+        uint32_t x = 0;
+#ifdef VIDEO_RECORDER_SSE2
+        for (; x + 8 <= width; x += 8) {
+            // 16-bit channels, two pixels per register: [row][pair]
+            __m128i wide[2][4];
+            for (int row = 0; row < 2; ++row) {
+                __m128i low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(rows[row] + x * 4));
+                __m128i high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(rows[row] + x * 4 + 16));
+                wide[row][0] = _mm_unpacklo_epi8(low, zero);
+                wide[row][1] = _mm_unpackhi_epi8(low, zero);
+                wide[row][2] = _mm_unpacklo_epi8(high, zero);
+                wide[row][3] = _mm_unpackhi_epi8(high, zero);
+                if (row == 1 && !hasSecondRow) break;
+
+                __m128i luma0 = _mm_srai_epi32(_mm_add_epi32(Dot4(wide[row][0], wide[row][1], yCoefficients), yRound), 8);
+                __m128i luma1 = _mm_srai_epi32(_mm_add_epi32(Dot4(wide[row][2], wide[row][3], yCoefficients), yRound), 8);
+                __m128i luma = _mm_add_epi16(_mm_packs_epi32(luma0, luma1), yOffset);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(yRows[row] + x), _mm_packus_epi16(luma, luma));
+            }
+            if (!hasSecondRow) {
+                for (int pair = 0; pair < 4; ++pair) wide[1][pair] = wide[0][pair];
+            }
+
+            // Channel sums of the four 2x2 blocks
+            __m128i blocks[4];
+            for (int pair = 0; pair < 4; ++pair) {
+                blocks[pair] = SumPair(_mm_add_epi16(wide[0][pair], wide[1][pair]));
+            }
+            __m128i blocks01 = _mm_unpacklo_epi64(blocks[0], blocks[1]);
+            __m128i blocks23 = _mm_unpacklo_epi64(blocks[2], blocks[3]);
+
+            __m128i u = _mm_srai_epi32(_mm_add_epi32(Dot4(blocks01, blocks23, uCoefficients), chromaRound), 10);
+            __m128i v = _mm_srai_epi32(_mm_add_epi32(Dot4(blocks01, blocks23, vCoefficients), chromaRound), 10);
+            __m128i uv = _mm_add_epi16(_mm_packs_epi32(u, v), chromaOffset);
+            __m128i uvBytes = _mm_packus_epi16(uv, uv);
+            int uBytes = _mm_cvtsi128_si32(uvBytes);
+            int vBytes = _mm_cvtsi128_si32(_mm_srli_si128(uvBytes, 4));
+            std::memcpy(uRow + x / 2, &uBytes, 4);
+            std::memcpy(vRow + x / 2, &vBytes, 4);
+        }
+#endif // VIDEO_RECORDER_SSE2
+
+        for (; x < width; x += 2) {
+            // An odd last column pairs with itself for chroma
+            uint32_t x1 = x + 1 < width ? x + 1 : x;
+            int sumR = 0, sumG = 0, sumB = 0;
+            for (int row = 0; row < 2; ++row) {
+                for (uint32_t column : { x, x1 }) {
+                    uint8_t const* pixel = rows[row] + column * 4;
+                    sumR += pixel[r];
+                    sumG += pixel[1];
+                    sumB += pixel[b];
+                }
+                if (row == 1 && !hasSecondRow) continue;
+                for (uint32_t column = x; column <= x1; ++column) {
+                    uint8_t const* pixel = rows[row] + column * 4;
+                    yRows[row][column] = Clamp8(((YR * pixel[r] + YG * pixel[1] + YB * pixel[b] + 128) >> 8) + 16);
+                }
+            }
+            uRow[x / 2] = Clamp8(((UR * sumR + UG * sumG + UB * sumB + 512) >> 10) + 128);
+            vRow[x / 2] = Clamp8(((VR * sumR + VG * sumG + VB * sumB + 512) >> 10) + 128);
+        }
+    }
+}
+
+bool VideoRecorder::Initialize(WGPUDevice device, uint32_t width, uint32_t height, WGPUTextureFormat format)
+{
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    size_t chromaSize = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    frameSize = (size_t)width * height + 2 * chromaSize;
+    // One more buffer than the screenshots: every frame goes through it
+    if (!readback.Initialize(device, width, height, format, 4)) return false;
+    readback.SetCallback([this](ReadbackImage const& image) { OnReadback(image); });
+    return true;
+}
+
+void VideoRecorder::Terminate()
+{
+    Stop();
+    readback.Terminate();
+    freeFrames.clear();
+}
+
+bool VideoRecorder::Start(std::string const& path, uint32_t fps, VideoQueuePolicy policy, size_t queueSize)
+{
+    if (output) return false;
+    outputIsPipe = !path.empty() && path[0] == '|';
+    if (outputIsPipe) output = popen(path.c_str() + 1, "w");
+    else if (path == "-") output = stdout;
+    else output = std::fopen(path.c_str(), "wb");
+    if (!output) return false;
+
+    this->policy = policy;
+    this->queueSize = queueSize > 0 ? queueSize : 1;
+    std::fprintf(output, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n", width, height, fps);
+
+    stopping = false;
+    writer = std::thread(&VideoRecorder::WriterMain, this);
+    return true;
+}
+
+void VideoRecorder::Stop()
+{
+    if (!output) return;
+    // Frames already copied on the GPU still make it to the file
+    readback.WaitIdle();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_all();
+    writer.join();
+
+    if (outputIsPipe) pclose(output);
+    else if (output == stdout) std::fflush(output);
+    else std::fclose(output);
+    output = nullptr;
+}
+
+void VideoRecorder::Capture(WGPUCommandEncoder encoder, WGPUTexture texture, uint64_t frameNumber)
+{
+    if (!output) return;
+    if (!readback.Capture(encoder, texture, frameNumber)) {
+        if (policy == VideoQueuePolicy::Drop) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.framesDropped;
+            return;
+        }
+        // Every buffer in flight: wait for them instead of losing the frame
+        auto blockStart = std::chrono::steady_clock::now();
+        readback.WaitIdle();
+        readback.Capture(encoder, texture, frameNumber);
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blockStart).count();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stats.framesCaptured;
+}
+
+void VideoRecorder::OnSubmitted()
+{
+    readback.OnSubmitted();
+}
+
+void VideoRecorder::Poll()
+{
+    readback.Poll();
+}
+
+void VideoRecorder::OnReadback(ReadbackImage const& image)
+{
+    std::unique_ptr<std::vector<uint8_t>> frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (queue.size() >= queueSize) {
+            if (policy == VideoQueuePolicy::Drop) {
+                ++stats.framesDropped;
+                return;
+            }
+            auto blockStart = std::chrono::steady_clock::now();
+            frameWritten.wait(lock, [this] { return queue.size() < queueSize; });
+            stats.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blockStart).count();
+        }
+        if (!freeFrames.empty()) {
+            frame = std::move(freeFrames.back());
+            freeFrames.pop_back();
+        }
+    }
+    if (!frame) frame.reset(new std::vector<uint8_t>(frameSize));
+
+    auto convertStart = std::chrono::steady_clock::now();
+    bool bgra = image.format == WGPUTextureFormat_BGRA8Unorm || image.format == WGPUTextureFormat_BGRA8UnormSrgb;
+    uint8_t* planes = frame->data();
+    size_t lumaSize = (size_t)width * height;
+    size_t chromaSize = (frameSize - lumaSize) / 2;
+    ConvertToYuv420(image.pixels, image.width, image.height, image.bytesPerRow, bgra, planes, planes + lumaSize, planes + lumaSize + chromaSize);
+    double convertMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - convertStart).count();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.convertMs += convertMs;
+        queue.push_back(std::move(frame));
+    }
+    frameQueued.notify_one();
+}
+
+void VideoRecorder::WriterMain()
+{
+    while (true) {
+        std::unique_ptr<std::vector<uint8_t>> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameQueued.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            frame = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        auto writeStart = std::chrono::steady_clock::now();
+        bool ok = std::fwrite("FRAME\n", 1, 6, output) == 6;
+        ok = ok && std::fwrite(frame->data(), 1, frame->size(), output) == frame->size();
+        double writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.writeMs += writeMs;
+            if (ok) {
+                ++stats.framesWritten;
+                stats.bytesWritten += 6 + frame->size();
+            }
+            else {
+                ++stats.framesDropped;
+            }
+            freeFrames.push_back(std::move(frame));
+        }
+        frameWritten.notify_one();
+    }
+}
+
+VideoRecorderStats VideoRecorder::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdio>
+
+// Failed checks are reported and counted, the test's main() returns the
+// count so that `xmake test` sees the failure
+inline int checkFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++checkFailures; \
+        } \
+    } while (0)
@@ -0,0 +1,378 @@
+#include "MockWebGpu.h"
+
+#include <webgpu/webgpu.h>
+#include <webgpu/wgpu.h>
+
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    struct Object {
+        uint32_t references = 1;
+        // Buffers: backing storage of the mapped range
+        std::vector<uint8_t> data;
+        // Failed validation
+        bool invalid = false;
+    };
+
+    struct WorkDone {
+        uint64_t submission = 0;
+        WGPUQueueWorkDoneCallback callback = nullptr;
+        void* userdata = nullptr;
+    };
+
+    struct Mapping {
+        uint64_t submission = 0;
+        WGPUBufferMapCallback callback = nullptr;
+        void* userdata = nullptr;
+    };
+
+    struct State {
+        // Callbacks run without it, they may call back in
+        std::mutex mutex;
+        std::unordered_map<std::string_view, uint64_t> calls;
+        int64_t liveObjects = 0;
+        uint64_t submissions = 0;
+        uint64_t completed = 0;
+        std::vector<WorkDone> workDone;
+        std::vector<Mapping> mappings;
+        WGPUErrorCallback uncapturedError = nullptr;
+        void* uncapturedErrorUserdata = nullptr;
+    };
+
+    State state;
+    Object device;
+    Object queue;
+
+    void Record(std::string_view function)
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        ++state.calls[function];
+    }
+
+    template<typename Handle>
+    Handle Create(std::string_view function)
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        ++state.calls[function];
+        ++state.liveObjects;
+        return reinterpret_cast<Handle>(new Object());
+    }
+
+    void Release(std::string_view function, void* handle)
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        ++state.calls[function];
+        Object* object = static_cast<Object*>(handle);
+        if (!object || --object->references > 0) return;
+        delete object;
+        --state.liveObjects;
+    }
+
+    // Synchronous, like wgpu-native without an error scope
+    void RaiseValidationError(char const* message)
+    {
+        WGPUErrorCallback callback;
+        void* userdata;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            ++state.calls["(validation error)"];
+            callback = state.uncapturedError;
+            userdata = state.uncapturedErrorUserdata;
+        }
+        if (callback) callback(WGPUErrorType_Validation, message, userdata);
+    }
+
+    bool IsInvalid(void const* handle)
+    {
+        return handle && static_cast<Object const*>(handle)->invalid;
+    }
+
+    // Fire the callbacks of what the GPU finished, return true if it is idle
+    bool FireCompleted()
+    {
+        std::vector<WorkDone> workDone;
+        std::vector<Mapping> mappings;
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            auto take = [](auto& pending, auto& ready) {
+                for (size_t i = 0; i < pending.size();) {
+                    if (pending[i].submission <= state.completed) {
+                        ready.push_back(pending[i]);
+                        pending.erase(pending.begin() + i);
+                    }
+                    else {
+                        ++i;
+                    }
+                }
+                };
+            take(state.workDone, workDone);
+            take(state.mappings, mappings);
+            idle = state.completed == state.submissions;
+        }
+        for (WorkDone const& entry : workDone) entry.callback(WGPUQueueWorkDoneStatus_Success, entry.userdata);
+        for (Mapping const& entry : mappings) entry.callback(WGPUBufferMapAsyncStatus_Success, entry.userdata);
+        return idle;
+    }
+}
+
+void MockWebGpu::Reset()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.calls.clear();
+    state.submissions = 0;
+    state.completed = 0;
+    state.workDone.clear();
+    state.mappings.clear();
+}
+
+WGPUDevice MockWebGpu::GetDevice()
+{
+    return reinterpret_cast<WGPUDevice>(&device);
+}
+
+WGPUQueue MockWebGpu::GetQueue()
+{
+    return reinterpret_cast<WGPUQueue>(&queue);
+}
+
+uint64_t MockWebGpu::GetCallCount(char const* function)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto it = state.calls.find(function);
+    return it != state.calls.end() ? it->second : 0;
+}
+
+int64_t MockWebGpu::GetLiveObjects()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.liveObjects;
+}
+
+uint64_t MockWebGpu::GetSubmissionCount()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.submissions;
+}
+
+uint64_t MockWebGpu::GetCompletedSubmissions()
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.completed;
+}
+
+void MockWebGpu::CompleteSubmissions(uint64_t submissionIndex)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (submissionIndex > state.submissions) submissionIndex = state.submissions;
+    if (submissionIndex > state.completed) state.completed = submissionIndex;
+}
+
+extern "C" {
+
+// Device and queue
+
+WGPUCommandEncoder wgpuDeviceCreateCommandEncoder(WGPUDevice, WGPUCommandEncoderDescriptor const*)
+{
+    return Create<WGPUCommandEncoder>("wgpuDeviceCreateCommandEncoder");
+}
+
+WGPUBuffer wgpuDeviceCreateBuffer(WGPUDevice, WGPUBufferDescriptor const*)
+{
+    return Create<WGPUBuffer>("wgpuDeviceCreateBuffer");
+}
+
+WGPUTexture wgpuDeviceCreateTexture(WGPUDevice, WGPUTextureDescriptor const*)
+{
+    return Create<WGPUTexture>("wgpuDeviceCreateTexture");
+}
+
+WGPUQuerySet wgpuDeviceCreateQuerySet(WGPUDevice, WGPUQuerySetDescriptor const*)
+{
+    return Create<WGPUQuerySet>("wgpuDeviceCreateQuerySet");
+}
+
+WGPUShaderModule wgpuDeviceCreateShaderModule(WGPUDevice, WGPUShaderModuleDescriptor const* descriptor)
+{
+    WGPUShaderModule module = Create<WGPUShaderModule>("wgpuDeviceCreateShaderModule");
+    auto const* wgsl = reinterpret_cast<WGPUShaderModuleWGSLDescriptor const*>(descriptor->nextInChain);
+    if (wgsl && wgsl->code && std::string_view(wgsl->code).find("invalid") != std::string_view::npos) {
+        reinterpret_cast<Object*>(module)->invalid = true;
+        RaiseValidationError("Shader module is invalid");
+    }
+    return module;
+}
+
+WGPURenderPipeline wgpuDeviceCreateRenderPipeline(WGPUDevice, WGPURenderPipelineDescriptor const* descriptor)
+{
+    WGPURenderPipeline pipeline = Create<WGPURenderPipeline>("wgpuDeviceCreateRenderPipeline");
+    if (IsInvalid(descriptor->vertex.module) || (descriptor->fragment && IsInvalid(descriptor->fragment->module))) {
+        reinterpret_cast<Object*>(pipeline)->invalid = true;
+        RaiseValidationError("Render pipeline uses an invalid shader module");
+    }
+    return pipeline;
+}
+
+void wgpuDeviceSetUncapturedErrorCallback(WGPUDevice, WGPUErrorCallback callback, void* userdata)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ++state.calls["wgpuDeviceSetUncapturedErrorCallback"];
+    state.uncapturedError = callback;
+    state.uncapturedErrorUserdata = userdata;
+}
+
+WGPUBool wgpuDeviceHasFeature(WGPUDevice, WGPUFeatureName)
+{
+    Record("wgpuDeviceHasFeature");
+    return false;
+}
+
+WGPUBool wgpuDeviceGetLimits(WGPUDevice, WGPUSupportedLimits* limits)
+{
+    Record("wgpuDeviceGetLimits");
+    limits->limits.minUniformBufferOffsetAlignment = 256;
+    limits->limits.minStorageBufferOffsetAlignment = 256;
+    return true;
+}
+
+WGPUBool wgpuDevicePoll(WGPUDevice, WGPUBool wait, WGPUWrappedSubmissionIndex const* wrappedSubmissionIndex)
+{
+    Record("wgpuDevicePoll");
+    if (wait) {
+        Record("wgpuDevicePoll(wait)");
+        std::lock_guard<std::mutex> lock(state.mutex);
+        uint64_t until = wrappedSubmissionIndex ? wrappedSubmissionIndex->submissionIndex : state.submissions;
+        if (until > state.completed) state.completed = until;
+    }
+    return FireCompleted();
+}
+
+void wgpuQueueSubmit(WGPUQueue, size_t, WGPUCommandBuffer const*)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ++state.calls["wgpuQueueSubmit"];
+    ++state.submissions;
+}
+
+WGPUSubmissionIndex wgpuQueueSubmitForIndex(WGPUQueue, size_t, WGPUCommandBuffer const*)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ++state.calls["wgpuQueueSubmitForIndex"];
+    return ++state.submissions;
+}
+
+void wgpuQueueOnSubmittedWorkDone(WGPUQueue, WGPUQueueWorkDoneCallback callback, void* userdata)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ++state.calls["wgpuQueueOnSubmittedWorkDone"];
+    state.workDone.push_back(WorkDone{ state.submissions, callback, userdata });
+}
+
+// Command encoding
+
+WGPUCommandBuffer wgpuCommandEncoderFinish(WGPUCommandEncoder, WGPUCommandBufferDescriptor const*)
+{
+    return Create<WGPUCommandBuffer>("wgpuCommandEncoderFinish");
+}
+
+WGPUComputePassEncoder wgpuCommandEncoderBeginComputePass(WGPUCommandEncoder, WGPUComputePassDescriptor const*)
+{
+    return Create<WGPUComputePassEncoder>("wgpuCommandEncoderBeginComputePass");
+}
+
+WGPURenderPassEncoder wgpuCommandEncoderBeginRenderPass(WGPUCommandEncoder, WGPURenderPassDescriptor const*)
+{
+    return Create<WGPURenderPassEncoder>("wgpuCommandEncoderBeginRenderPass");
+}
+
+void wgpuCommandEncoderCopyBufferToBuffer(WGPUCommandEncoder, WGPUBuffer, uint64_t, WGPUBuffer, uint64_t, uint64_t)
+{
+    Record("wgpuCommandEncoderCopyBufferToBuffer");
+}
+
+void wgpuCommandEncoderResolveQuerySet(WGPUCommandEncoder, WGPUQuerySet, uint32_t, uint32_t, WGPUBuffer, uint64_t)
+{
+    Record("wgpuCommandEncoderResolveQuerySet");
+}
+
+void wgpuComputePassEncoderEnd(WGPUComputePassEncoder)
+{
+    Record("wgpuComputePassEncoderEnd");
+}
+
+void wgpuRenderPassEncoderEnd(WGPURenderPassEncoder)
+{
+    Record("wgpuRenderPassEncoderEnd");
+}
+
+// Buffers and textures
+
+void wgpuBufferMapAsync(WGPUBuffer, WGPUMapModeFlags, size_t, size_t, WGPUBufferMapCallback callback, void* userdata)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ++state.calls["wgpuBufferMapAsync"];
+    // Lands once what was submitted so far is done
+    state.mappings.push_back(Mapping{ state.submissions, callback, userdata });
+}
+
+void* wgpuBufferGetMappedRange(WGPUBuffer buffer, size_t offset, size_t size)
+{
+    Record("wgpuBufferGetMappedRange");
+    Object& object = *reinterpret_cast<Object*>(buffer);
+    if (object.data.size() < offset + size) object.data.resize(offset + size);
+    return object.data.data() + offset;
+}
+
+void const* wgpuBufferGetConstMappedRange(WGPUBuffer buffer, size_t offset, size_t size)
+{
+    return wgpuBufferGetMappedRange(buffer, offset, size);
+}
+
+void wgpuBufferUnmap(WGPUBuffer)
+{
+    Record("wgpuBufferUnmap");
+}
+
+void wgpuBufferDestroy(WGPUBuffer)
+{
+    Record("wgpuBufferDestroy");
+}
+
+void wgpuTextureDestroy(WGPUTexture)
+{
+    Record("wgpuTextureDestroy");
+}
+
+void wgpuQuerySetDestroy(WGPUQuerySet)
+{
+    Record("wgpuQuerySetDestroy");
+}
+
+WGPUTextureView wgpuTextureCreateView(WGPUTexture, WGPUTextureViewDescriptor const*)
+{
+    return Create<WGPUTextureView>("wgpuTextureCreateView");
+}
+
+// Releases
+
+void wgpuCommandEncoderRelease(WGPUCommandEncoder handle) { Release("wgpuCommandEncoderRelease", handle); }
+void wgpuCommandBufferRelease(WGPUCommandBuffer handle) { Release("wgpuCommandBufferRelease", handle); }
+void wgpuComputePassEncoderRelease(WGPUComputePassEncoder handle) { Release("wgpuComputePassEncoderRelease", handle); }
+void wgpuRenderPassEncoderRelease(WGPURenderPassEncoder handle) { Release("wgpuRenderPassEncoderRelease", handle); }
+void wgpuBufferRelease(WGPUBuffer handle) { Release("wgpuBufferRelease", handle); }
+void wgpuTextureRelease(WGPUTexture handle) { Release("wgpuTextureRelease", handle); }
+void wgpuTextureViewRelease(WGPUTextureView handle) { Release("wgpuTextureViewRelease", handle); }
+void wgpuSamplerRelease(WGPUSampler handle) { Release("wgpuSamplerRelease", handle); }
+void wgpuBindGroupRelease(WGPUBindGroup handle) { Release("wgpuBindGroupRelease", handle); }
+void wgpuBindGroupLayoutRelease(WGPUBindGroupLayout handle) { Release("wgpuBindGroupLayoutRelease", handle); }
+void wgpuPipelineLayoutRelease(WGPUPipelineLayout handle) { Release("wgpuPipelineLayoutRelease", handle); }
+void wgpuShaderModuleRelease(WGPUShaderModule handle) { Release("wgpuShaderModuleRelease", handle); }
+void wgpuRenderPipelineRelease(WGPURenderPipeline handle) { Release("wgpuRenderPipelineRelease", handle); }
+void wgpuComputePipelineRelease(WGPUComputePipeline handle) { Release("wgpuComputePipelineRelease", handle); }
+void wgpuQuerySetRelease(WGPUQuerySet handle) { Release("wgpuQuerySetRelease", handle); }
+void wgpuRenderBundleRelease(WGPURenderBundle handle) { Release("wgpuRenderBundleRelease", handle); }
+
+} // extern "C"
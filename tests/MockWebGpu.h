@@ -0,0 +1,37 @@
+#pragma once
+#include <webgpu/webgpu.h>
+#include <cstdint>
+
+// Recording stand-in for the wgpu-native C API, linked into the tests and
+// benchmarks in place of the real library so that they run on the CPU
+// alone.
+//
+// Every call is counted by function name, a blocking wgpuDevicePoll() also
+// as "wgpuDevicePoll(wait)". Created objects are fake handles, reference
+// counted like the real ones. The queue is a simulated GPU: submissions
+// only complete through CompleteSubmissions() or a blocking poll, and
+// work-done and map callbacks only fire from wgpuDevicePoll(), as they do
+// in wgpu-native.
+//
+// WGSL containing "invalid" fails validation: creating a shader module from
+// it, or a pipeline from such a module, calls the uncaptured error callback
+// from inside the call, on the calling thread, like wgpu-native does.
+class MockWebGpu {
+public:
+    // Forget every call, submission and pending callback. Objects still
+    // alive stay valid.
+    static void Reset();
+
+    static WGPUDevice GetDevice();
+    static WGPUQueue GetQueue();
+
+    static uint64_t GetCallCount(char const* function);
+    // Objects created and not released yet, the device and queue excluded
+    static int64_t GetLiveObjects();
+
+    static uint64_t GetSubmissionCount();
+    static uint64_t GetCompletedSubmissions();
+    // The GPU finishes every submission up to `submissionIndex` (the first
+    // one is 1). Callbacks fire at the next poll.
+    static void CompleteSubmissions(uint64_t submissionIndex);
+};
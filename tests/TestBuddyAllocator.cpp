@@ -0,0 +1,156 @@
+#include "../include/BuddyAllocator.h"
+#include "../include/GpuBufferAllocator.h"
+#include "Check.h"
+#include "MockWebGpu.h"
+
+#include <sstream>
+#include <string>
+
+namespace {
+    // Blocks split down to the size asked for and merge back with their
+    // buddy once both are free
+    void TestSplitMerge()
+    {
+        BuddyAllocator allocator;
+        allocator.Initialize(1024, 64);
+
+        CHECK(allocator.Allocate(64) == 0);
+        // 64, 128, 256 and 512 are left over from the splits
+        CHECK(allocator.GetStats().largestFreeBlock == 512);
+        CHECK(allocator.Allocate(64) == 64);
+        CHECK(allocator.Allocate(128) == 128);
+        CHECK(allocator.GetStats().allocatedBytes == 256);
+        CHECK(allocator.GetStats().allocationCount == 3);
+
+        CHECK(allocator.Free(64) == 64);
+        // Its buddy is still allocated: nothing merges
+        CHECK(allocator.GetStats().largestFreeBlock == 512);
+        CHECK(allocator.Free(0) == 64);
+        CHECK(allocator.Free(128) == 128);
+        CHECK(allocator.IsEmpty());
+        CHECK(allocator.GetStats().largestFreeBlock == 1024);
+        CHECK(allocator.GetStats().fragmentation == 0.0);
+
+        // Everything merged: the whole range is available again
+        CHECK(allocator.Allocate(1024) == 0);
+        CHECK(allocator.Allocate(64) == BuddyAllocator::InvalidOffset);
+        allocator.Free(0);
+    }
+
+    // Sizes round up to a power of two, at least the minimum block
+    void TestRounding()
+    {
+        BuddyAllocator allocator;
+        allocator.Initialize(1024, 64);
+
+        CHECK(allocator.Allocate(1) == 0);
+        CHECK(allocator.GetStats().allocatedBytes == 64);
+        CHECK(allocator.Allocate(100) == 128);
+        CHECK(allocator.GetStats().allocatedBytes == 64 + 128);
+        CHECK(allocator.Allocate(2048) == BuddyAllocator::InvalidOffset);
+        CHECK(allocator.Allocate(1024) == BuddyAllocator::InvalidOffset);
+    }
+
+    // Blocks are aligned to their size, a larger alignment takes a larger block
+    void TestAlignment()
+    {
+        BuddyAllocator allocator;
+        allocator.Initialize(4096, 64);
+
+        CHECK(allocator.Allocate(64) == 0);
+        uint64_t aligned = allocator.Allocate(64, 256);
+        CHECK(aligned != BuddyAllocator::InvalidOffset);
+        CHECK(aligned % 256 == 0);
+        CHECK(allocator.GetStats().allocatedBytes == 64 + 256);
+        uint64_t large = allocator.Allocate(300, 512);
+        CHECK(large % 512 == 0);
+        CHECK(allocator.Free(aligned) == 256);
+        CHECK(allocator.Free(large) == 512);
+    }
+
+    void TestFragmentation()
+    {
+        BuddyAllocator allocator;
+        allocator.Initialize(1024, 64);
+
+        uint64_t offsets[16];
+        for (uint64_t& offset : offsets) {
+            offset = allocator.Allocate(64);
+        }
+        CHECK(allocator.Allocate(64) == BuddyAllocator::InvalidOffset);
+        CHECK(allocator.GetStats().largestFreeBlock == 0);
+        CHECK(allocator.GetStats().fragmentation == 0.0);
+
+        // Every other block: 512 bytes free, none of them contiguous
+        for (uint32_t i = 0; i < 16; i += 2) {
+            allocator.Free(offsets[i]);
+        }
+        BuddyAllocatorStats stats = allocator.GetStats();
+        CHECK(stats.allocationCount == 8);
+        CHECK(stats.largestFreeBlock == 64);
+        CHECK(stats.fragmentation == 1.0 - 64.0 / 512.0);
+        CHECK(allocator.Allocate(128) == BuddyAllocator::InvalidOffset);
+
+        for (uint32_t i = 1; i < 16; i += 2) {
+            allocator.Free(offsets[i]);
+        }
+        CHECK(allocator.IsEmpty());
+        CHECK(allocator.GetStats().fragmentation == 0.0);
+    }
+
+    // Sub-allocations share backing buffers, aligned for their binding
+    void TestGpuBufferAllocator()
+    {
+        MockWebGpu::Reset();
+        GpuBufferAllocator allocator;
+        CHECK(allocator.Initialize(MockWebGpu::GetDevice(), 4096));
+
+        BufferAllocation first = allocator.Allocate(BufferUsageClass::Uniform, 16);
+        BufferAllocation second = allocator.Allocate(BufferUsageClass::Uniform, 16);
+        CHECK(first.IsValid() && second.IsValid());
+        CHECK(first.buffer == second.buffer);
+        // The mock's minUniformBufferOffsetAlignment
+        CHECK(second.offset == 256);
+        BufferAllocation vertices = allocator.Allocate(BufferUsageClass::Vertex, 100);
+        CHECK(vertices.offset == 0 && vertices.size == 100);
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateBuffer") == 2);
+
+        // Larger than a block: a dedicated one, given back once empty
+        BufferAllocation storage = allocator.Allocate(BufferUsageClass::Storage, 64);
+        BufferAllocation large = allocator.Allocate(BufferUsageClass::Storage, 10000);
+        CHECK(large.IsValid() && large.buffer != storage.buffer);
+        CHECK(MockWebGpu::GetLiveObjects() == 4);
+        allocator.Free(large);
+        CHECK(!large.IsValid());
+        CHECK(MockWebGpu::GetLiveObjects() == 3);
+
+        // One 256-byte allocation left at 256 of 4096: the largest free block
+        // is 2048 of 3840 free bytes
+        allocator.Free(first);
+        std::ostringstream report;
+        allocator.Report(report);
+        std::string text = report.str();
+        CHECK(text.rfind("Buffer allocator:\n", 0) == 0);
+        CHECK(text.find(" Uniform: 1 allocations in 1 blocks, 6.2% occupied") != std::string::npos);
+        CHECK(text.find("largest free 2048 bytes, fragmentation 46.7%") != std::string::npos);
+        CHECK(text.find("  Vertex: 1 allocations in 1 blocks") != std::string::npos);
+        CHECK(text.find("Index") == std::string::npos);
+
+        allocator.Free(second);
+        allocator.Free(vertices);
+        allocator.Free(storage);
+        allocator.Terminate();
+        CHECK(MockWebGpu::GetLiveObjects() == 0);
+    }
+}
+
+int main()
+{
+    TestSplitMerge();
+    TestRounding();
+    TestAlignment();
+    TestFragmentation();
+    TestGpuBufferAllocator();
+    std::printf("TestBuddyAllocator: %d failures\n", checkFailures);
+    return checkFailures;
+}
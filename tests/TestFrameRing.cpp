@@ -0,0 +1,133 @@
+#include "../include/FrameRing.h"
+#include "../include/GpuHandle.h"
+#include "Check.h"
+#include "MockWebGpu.h"
+
+namespace {
+    uint32_t transientsReleased = 0;
+
+    void ReleaseTransient(void*)
+    {
+        ++transientsReleased;
+    }
+
+    void RecordFrame(FrameRing& ring)
+    {
+        FrameContext& frame = ring.BeginFrame();
+        ring.Submit(frame);
+        ring.EndFrame(frame);
+    }
+
+    // A slot is reused without waiting once the GPU finished it, and with a
+    // single blocking poll on its own submission otherwise
+    void TestFenceRecycling()
+    {
+        MockWebGpu::Reset();
+        FrameRing ring;
+        ring.Initialize(MockWebGpu::GetDevice(), MockWebGpu::GetQueue(), 2);
+
+        RecordFrame(ring);
+        RecordFrame(ring);
+        CHECK(MockWebGpu::GetSubmissionCount() == 2);
+        CHECK(MockWebGpu::GetCallCount("wgpuDevicePoll") == 0);
+
+        // The GPU finished frame 0: its slot comes back without blocking
+        MockWebGpu::CompleteSubmissions(1);
+        RecordFrame(ring);
+        CHECK(MockWebGpu::GetCallCount("wgpuDevicePoll(wait)") == 0);
+
+        // Frame 1 is still running: its slot waits on that submission only
+        RecordFrame(ring);
+        CHECK(MockWebGpu::GetCallCount("wgpuDevicePoll(wait)") == 1);
+        CHECK(MockWebGpu::GetCompletedSubmissions() == 2);
+        CHECK(ring.GetStats().framesSubmitted == 4);
+
+        ring.Terminate();
+        CHECK(MockWebGpu::GetCompletedSubmissions() == 4);
+        CHECK(MockWebGpu::GetLiveObjects() == 0);
+    }
+
+    // Every frame creates an encoder and a command buffer, released once
+    // submitted
+    void TestAllocationCounts()
+    {
+        MockWebGpu::Reset();
+        FrameRing ring;
+        ring.Initialize(MockWebGpu::GetDevice(), MockWebGpu::GetQueue(), 3);
+
+        for (int i = 0; i < 10; ++i) {
+            FrameContext& frame = ring.BeginFrame();
+            ring.CountAllocation(frame);
+            ring.Submit(frame);
+            ring.EndFrame(frame);
+            CHECK(ring.GetStats().allocations == 3);
+            // Nothing the frame created outlives its submission
+            CHECK(MockWebGpu::GetLiveObjects() == 0);
+            MockWebGpu::CompleteSubmissions(MockWebGpu::GetSubmissionCount());
+        }
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateCommandEncoder") == 10);
+        CHECK(MockWebGpu::GetCallCount("wgpuCommandEncoderFinish") == 10);
+        CHECK(MockWebGpu::GetCallCount("wgpuCommandBufferRelease") == 10);
+        ring.Terminate();
+    }
+
+    // Transients and deferred handles live until the fence of the frame
+    // that took them
+    void TestTransientRelease()
+    {
+        MockWebGpu::Reset();
+        transientsReleased = 0;
+        FrameRing ring;
+        ring.Initialize(MockWebGpu::GetDevice(), MockWebGpu::GetQueue(), 2);
+
+        FrameContext& frame = ring.BeginFrame();
+        ring.Track(frame, nullptr, ReleaseTransient);
+        GpuBuffer buffer(wgpuDeviceCreateBuffer(MockWebGpu::GetDevice(), nullptr));
+        buffer.Reset();
+        CHECK(MockWebGpu::GetLiveObjects() == 2);
+        ring.Submit(frame);
+        ring.EndFrame(frame);
+
+        // The other slot: frame 0 is not done yet
+        RecordFrame(ring);
+        CHECK(transientsReleased == 0);
+        CHECK(MockWebGpu::GetLiveObjects() == 1);
+
+        MockWebGpu::CompleteSubmissions(1);
+        RecordFrame(ring);
+        CHECK(transientsReleased == 1);
+        CHECK(MockWebGpu::GetLiveObjects() == 0);
+        CHECK(GpuReleaseQueue::GetCounts(GpuObjectType::Buffer).pending == 0);
+        ring.Terminate();
+    }
+
+    // A frame that is never submitted gives its encoder back
+    void TestAbandonFrame()
+    {
+        MockWebGpu::Reset();
+        FrameRing ring;
+        ring.Initialize(MockWebGpu::GetDevice(), MockWebGpu::GetQueue(), 2);
+
+        FrameContext& frame = ring.BeginFrame();
+        CHECK(MockWebGpu::GetLiveObjects() == 1);
+        ring.AbandonFrame(frame);
+        CHECK(MockWebGpu::GetLiveObjects() == 0);
+        CHECK(MockWebGpu::GetSubmissionCount() == 0);
+        CHECK(ring.GetStats().framesSubmitted == 0);
+
+        RecordFrame(ring);
+        CHECK(ring.GetStats().framesSubmitted == 1);
+        ring.Terminate();
+        CHECK(MockWebGpu::GetLiveObjects() == 0);
+    }
+}
+
+int main()
+{
+    TestFenceRecycling();
+    TestAllocationCounts();
+    TestTransientRelease();
+    TestAbandonFrame();
+    std::printf("TestFrameRing: %d failures\n", checkFailures);
+    return checkFailures;
+}
@@ -0,0 +1,62 @@
+#include "../include/GpuProfiler.h"
+#include "Check.h"
+#include "MockWebGpu.h"
+
+#include <sstream>
+#include <string>
+
+namespace {
+    // The mock device has no TimestampQuery: the profiler stays out of the way
+    void TestWithoutTimestamps()
+    {
+        MockWebGpu::Reset();
+        GpuProfiler profiler;
+        CHECK(!profiler.Initialize(MockWebGpu::GetDevice()));
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceHasFeature") == 1);
+        CHECK(!profiler.IsEnabled());
+        CHECK(!profiler.GetStats().enabled);
+
+        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(MockWebGpu::GetDevice(), nullptr);
+        for (int frame = 0; frame < 3; ++frame) {
+            profiler.BeginFrame();
+            CHECK(profiler.RenderPassWrites("Main") == nullptr);
+            CHECK(profiler.ComputePassWrites("Culling") == nullptr);
+            profiler.EndFrame(encoder);
+            profiler.OnSubmitted();
+        }
+        wgpuCommandEncoderRelease(encoder);
+
+        // No queries, readback buffers or copies were ever recorded
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateQuerySet") == 0);
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateBuffer") == 0);
+        CHECK(MockWebGpu::GetCallCount("wgpuCommandEncoderResolveQuerySet") == 0);
+        CHECK(MockWebGpu::GetCallCount("wgpuCommandEncoderCopyBufferToBuffer") == 0);
+        CHECK(MockWebGpu::GetCallCount("wgpuBufferMapAsync") == 0);
+        CHECK(profiler.GetPassTimings().empty());
+
+        std::ostringstream report;
+        profiler.Report(report);
+        CHECK(report.str() == "GPU profiler: timestamp queries not available\n");
+        profiler.Terminate();
+    }
+
+    // No device at all, e.g. it was lost before the profiler started
+    void TestWithoutDevice()
+    {
+        MockWebGpu::Reset();
+        GpuProfiler profiler;
+        CHECK(!profiler.Initialize(nullptr));
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceHasFeature") == 0);
+        CHECK(profiler.RenderPassWrites("Main") == nullptr);
+        profiler.Terminate();
+    }
+}
+
+int main()
+{
+    TestWithoutTimestamps();
+    TestWithoutDevice();
+    CHECK(MockWebGpu::GetLiveObjects() == 0);
+    std::printf("TestGpuProfiler: %d failures\n", checkFailures);
+    return checkFailures;
+}
@@ -0,0 +1,186 @@
+#include "../include/PipelineCache.h"
+#include "../include/PipelineManager.h"
+#include "../include/Logger.h"
+#include "Check.h"
+#include "MockWebGpu.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    char const* const indexPath = "TestPipelineCache.txt";
+
+    char const* const validSource = "@vertex fn vs_main() {} @fragment fn fs_main() {}";
+    char const* const invalidSource = "@vertex fn vs_main() { invalid }";
+
+    // Errors nobody captured, as the application would log them
+    std::atomic<int> uncapturedErrors{ 0 };
+
+    void OnDeviceError(WGPUErrorType type, char const* message, void* /* pUserData */)
+    {
+        if (PipelineCache::CaptureError(type, message)) return;
+        ++uncapturedErrors;
+    }
+
+    std::vector<uint64_t> ReadIndexKeys()
+    {
+        std::vector<uint64_t> keys;
+        std::ifstream file(indexPath);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line[0] != '#') keys.push_back(std::strtoull(line.c_str(), nullptr, 16));
+        }
+        return keys;
+    }
+
+    WGPURenderPipelineDescriptor PipelineDesc(WGPUFragmentState& fragment, WGPUColorTargetState& target)
+    {
+        target = {};
+        target.format = WGPUTextureFormat_RGBA8Unorm;
+        target.writeMask = WGPUColorWriteMask_All;
+        fragment = {};
+        fragment.entryPoint = "fs_main";
+        fragment.targetCount = 1;
+        fragment.targets = &target;
+
+        WGPURenderPipelineDescriptor desc = {};
+        desc.vertex.entryPoint = "vs_main";
+        desc.primitive.topology = WGPUPrimitiveTopology_TriangleList;
+        desc.multisample.count = 1;
+        desc.multisample.mask = ~0u;
+        desc.fragment = &fragment;
+        return desc;
+    }
+
+    // Failures are not cached, successes are deduplicated
+    void TestValidation()
+    {
+        PipelineCache cache;
+        cache.Initialize(MockWebGpu::GetDevice(), indexPath);
+        WGPUFragmentState fragment;
+        WGPUColorTargetState target;
+        WGPURenderPipelineDescriptor desc = PipelineDesc(fragment, target);
+
+        WGPURenderPipeline pipeline = cache.GetRenderPipeline(validSource, desc);
+        CHECK(pipeline != nullptr);
+        CHECK(cache.GetRenderPipeline(validSource, desc) == pipeline);
+        CHECK(cache.GetRenderPipeline(invalidSource, desc) == nullptr);
+        CHECK(cache.GetShaderModule(invalidSource) == nullptr);
+
+        PipelineCacheStats stats = cache.GetStats();
+        CHECK(stats.pipelineHits == 1);
+        CHECK(stats.validationFailures == 2);
+        CHECK(uncapturedErrors == 0);
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateShaderModule") == 3);
+        cache.Terminate();
+    }
+
+    // Keys of explicit layouts are handles, meaningless to the next run
+    void TestIndexSkipsExplicitLayouts()
+    {
+        std::remove(indexPath);
+        WGPUFragmentState fragment;
+        WGPUColorTargetState target;
+        WGPURenderPipelineDescriptor desc = PipelineDesc(fragment, target);
+        WGPURenderPipelineDescriptor explicitDesc = desc;
+        explicitDesc.layout = reinterpret_cast<WGPUPipelineLayout>(uintptr_t(0x1000));
+
+        for (int run = 0; run < 2; ++run) {
+            PipelineCache cache;
+            cache.Initialize(MockWebGpu::GetDevice(), indexPath);
+            CHECK(cache.GetRenderPipeline(validSource, desc) != nullptr);
+            CHECK(cache.GetRenderPipeline(validSource, explicitDesc) != nullptr);
+            PipelineCacheStats stats = cache.GetStats();
+            // The module and the pipeline with the default layout
+            CHECK(stats.diskHits == (run == 0 ? 0u : 2u));
+            CHECK(stats.diskMisses == (run == 0 ? 2u : 0u));
+            cache.Terminate();
+        }
+        CHECK(ReadIndexKeys().size() == 2);
+    }
+
+    // A full index keeps this run's keys and drops the oldest ones
+    void TestIndexIsCapped()
+    {
+        FILE* file = std::fopen(indexPath, "w");
+        for (uint64_t key = 1; key <= PipelineCache::MaxIndexKeys + 10; ++key) std::fprintf(file, "%llx\n", (unsigned long long)key);
+        std::fclose(file);
+
+        PipelineCache cache;
+        cache.Initialize(MockWebGpu::GetDevice(), indexPath);
+        WGPUFragmentState fragment;
+        WGPUColorTargetState target;
+        WGPURenderPipelineDescriptor desc = PipelineDesc(fragment, target);
+        CHECK(cache.GetRenderPipeline(validSource, desc) != nullptr);
+        cache.Terminate();
+
+        std::vector<uint64_t> keys = ReadIndexKeys();
+        CHECK(keys.size() == PipelineCache::MaxIndexKeys);
+        CHECK(keys.size() > 2 && keys[0] == PipelineCache::HashShader(validSource));
+        CHECK(keys.back() == PipelineCache::MaxIndexKeys - 2);
+    }
+
+    // The worker creates and validates every pipeline. Errors the main
+    // thread raises meanwhile are neither blamed on it nor swallowed.
+    void TestManagerValidatesOffThread()
+    {
+        PipelineCache cache;
+        cache.Initialize(MockWebGpu::GetDevice(), indexPath);
+        PipelineManager manager;
+        manager.Initialize(MockWebGpu::GetDevice(), cache);
+        WGPUFragmentState fragment;
+        WGPUColorTargetState target;
+        WGPURenderPipelineDescriptor desc = PipelineDesc(fragment, target);
+
+        PipelineHandle fallback = manager.Request("Fallback", validSource, desc);
+        PipelineHandle broken = manager.Request("Broken", invalidSource, desc, fallback);
+
+        // What a frame doing something wrong would raise
+        WGPUShaderModuleWGSLDescriptor wgsl = {};
+        wgsl.chain.sType = WGPUSType_ShaderModuleWGSLDescriptor;
+        wgsl.code = invalidSource;
+        WGPUShaderModuleDescriptor moduleDesc = {};
+        moduleDesc.nextInChain = &wgsl.chain;
+        int mainThreadErrors = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while ((manager.GetState(fallback) == PipelineState::Pending || manager.GetState(broken) == PipelineState::Pending)
+            && std::chrono::steady_clock::now() < deadline) {
+            wgpuShaderModuleRelease(wgpuDeviceCreateShaderModule(MockWebGpu::GetDevice(), &moduleDesc));
+            ++mainThreadErrors;
+        }
+
+        CHECK(manager.GetState(fallback) == PipelineState::Ready);
+        CHECK(manager.GetState(broken) == PipelineState::Failed);
+        CHECK(uncapturedErrors == mainThreadErrors);
+        CHECK(manager.Resolve(broken) == manager.Resolve(fallback));
+        CHECK(manager.GetStats().fallbackDraws == 1);
+
+        manager.Terminate();
+        cache.Terminate();
+    }
+}
+
+int main()
+{
+    Logger::Initialize(LogLevel::Error);
+    std::remove(indexPath);
+    wgpuDeviceSetUncapturedErrorCallback(MockWebGpu::GetDevice(), OnDeviceError, nullptr);
+
+    TestValidation();
+    TestIndexSkipsExplicitLayouts();
+    TestIndexIsCapped();
+    uncapturedErrors = 0;
+    TestManagerValidatesOffThread();
+
+    std::remove(indexPath);
+    Logger::Terminate();
+    CHECK(MockWebGpu::GetLiveObjects() == 0);
+    std::printf("TestPipelineCache: %d failures\n", checkFailures);
+    return checkFailures;
+}
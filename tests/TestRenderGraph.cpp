@@ -0,0 +1,189 @@
+#include "../include/RenderGraph.h"
+#include "Check.h"
+#include "MockWebGpu.h"
+
+#include <string>
+
+namespace {
+    RenderGraphTextureDesc ColorDesc()
+    {
+        RenderGraphTextureDesc desc;
+        desc.width = 64;
+        desc.height = 64;
+        desc.format = WGPUTextureFormat_RGBA8Unorm;
+        desc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding;
+        return desc;
+    }
+
+    // Passes the graph executed, in order
+    std::string executed;
+
+    RenderGraphExecute Mark(char const* name)
+    {
+        return [name](RenderGraphPassContext const&) { executed += name; };
+    }
+
+    bool Run(RenderGraph& graph)
+    {
+        executed.clear();
+        if (!graph.Compile()) return false;
+        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(MockWebGpu::GetDevice(), nullptr);
+        graph.Execute(encoder);
+        wgpuCommandEncoderRelease(encoder);
+        return true;
+    }
+
+    // A writes T and U, B only reads T, C reads U into the backbuffer. B
+    // goes, A stays for C: culling B must drop A's reference to T once only.
+    void TestCullingKeepsSharedWriter()
+    {
+        RenderGraph graph;
+        graph.Initialize(MockWebGpu::GetDevice());
+        RenderGraphResource backbuffer = graph.ImportTexture("Backbuffer", nullptr, ColorDesc());
+        RenderGraphResource t = graph.CreateTexture("T", ColorDesc());
+        RenderGraphResource u = graph.CreateTexture("U", ColorDesc());
+
+        uint32_t a = graph.AddPass("A", RenderGraphPassType::Compute, Mark("A"));
+        graph.Write(a, t);
+        graph.Write(a, u);
+        uint32_t b = graph.AddPass("B", RenderGraphPassType::Compute, Mark("B"));
+        graph.Read(b, t);
+        uint32_t c = graph.AddPass("C", RenderGraphPassType::Render, Mark("C"));
+        graph.Read(c, u);
+        graph.SetColorAttachment(c, backbuffer, WGPULoadOp_Clear);
+
+        CHECK(Run(graph));
+        CHECK(executed == "AC");
+        CHECK(graph.GetStats().culledPasses == 1);
+        graph.Terminate();
+    }
+
+    // Culling runs up the chain of passes only feeding culled ones
+    void TestCullingChain()
+    {
+        RenderGraph graph;
+        graph.Initialize(MockWebGpu::GetDevice());
+        RenderGraphResource backbuffer = graph.ImportTexture("Backbuffer", nullptr, ColorDesc());
+        RenderGraphResource t = graph.CreateTexture("T", ColorDesc());
+        RenderGraphResource u = graph.CreateTexture("U", ColorDesc());
+
+        uint32_t a = graph.AddPass("A", RenderGraphPassType::Compute, Mark("A"));
+        graph.Write(a, t);
+        uint32_t b = graph.AddPass("B", RenderGraphPassType::Compute, Mark("B"));
+        graph.Read(b, t);
+        graph.Write(b, u);
+        uint32_t c = graph.AddPass("C", RenderGraphPassType::Render, Mark("C"));
+        graph.SetColorAttachment(c, backbuffer, WGPULoadOp_Clear);
+        uint32_t d = graph.AddPass("D", RenderGraphPassType::Compute, Mark("D"));
+        graph.SetSideEffects(d);
+
+        CHECK(Run(graph));
+        CHECK(executed == "CD");
+        CHECK(graph.GetStats().culledPasses == 2);
+        CHECK(graph.GetStats().transientTextures == 0);
+        graph.Terminate();
+    }
+
+    // A clears T, B loads and draws over it. Loading keeps A alive for B, but
+    // not B itself: with nobody reading T both go.
+    void TestCullingLoadedAttachment()
+    {
+        RenderGraph graph;
+        graph.Initialize(MockWebGpu::GetDevice());
+        RenderGraphResource backbuffer = graph.ImportTexture("Backbuffer", nullptr, ColorDesc());
+        RenderGraphResource t = graph.CreateTexture("T", ColorDesc());
+
+        uint32_t a = graph.AddPass("A", RenderGraphPassType::Render, Mark("A"));
+        graph.SetColorAttachment(a, t, WGPULoadOp_Clear);
+        uint32_t b = graph.AddPass("B", RenderGraphPassType::Render, Mark("B"));
+        graph.SetColorAttachment(b, t, WGPULoadOp_Load);
+        uint32_t c = graph.AddPass("C", RenderGraphPassType::Render, Mark("C"));
+        graph.SetColorAttachment(c, backbuffer, WGPULoadOp_Clear);
+
+        CHECK(Run(graph));
+        CHECK(executed == "C");
+        CHECK(graph.GetStats().culledPasses == 2);
+        CHECK(graph.GetStats().mergedPasses == 0);
+        CHECK(graph.GetStats().transientTextures == 0);
+
+        // Once D reads T, both are needed again
+        uint32_t d = graph.AddPass("D", RenderGraphPassType::Render, Mark("D"));
+        graph.Read(d, t);
+        graph.SetColorAttachment(d, backbuffer, WGPULoadOp_Load);
+        CHECK(Run(graph));
+        CHECK(executed == "ABCD");
+        CHECK(graph.GetStats().culledPasses == 0);
+        graph.Terminate();
+    }
+
+    // A Compile() culling everything leaves no stats of the previous frame
+    void TestStatsResetOnFailedCompile()
+    {
+        RenderGraph graph;
+        graph.Initialize(MockWebGpu::GetDevice());
+        RenderGraphResource backbuffer = graph.ImportTexture("Backbuffer", nullptr, ColorDesc());
+        uint32_t a = graph.AddPass("A", RenderGraphPassType::Render, Mark("A"));
+        graph.SetColorAttachment(a, backbuffer, WGPULoadOp_Clear);
+        CHECK(Run(graph));
+        CHECK(graph.GetStats().encoderPasses == 1);
+
+        graph.Reset();
+        RenderGraphResource t = graph.CreateTexture("T", ColorDesc());
+        uint32_t b = graph.AddPass("B", RenderGraphPassType::Compute, Mark("B"));
+        graph.Write(b, t);
+        CHECK(!Run(graph));
+        CHECK(graph.GetStats().culledPasses == 1);
+        CHECK(graph.GetStats().encoderPasses == 0);
+        graph.Terminate();
+    }
+
+    // Transients with disjoint lifetimes share one texture, consecutive
+    // passes loading the same attachments share one render pass
+    void TestAliasingAndMerging()
+    {
+        RenderGraph graph;
+        graph.Initialize(MockWebGpu::GetDevice());
+        RenderGraphResource backbuffer = graph.ImportTexture("Backbuffer", nullptr, ColorDesc());
+        RenderGraphResource first = graph.CreateTexture("First", ColorDesc());
+        RenderGraphResource second = graph.CreateTexture("Second", ColorDesc());
+
+        uint32_t drawFirst = graph.AddPass("DrawFirst", RenderGraphPassType::Render, Mark("1"));
+        graph.SetColorAttachment(drawFirst, first, WGPULoadOp_Clear);
+        uint32_t useFirst = graph.AddPass("UseFirst", RenderGraphPassType::Render, Mark("2"));
+        graph.Read(useFirst, first);
+        graph.SetColorAttachment(useFirst, backbuffer, WGPULoadOp_Clear);
+        uint32_t drawSecond = graph.AddPass("DrawSecond", RenderGraphPassType::Render, Mark("3"));
+        graph.SetColorAttachment(drawSecond, second, WGPULoadOp_Clear);
+        uint32_t useSecond = graph.AddPass("UseSecond", RenderGraphPassType::Render, Mark("4"));
+        graph.Read(useSecond, second);
+        graph.SetColorAttachment(useSecond, backbuffer, WGPULoadOp_Load);
+        uint32_t overlay = graph.AddPass("Overlay", RenderGraphPassType::Render, Mark("5"));
+        graph.SetColorAttachment(overlay, backbuffer, WGPULoadOp_Load);
+
+        uint64_t texturesBefore = MockWebGpu::GetCallCount("wgpuDeviceCreateTexture");
+        CHECK(Run(graph));
+        CHECK(executed == "12345");
+        CHECK(graph.GetStats().transientTextures == 2);
+        CHECK(graph.GetStats().physicalTextures == 1);
+        CHECK(graph.GetStats().mergedPasses == 1);
+        CHECK(graph.GetStats().encoderPasses == 4);
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateTexture") - texturesBefore == 1);
+
+        // The next frame reuses the pool
+        CHECK(Run(graph));
+        CHECK(MockWebGpu::GetCallCount("wgpuDeviceCreateTexture") - texturesBefore == 1);
+        graph.Terminate();
+    }
+}
+
+int main()
+{
+    TestCullingKeepsSharedWriter();
+    TestCullingChain();
+    TestCullingLoadedAttachment();
+    TestStatsResetOnFailedCompile();
+    TestAliasingAndMerging();
+    CHECK(MockWebGpu::GetLiveObjects() == 0);
+    std::printf("TestRenderGraph: %d failures\n", checkFailures);
+    return checkFailures;
+}
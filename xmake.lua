@@ -1,12 +1,66 @@
 add_rules("mode.debug", "mode.release")
 add_requires("glfw","wgpu-native","glfw3webgpu")
 
+-- CPU_ZONE markers, exported as a Chrome trace (xmake f --cpu_profiler=n to compile them out)
+option("cpu_profiler")
+    set_default(true)
+    set_showmenu(true)
+    set_description("Record CPU profiling zones")
+    add_defines("CPU_PROFILER_ENABLED")
+option_end()
+
 
 target("WebGpu")
     set_kind("binary")
+    set_languages("c++20")
     add_files("src/*.cpp")
     add_headerfiles("include/*.h")
     add_packages("glfw","wgpu-native","glfw3webgpu" )
+    add_defines("WEBGPU_BACKEND_WGPU")
+    add_options("cpu_profiler")
+
+-- CPU-only tests and benchmarks, linked against tests/MockWebGpu.cpp instead of a real device:
+--   $ xmake build -g tests && xmake test
+--   $ xmake f -m release && xmake build -g bench && xmake run BenchRenderGraph
+local function cpu_target(name, group, files)
+    target(name)
+        set_kind("binary")
+        set_default(false)
+        set_group(group)
+        set_languages("c++20")
+        add_files(files)
+        -- For its headers: the mock defines every call these sources make,
+        -- so nothing of the library itself gets linked in
+        add_packages("wgpu-native")
+        add_defines("WEBGPU_BACKEND_WGPU")
+        add_options("cpu_profiler")
+        if group == "tests" then
+            add_tests("default")
+        end
+    target_end()
+end
+
+cpu_target("TestFrameRing", "tests", {"tests/TestFrameRing.cpp", "tests/MockWebGpu.cpp",
+    "src/FrameRing.cpp", "src/GpuHandle.cpp", "src/Logger.cpp", "src/CpuProfiler.cpp"})
+cpu_target("TestRenderGraph", "tests", {"tests/TestRenderGraph.cpp", "tests/MockWebGpu.cpp",
+    "src/RenderGraph.cpp", "src/GpuProfiler.cpp"})
+cpu_target("TestBuddyAllocator", "tests", {"tests/TestBuddyAllocator.cpp", "tests/MockWebGpu.cpp",
+    "src/BuddyAllocator.cpp", "src/GpuBufferAllocator.cpp"})
+cpu_target("BenchStbPng", "bench", {"bench/BenchStbPng.cpp",
+    "src/JobSystem.cpp", "src/CpuProfiler.cpp"})
+cpu_target("BenchStbJpg", "bench", {"bench/BenchStbJpg.cpp",
+    "src/JobSystem.cpp", "src/CpuProfiler.cpp"})
+cpu_target("TestPipelineCache", "tests", {"tests/TestPipelineCache.cpp", "tests/MockWebGpu.cpp",
+    "src/PipelineCache.cpp", "src/PipelineManager.cpp", "src/Logger.cpp", "src/CpuProfiler.cpp"})
+cpu_target("TestGpuProfiler", "tests", {"tests/TestGpuProfiler.cpp", "tests/MockWebGpu.cpp",
+    "src/GpuProfiler.cpp"})
+
+cpu_target("BenchRenderGraph", "bench", {"bench/BenchRenderGraph.cpp", "tests/MockWebGpu.cpp",
+    "src/RenderGraph.cpp", "src/GpuProfiler.cpp"})
+cpu_target("BenchJobSystem", "bench", {"bench/BenchJobSystem.cpp",
+    "src/JobSystem.cpp", "src/CpuProfiler.cpp"})
+cpu_target("BenchBuddyAllocator", "bench", {"bench/BenchBuddyAllocator.cpp", "tests/MockWebGpu.cpp",
+    "src/BuddyAllocator.cpp", "src/GpuBufferAllocator.cpp"})
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io